@@ -0,0 +1,303 @@
+/*
+bench.c - Cycle counts of the library routines, measured in the simulator
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+/*
+This program is run in simavr, once for each group of routines, selected with a BENCH_<GROUP> define. Timer 1 runs at
+the CPU clock and counts the cycles spent in every measured call. The results are written to the simulator console as
+lines "BENCH <name> <cycles>", that are read by bench.py. The image built with BENCH_NONE measures nothing, and is the
+reference to compute the flash and SRAM footprint of the other images.
+
+Timer 1 is the cycle counter, so the PWM routines are measured on timers 0 and 2.
+*/
+
+#include "rfsavr/adc.h"
+#include "rfsavr/io.h"
+#include "rfsavr/leds.h"
+#include "rfsavr/message.h"
+#include "rfsavr/pwm.h"
+#include "rfsavr/usart.h"
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/sleep.h>
+#include <avr_mcu_section.h>
+#include <stdint.h>
+
+#define LEDS_COUNT      8
+#define MESSAGE_SIZE    16
+#define USART_BULK_SIZE 16
+
+AVR_MCU(F_CPU, "atmega328p");
+AVR_MCU_SIMAVR_CONSOLE(&GPIOR0);
+
+/**
+ * @brief Measure the cycles spent executing a statement and write them to the console
+ */
+#define BENCH(name, statement)              \
+    do {                                    \
+        bench_start();                      \
+        statement;                          \
+        bench_report(name, bench_stop());   \
+    } while (0)
+
+// Cycles spent by bench_start and bench_stop themselves, measured before any routine
+static uint32_t bench_overhead;
+
+static inline __attribute__((always_inline)) void bench_start()
+{
+    TCNT1 = 0;
+    TIFR1 = _BV(TOV1);
+}
+
+/**
+ * @brief Return the cycles counted since bench_start
+ */
+static inline __attribute__((always_inline)) uint32_t bench_stop()
+{
+    uint32_t cycles = TCNT1;
+    if (TIFR1 & _BV(TOV1)) {
+        cycles += 0x10000;
+    }
+    return cycles;
+}
+
+/**
+ * @brief Write a string to the simulator console
+ */
+static void bench_print(const char *s)
+{
+    while (*s) {
+        GPIOR0 = *s++;
+    }
+}
+
+/**
+ * @brief Write an unsigned number to the simulator console
+ */
+static void bench_print_number(uint32_t n)
+{
+    char digits[11];
+    char *d = digits + sizeof(digits) - 1;
+
+    *d = '\0';
+    do {
+        *--d = '0' + n % 10;
+        n /= 10;
+    } while (n);
+    bench_print(d);
+}
+
+/**
+ * @brief Write the result of a measure to the console
+ *
+ * @param name The name of the measured routine
+ * @param cycles The cycles counted by timer 1, including the overhead of the measure
+ */
+static void bench_report(const char *name, uint32_t cycles)
+{
+    bench_print("BENCH ");
+    bench_print(name);
+    bench_print(" ");
+    bench_print_number(cycles - bench_overhead);
+    bench_print("\n");
+}
+
+#ifdef BENCH_USART
+/**
+ * @brief Measure the bytes moved one call per byte against one call for all of them
+ *
+ * The USART is in buffered mode with the interrupts disabled, so every byte stays in the ring buffers and the cost
+ * per byte does not depend on the baudrate. Each result is for USART_BULK_SIZE bytes.
+ */
+static void bench_usart_bulk(struct rfs_usart_t *usart)
+{
+    static const char data[USART_BULK_SIZE] = "0123456789abcdef";
+    static char rx_data[2 * USART_BULK_SIZE];
+    static char tx_data[2 * USART_BULK_SIZE];
+    struct rfs_ringbuf_t rx_buffer;
+    struct rfs_ringbuf_t tx_buffer;
+    char received[USART_BULK_SIZE];
+    uint8_t i;
+
+    RFS_RINGBUF_INIT(&rx_buffer, rx_data);
+    RFS_RINGBUF_INIT(&tx_buffer, tx_data);
+    rfs_usart_setbuffers(usart, &rx_buffer, &tx_buffer);
+
+    BENCH("rfs_usart_write_16", for (i = 0; i < USART_BULK_SIZE; i++) rfs_usart_write(usart, data[i]));
+    RFS_RINGBUF_INIT(&tx_buffer, tx_data);
+    BENCH("rfs_usart_write_buf_16", rfs_usart_write_buf(usart, data, USART_BULK_SIZE));
+
+    for (i = 0; i < USART_BULK_SIZE; i++) {
+        rfs_ringbuf_put(&rx_buffer, data[i]);
+    }
+    BENCH("rfs_usart_read_16", for (i = 0; i < USART_BULK_SIZE; i++) rfs_usart_read(usart, received + i));
+    for (i = 0; i < USART_BULK_SIZE; i++) {
+        rfs_ringbuf_put(&rx_buffer, data[i]);
+    }
+    BENCH("rfs_usart_read_buf_16", rfs_usart_read_buf(usart, received, USART_BULK_SIZE));
+
+    rfs_usart_setbuffers(usart, 0, 0);
+}
+
+static void bench_usart()
+{
+    struct rfs_usart_t usart;
+    char c;
+
+    rfs_usart_open(&usart, RFS_USART_0, RFS_USART_ASYNC, RFS_USART_RXTX | RFS_USART_8BITS);
+    BENCH("rfs_usart_setspeed", rfs_usart_setspeed(&usart, RFS_USART_B115200, F_CPU));
+    BENCH("rfs_usart_write", rfs_usart_write(&usart, 'a'));
+    BENCH("rfs_usart_read", rfs_usart_read(&usart, &c));
+    bench_usart_bulk(&usart);
+    rfs_usart_close(&usart);
+}
+#endif
+
+#ifdef BENCH_MESSAGE
+static void bench_message()
+{
+    static const char data[MESSAGE_SIZE] = "Hello, world!!!!";
+    struct rfs_usart_t usart;
+    struct rfs_message_t message;
+
+    rfs_usart_open(&usart, RFS_USART_0, RFS_USART_ASYNC, RFS_USART_RXTX | RFS_USART_8BITS);
+    rfs_usart_setspeed(&usart, RFS_USART_B115200, F_CPU);
+    BENCH("rfs_message_init", rfs_message_init(&message, &usart, data, MESSAGE_SIZE));
+    // The first call sends the header, the next ones the data, once the transmitter is free
+    BENCH("rfs_message_send_header", rfs_message_send(&message));
+    while (!(UCSR0A & _BV(UDRE0)));
+    BENCH("rfs_message_send_data", rfs_message_send(&message));
+    rfs_usart_close(&usart);
+}
+#endif
+
+#ifdef BENCH_PWM
+RFS_PWM_DEFINE(bench_pwm2b, 2, B)
+
+static void bench_pwm()
+{
+    struct rfs_pwm_t pwm;
+
+    BENCH("rfs_pwm_init", rfs_pwm_init(&pwm, RFS_TIMER2, RFS_PWM_CHANNEL_B));
+    BENCH("rfs_pwm_set_frequency", rfs_pwm_set_frequency(&pwm, 20000, F_CPU));
+    BENCH("rfs_pwm_set_duty_cycle_8", rfs_pwm_set_duty_cycle_8(&pwm, 128));
+    rfs_pwm_close(&pwm);
+    rfs_pwm_init(&pwm, RFS_TIMER0, RFS_PWM_CHANNEL_A);
+    BENCH("rfs_pwm_set_frequency_hint", rfs_pwm_set_frequency_hint(&pwm, 50000, F_CPU));
+    rfs_pwm_close(&pwm);
+    BENCH("RFS_PWM_DEFINE_init", bench_pwm2b_init());
+    BENCH("RFS_PWM_DEFINE_set_frequency", bench_pwm2b_set_frequency(20000, F_CPU, 2));
+    BENCH("RFS_PWM_DEFINE_set_duty_cycle", bench_pwm2b_set_duty_cycle(128));
+    bench_pwm2b_close();
+}
+#endif
+
+#ifdef BENCH_ADC
+static void bench_adc()
+{
+    uint16_t result;
+
+    rfs_adc_setreference(RFS_ADC_AVCC);
+    rfs_adc_setchannel(RFS_ADC_CHANNEL_ADC0);
+    rfs_adc_setprescaler(RFS_ADC_128);
+    rfs_adc_setenabled(1);
+    rfs_adc_start();
+    BENCH("rfs_adc_get16_pending", rfs_adc_get16(&result));
+    while (!(ADCSRA & _BV(ADIF)));
+    BENCH("rfs_adc_get16_done", rfs_adc_get16(&result));
+    rfs_adc_setenabled(0);
+}
+#endif
+
+#ifdef BENCH_LEDS
+static void bench_leds()
+{
+    static struct rfs_grb_t leds_values[LEDS_COUNT];
+    struct rfs_pin_t leds_pin;
+    uint8_t i;
+
+    for (i = 0; i < LEDS_COUNT; i++) {
+        leds_values[i].green = i;
+        leds_values[i].red = 0xff - i;
+        leds_values[i].blue = 0xa5;
+    }
+    rfs_pin_init(&leds_pin, &PORTB, 0);
+    rfs_pin_set_output(&leds_pin);
+    BENCH("rfs_leds_write", rfs_leds_write(leds_values, LEDS_COUNT, &leds_pin));
+}
+#endif
+
+#ifdef BENCH_PINS
+static void bench_pins()
+{
+    // The pin is initialized by a call, so that the compiler does not know it when inlining the helpers
+    struct rfs_pin_t pin;
+    volatile uint8_t value;
+
+    BENCH("rfs_pin_init", rfs_pin_init(&pin, &PORTB, 5));
+    BENCH("rfs_pin_set_output", rfs_pin_set_output(&pin));
+    BENCH("rfs_pin_set", rfs_pin_set(&pin));
+    BENCH("rfs_pin_reset", rfs_pin_reset(&pin));
+    BENCH("rfs_pin_toggle", rfs_pin_toggle(&pin));
+    BENCH("rfs_pin_read", value = rfs_pin_read(&pin));
+    BENCH("rfs_pin_set_input", rfs_pin_set_input(&pin));
+    (void)value;
+}
+#endif
+
+int main()
+{
+    cli();
+
+    // Timer 1 counts the CPU cycles, in normal mode and without prescaler
+    TCCR1A = 0;
+    TCCR1B = _BV(CS10);
+
+    // Calibrate the cost of the measure itself, a start and stop pair around nothing, that is subtracted from every
+    // result
+    bench_start();
+    bench_overhead = bench_stop();
+
+#ifdef BENCH_USART
+    bench_usart();
+#endif
+#ifdef BENCH_MESSAGE
+    bench_message();
+#endif
+#ifdef BENCH_PWM
+    bench_pwm();
+#endif
+#ifdef BENCH_ADC
+    bench_adc();
+#endif
+#ifdef BENCH_LEDS
+    bench_leds();
+#endif
+#ifdef BENCH_PINS
+    bench_pins();
+#endif
+    bench_print("BENCH done 0\n");
+
+    // Sleeping with the interrupts disabled stops the simulator
+    sleep_enable();
+    sleep_cpu();
+}
@@ -0,0 +1,104 @@
+#!/usr/bin/env python
+
+"""Run the benchmark programs in the simulator and compare the results with the baseline.
+
+The cycles of every routine are read from the simulator console, and the flash and SRAM footprint of every program
+from the size tool, as the difference with the benchnone.bin program. Every number is checked against baseline.txt,
+and the test fails if any of them is greater than the baseline by more than the tolerance (BENCH_TOLERANCE, in percent,
+2 by default). The numbers that have no baseline are reported as warnings and not checked. With --update, the baseline is written with the current numbers instead.
+"""
+
+import os
+import re
+import subprocess
+import sys
+
+from autotests import pass_, fail, skip
+from simtests import SIMULATOR_VARIABLE, SIMULATION_TIMEOUT
+
+GROUPS = ["usart", "message", "pwm", "adc", "leds", "pins"]
+REFERENCE_PROGRAM = "benchnone.bin"
+BASELINE_FILE = os.path.join(os.environ.get("srcdir", os.path.dirname(os.path.abspath(__file__))), "baseline.txt")
+SIZE_VARIABLE = "SIZE"
+TOLERANCE_VARIABLE = "BENCH_TOLERANCE"
+DEFAULT_TOLERANCE = 2.0
+BENCH_LINE = re.compile(r"BENCH (\S+) (\d+)")
+BASELINE_HEADER = """# Cycles of each routine and flash/SRAM bytes of each group, as written by bench.py --update
+#
+# Run "make bench-baseline" in the bench directory, in a build with simavr, to record the numbers. The routines
+# and groups missing from this file are reported as warnings and not checked.
+"""
+
+def run_bench(program_file: str) -> dict[str, int]:
+    """Run a program in the simulator and return the cycles of each measured routine."""
+    simulator = os.environ.get(SIMULATOR_VARIABLE, "")
+    if not simulator:
+        skip()
+    # simavr writes the console to stdout or stderr depending on its version
+    result = subprocess.run([simulator, program_file], check=True, timeout=SIMULATION_TIMEOUT,
+        capture_output=True, text=True)
+    cycles = {name: int(value) for name, value in BENCH_LINE.findall(result.stdout + result.stderr)}
+    if cycles.pop("done", None) is None:
+        # The program did not finish
+        fail()
+    return cycles
+
+def footprint(program_file: str) -> tuple[int, int]:
+    """Return the (flash, sram) bytes used by a program."""
+    size = os.environ.get(SIZE_VARIABLE, "")
+    if not size:
+        skip()
+    output = subprocess.run([size, program_file], check=True, capture_output=True, text=True).stdout
+    # Berkeley format: text data bss dec hex filename
+    text, data, bss = (int(field) for field in output.splitlines()[1].split()[:3])
+    return text + data, data + bss
+
+def measure() -> dict[str, int]:
+    results = {}
+    reference_flash, reference_sram = footprint(REFERENCE_PROGRAM)
+    for group in GROUPS:
+        program_file = f"bench{group}.bin"
+        results.update(run_bench(program_file))
+        flash, sram = footprint(program_file)
+        results[f"{group}.flash"] = flash - reference_flash
+        results[f"{group}.sram"] = sram - reference_sram
+    return results
+
+def read_baseline() -> dict[str, int]:
+    baseline = {}
+    with open(BASELINE_FILE) as f:
+        for line in f:
+            line = line.split("#")[0].split()
+            if line:
+                baseline[line[0]] = int(line[1])
+    return baseline
+
+def write_baseline(results: dict[str, int]) -> None:
+    with open(BASELINE_FILE, "w") as f:
+        f.write(BASELINE_HEADER)
+        for name, value in sorted(results.items()):
+            f.write(f"{name} {value}\n")
+
+def main() -> None:
+    results = measure()
+    for name, value in sorted(results.items()):
+        print(f"{name} {value}")
+    if "--update" in sys.argv[1:]:
+        write_baseline(results)
+        pass_()
+    tolerance = float(os.environ.get(TOLERANCE_VARIABLE, DEFAULT_TOLERANCE))
+    baseline = read_baseline()
+    # The routines without a baseline are not checked, but they are reported, so the baseline can be updated
+    for name in sorted(results):
+        if name not in baseline:
+            print(f"warning: no baseline for {name}, not checked", file=sys.stderr)
+    regressions = [name for name, value in baseline.items()
+        if name in results and results[name] > value * (1 + tolerance / 100)]
+    for name in regressions:
+        print(f"regression: {name}", file=sys.stderr)
+    if regressions:
+        fail()
+    pass_()
+
+if __name__ == "__main__":
+    main()
@@ -13,4 +13,16 @@ if test "x" = "x$OBJCOPY" ;
 then
   AC_MSG_ERROR([objcopy not found, try setting the OBJCOPY variable])
 fi]
-)
\ No newline at end of file
+)
+
+# Check for the simavr simulator, used to run the tests that don't need a board. It is optional.
+AC_DEFUN([AVR_CHECK_SIMULATOR],
+[AC_CHECK_PROG([RUN_AVR], [run_avr], [$as_dir/$ac_word$ac_exec_ext])
+AC_ARG_VAR([SIMAVR_CFLAGS], [C compiler flags to find the simavr headers])
+if test "x" = "x$SIMAVR_CFLAGS" ;
+then
+  SIMAVR_CFLAGS="-I/usr/include/simavr"
+fi
+AC_CHECK_TOOL([SIZE], [size], [])
+AM_CONDITIONAL([HAVE_SIMAVR], [test "x" != "x$RUN_AVR"])]
+)
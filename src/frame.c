@@ -0,0 +1,265 @@
+/*
+frame.c - Binary message protocol (COBS framing and CRC-16) to be sent using the USART subsystem
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+#include <rfsavr/crc.h>
+#include <rfsavr/frame.h>
+
+///////////////////////////////////////////////// PRIVATE FUNCTIONS //////////////////////////////////////////////////
+
+
+/**
+ * @brief Return a byte of the stream to encode (the payload followed by the CRC)
+ * 
+ * @param frame The frame being sent
+ * @param position The position of the byte in the stream
+ * 
+ * @returns The byte at the given position
+ */
+static uint8_t rfs_frame_get(const struct rfs_frame_t *frame, uint16_t position)
+{
+    if (position < frame->size) {
+        return frame->data[position];
+    } else if (position == frame->size) {
+        return frame->crc >> 8;
+    }
+    return frame->crc & 0xff;
+}
+
+/**
+ * @brief Find the end of the next COBS block, and compute its code
+ * 
+ * The block ends at the next zero, after 254 bytes or at the end of the stream. The payload bytes are
+ * added to the CRC the first time they are scanned. Since the blocks don't overlap, the CRC is complete
+ * when the scan reaches the end of the payload.
+ * 
+ * @param frame The frame being sent
+ */
+static void rfs_frame_scan(struct rfs_frame_t *frame)
+{
+    const uint16_t total = frame->size + RFS_FRAME_CRC_SIZE;
+    uint16_t end = frame->position;
+
+    while ((end < total) && ((end - frame->position) < RFS_FRAME_BLOCK_SIZE)) {
+        if (end == frame->scanned && end < frame->size) {
+            frame->crc = rfs_crc16_update(frame->crc, frame->data[end]);
+            frame->scanned++;
+        }
+        if (rfs_frame_get(frame, end) == 0) {
+            break;
+        }
+        end++;
+    }
+    frame->block_end = end;
+    frame->code = end - frame->position + 1;
+}
+
+/**
+ * @brief Move to the next COBS block, once the current one has been sent
+ * 
+ * @param frame The frame being sent
+ */
+static void rfs_frame_next_block(struct rfs_frame_t *frame)
+{
+    const uint16_t total = frame->size + RFS_FRAME_CRC_SIZE;
+
+    if (frame->position == total) {
+        frame->state = RFS_FRAME_STATE_END;
+        return;
+    }
+    if (frame->code != RFS_FRAME_BLOCK_SIZE + 1) {
+        // The block ended at a zero, that is implicit in the encoding
+        frame->position++;
+    }
+    frame->code = 0;
+    frame->state = RFS_FRAME_STATE_CODE;
+}
+
+/**
+ * @brief Discard the frame being received and wait for the next delimiter
+ * 
+ * @param frame The structure that contains the reception information
+ */
+static void rfs_frame_recv_drop(struct rfs_frame_rx_t *frame)
+{
+    if (frame->state != RFS_FRAME_RECV_STATE_SYNC) {
+        frame->bad_frames++;
+        frame->state = RFS_FRAME_RECV_STATE_SYNC;
+    }
+}
+
+/**
+ * @brief Add a decoded byte to the frame being received
+ * 
+ * @param frame The structure that contains the reception information
+ * @param data The decoded byte
+ */
+static void rfs_frame_recv_put(struct rfs_frame_rx_t *frame, uint8_t data)
+{
+    frame->crc = rfs_crc16_update(frame->crc, data);
+    if (frame->pending_count < RFS_FRAME_CRC_SIZE) {
+        frame->pending[frame->pending_count++] = data;
+        return;
+    }
+    // The oldest pending byte is not part of the CRC, move it to the payload
+    if (frame->size == frame->capacity) {
+        rfs_frame_recv_drop(frame);
+        return;
+    }
+    frame->data[frame->size++] = frame->pending[0];
+    frame->pending[0] = frame->pending[1];
+    frame->pending[1] = data;
+}
+
+/**
+ * @brief Prepare the reception of a new frame
+ * 
+ * @param frame The structure that contains the reception information
+ */
+static void rfs_frame_recv_reset(struct rfs_frame_rx_t *frame)
+{
+    frame->size = 0;
+    frame->crc = RFS_CRC16_INIT;
+    frame->pending_count = 0;
+    frame->remaining = 0;
+    frame->zero = 0;
+    frame->state = RFS_FRAME_RECV_STATE_IDLE;
+}
+
+
+///////////////////////////////////////////////// PUBLIC FUNCTIONS ///////////////////////////////////////////////////
+
+
+void rfs_frame_init(struct rfs_frame_t *frame, struct rfs_usart_t *usart, const uint8_t *data, uint16_t size)
+{
+    frame->usart = usart;
+    frame->data = data;
+    frame->size = size;
+    frame->position = 0;
+    frame->scanned = 0;
+    frame->crc = RFS_CRC16_INIT;
+    frame->code = 0;
+    frame->state = RFS_FRAME_STATE_CODE;
+}
+
+int8_t rfs_frame_send(struct rfs_frame_t *frame)
+{
+    uint16_t end;
+
+    switch (frame->state) {
+    case RFS_FRAME_STATE_CODE:
+        if (frame->code == 0) {
+            rfs_frame_scan(frame);
+        }
+        if (rfs_usart_write(frame->usart, frame->code)) {
+            if (frame->position == frame->block_end) {
+                rfs_frame_next_block(frame);
+            } else {
+                frame->state = RFS_FRAME_STATE_DATA;
+            }
+        }
+        break;
+    case RFS_FRAME_STATE_DATA:
+        if (frame->position < frame->size) {
+            // Write as many payload bytes of the block as the USART accepts
+            end = (frame->block_end < frame->size) ? frame->block_end : frame->size;
+            frame->position += rfs_usart_write_buf(frame->usart, (const char *)frame->data + frame->position,
+                end - frame->position);
+        } else if (rfs_usart_write(frame->usart, rfs_frame_get(frame, frame->position))) {
+            frame->position++;
+        }
+        if (frame->position == frame->block_end) {
+            rfs_frame_next_block(frame);
+        }
+        break;
+    case RFS_FRAME_STATE_END:
+        if (rfs_usart_write(frame->usart, RFS_FRAME_DELIMITER)) {
+            return 0;
+        }
+        break;
+    }
+    return 1;
+}
+
+void rfs_frame_recv_init(struct rfs_frame_rx_t *frame, struct rfs_usart_t *usart, uint8_t *data, uint16_t capacity)
+{
+    frame->usart = usart;
+    frame->data = data;
+    frame->capacity = capacity;
+    frame->frames = 0;
+    frame->bad_frames = 0;
+    rfs_frame_recv_reset(frame);
+}
+
+int8_t rfs_frame_recv(struct rfs_frame_rx_t *frame)
+{
+    char c;
+    int8_t result;
+
+    while ((result = rfs_usart_read(frame->usart, &c)) != 0) {
+        const uint8_t data = c;
+        if (result < 0) {
+            // Reception error, the frame in progress is lost
+            rfs_frame_recv_drop(frame);
+            continue;
+        }
+        if (data == RFS_FRAME_DELIMITER) {
+            if (frame->state == RFS_FRAME_RECV_STATE_DATA) {
+                // The CRC of the payload followed by its CRC is 0
+                if ((frame->remaining == 0) && (frame->pending_count == RFS_FRAME_CRC_SIZE) && (frame->crc == 0)) {
+                    // The size of the payload is kept for the caller, it is cleared when the next frame starts
+                    const uint16_t size = frame->size;
+                    frame->frames++;
+                    rfs_frame_recv_reset(frame);
+                    frame->size = size;
+                    return 1;
+                }
+                frame->bad_frames++;
+            }
+            rfs_frame_recv_reset(frame);
+            continue;
+        }
+        switch (frame->state) {
+        case RFS_FRAME_RECV_STATE_SYNC:
+            // Wait for the next delimiter
+            break;
+        case RFS_FRAME_RECV_STATE_IDLE:
+            frame->state = RFS_FRAME_RECV_STATE_DATA;
+            frame->size = 0;
+            // The first byte of the frame is a code
+            /* fallthrough */
+        case RFS_FRAME_RECV_STATE_DATA:
+            if (frame->remaining == 0) {
+                // New block. The previous block ended at a zero, unless it was a full block
+                if (frame->zero) {
+                    rfs_frame_recv_put(frame, 0);
+                }
+                frame->remaining = data - 1;
+                frame->zero = (data != RFS_FRAME_BLOCK_SIZE + 1);
+            } else {
+                rfs_frame_recv_put(frame, data);
+                frame->remaining--;
+            }
+            break;
+        }
+    }
+    return 0;
+}
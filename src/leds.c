@@ -25,74 +25,378 @@ along with RobotsFromScratch; see the file COPYING.  If not, see
 
 ///////////////////////////////////////////////// PUBLIC FUNCTIONS ///////////////////////////////////////////////////
 
-void rfs_leds_write(const struct rfs_grb_t *leds_values, uint8_t leds_count, struct rfs_pin_t *leds_pin)
+void rfs_leds_write(const struct rfs_grb_t *leds_values, uint16_t leds_count, struct rfs_pin_t *leds_pin)
 {
+    if (leds_count == 0) {
+        return;
+    }
     const uint8_t port_value = *leds_pin->port;
     const uint8_t port_high = port_value | _BV(leds_pin->pin);
     const uint8_t port_low = port_value & ~_BV(leds_pin->pin);
     const uint8_t *color_ptr = (const uint8_t *)leds_values;
-    const uint8_t color_value = *(color_ptr++);
-    leds_count *= 3;
+    uint8_t color_value = *(color_ptr++);
+    uint16_t bytes_count = leds_count * 3;
     uint8_t bit_mask = 0x80;
 
-    asm (
-        "set_high:" "\n\t"
-            "st %a0, %1" "\n\t"
+    // Every bit takes 20 cycles: 13 high and 7 low for a 1, 7 high and 13 low for a 0. The 16-bit byte counter is
+    // decremented with sbiw (2 cycles), which fits in the same budget because the flags it sets are tested later,
+    // in a slot that was padded with nops. When the last bit of a byte is a 1, the next color is loaded before the
+    // counter is tested, so one byte past the end of the buffer is read (and ignored)
+    asm volatile (
+        "set_high%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
             "nop" "\n\t"
-            "mov __tmp_reg__, %2" "\n\t"
-            "and __tmp_reg__, %3" "\n\t"
-            "breq write_zero" "\n\t"
+            "mov __tmp_reg__, %[color]" "\n\t"
+            "and __tmp_reg__, %[mask]" "\n\t"
+            "breq write_zero%=" "\n\t"
 
-            "lsr %3" "\n\t"
-            "brne more_bits_one" "\n\t"
+            "lsr %[mask]" "\n\t"
+            "brne more_bits_one%=" "\n\t"
 
-            "dec %4" "\n\t"
-            "breq last_color_one" "\n\t"
+            "sbiw %[count], 1" "\n\t"
+            "ld %[color], %a[ptr]+" "\n\t"
+            "ldi %[mask], 0x80" "\n\t"
 
-            "ld %2, %a5+" "\n\t"
-            "ldi %3, 0x80" "\n\t"
+        "set_low%=:" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "breq end%=" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "rjmp set_high%=" "\n\t"
 
-        "set_low:" "\n\t"
-            "st %a0, %6" "\n\t"
+        "more_bits_one%=:" "\n\t"
             "nop" "\n\t"
             "nop" "\n\t"
+            "rjmp set_low%=" "\n\t"
+
+        "write_zero%=:" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "lsr %[mask]" "\n\t"
+            "brne more_bits_zero%=" "\n\t"
+
+            "sbiw %[count], 1" "\n\t"
+            "breq end%=" "\n\t"
+
+            "ld %[color], %a[ptr]+" "\n\t"
+            "ldi %[mask], 0x80" "\n\t"
             "nop" "\n\t"
-            "rjmp set_high" "\n\t"
+            "rjmp set_high%=" "\n\t"
 
-        "more_bits_one:" "\n\t"
+        "more_bits_zero%=:" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
             "nop" "\n\t"
             "nop" "\n\t"
-            "rjmp set_low" "\n\t"
+            "rjmp set_high%=" "\n\t"
+
+        "end%=:" "\n\t"
+        : [color] "+r" (color_value), [mask] "+d" (bit_mask), [count] "+w" (bytes_count), [ptr] "+e" (color_ptr)
+        : [port] "e" (leds_pin->port), [high] "r" (port_high), [low] "r" (port_low)
+        : "memory"
+    );
+}
+
+void rfs_leds_write_parallel(const struct rfs_grb_t *leds_values, uint16_t leds_count, volatile uint8_t *port,
+    uint8_t pins_mask)
+{
+    if (leds_count == 0 || pins_mask == 0) {
+        return;
+    }
+    const uint8_t port_value = *port;
+    const uint8_t port_high = port_value | pins_mask;
+    const uint8_t port_low = port_value & ~pins_mask;
+    const uint8_t *color_ptr = (const uint8_t *)leds_values;
+    uint16_t bytes_count = leds_count * 3;
+    uint8_t strips_count = 0;
+    for (uint8_t pins = pins_mask; pins != 0; pins >>= 1) {
+        strips_count += pins & 1;
+    }
+    // Distance between the same byte of two consecutive strips, and from the byte after the last strip back to the
+    // next byte of the first one
+    const uint16_t strip_size = bytes_count;
+    const uint16_t strips_size = strips_count * strip_size - 1;
+    uint8_t strip0, strip1, strip2, strip3, strip4, strip5, strip6, strip7;
+    uint8_t plane_a, plane_b;
+
+    // The same color byte of the strips is kept in 8 registers, one for each pin. While a bit is written, the port
+    // value of the next bit is built shifting one bit out of each register (the plane), so every bit takes 25
+    // cycles: 13 high and 12 low for a 1, 7 high and 18 low for a 0. The bits are unrolled, and the planes alternate
+    // between two registers. After the last bit of each byte, the next byte of each strip in pins_mask is loaded,
+    // which keeps that bit at low level for 49 + 3 * strips cycles after a 1, and 6 more after a 0: up to 4.94 us
+    // with 8 strips
+    asm volatile (
+            "rjmp load%=" "\n\t"
+
+        "bit0%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "lsl %[d7]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "lsl %[d6]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "nop" "\n\t"
+            "st %a[port], %[pa]" "\n\t"
+            "lsl %[d5]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "lsl %[d4]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "lsl %[d3]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "lsl %[d2]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "lsl %[d1]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "lsl %[d0]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "and %[pb], %[mask]" "\n\t"
+            "or %[pb], %[low]" "\n\t"
 
-        "last_color_one:" "\n\t"
+        "bit1%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "lsl %[d7]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "lsl %[d6]" "\n\t"
+            "rol %[pa]" "\n\t"
             "nop" "\n\t"
+            "st %a[port], %[pb]" "\n\t"
+            "lsl %[d5]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "lsl %[d4]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "lsl %[d3]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "lsl %[d2]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "lsl %[d1]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "lsl %[d0]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "and %[pa], %[mask]" "\n\t"
+            "or %[pa], %[low]" "\n\t"
+
+        "bit2%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "lsl %[d7]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "lsl %[d6]" "\n\t"
+            "rol %[pb]" "\n\t"
             "nop" "\n\t"
-            "st %a0, %6" "\n\t"
-            "rjmp end" "\n\t"
+            "st %a[port], %[pa]" "\n\t"
+            "lsl %[d5]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "lsl %[d4]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "lsl %[d3]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "lsl %[d2]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "lsl %[d1]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "lsl %[d0]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "and %[pb], %[mask]" "\n\t"
+            "or %[pb], %[low]" "\n\t"
 
-        "write_zero:" "\n\t"
-            "st %a0, %6" "\n\t"
+        "bit3%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "lsl %[d7]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "lsl %[d6]" "\n\t"
+            "rol %[pa]" "\n\t"
             "nop" "\n\t"
+            "st %a[port], %[pb]" "\n\t"
+            "lsl %[d5]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "lsl %[d4]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "lsl %[d3]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "lsl %[d2]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "lsl %[d1]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "lsl %[d0]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "and %[pa], %[mask]" "\n\t"
+            "or %[pa], %[low]" "\n\t"
+
+        "bit4%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "lsl %[d7]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "lsl %[d6]" "\n\t"
+            "rol %[pb]" "\n\t"
             "nop" "\n\t"
-            "lsr %3" "\n\t"
-            "brne more_bits_zero" "\n\t"
+            "st %a[port], %[pa]" "\n\t"
+            "lsl %[d5]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "lsl %[d4]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "lsl %[d3]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "lsl %[d2]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "lsl %[d1]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "lsl %[d0]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "and %[pb], %[mask]" "\n\t"
+            "or %[pb], %[low]" "\n\t"
 
-            "dec %4" "\n\t"
-            "breq end" "\n\t"
+        "bit5%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "lsl %[d7]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "lsl %[d6]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "nop" "\n\t"
+            "st %a[port], %[pb]" "\n\t"
+            "lsl %[d5]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "lsl %[d4]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "lsl %[d3]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "lsl %[d2]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "lsl %[d1]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "lsl %[d0]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "and %[pa], %[mask]" "\n\t"
+            "or %[pa], %[low]" "\n\t"
 
-            "ld %2, %a5+" "\n\t"
-            "ldi %3, 0x80" "\n\t"
-            "rjmp set_high" "\n\t"
+        "bit6%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "lsl %[d7]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "lsl %[d6]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "nop" "\n\t"
+            "st %a[port], %[pa]" "\n\t"
+            "lsl %[d5]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "lsl %[d4]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "lsl %[d3]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "lsl %[d2]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "lsl %[d1]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "lsl %[d0]" "\n\t"
+            "rol %[pb]" "\n\t"
+            "and %[pb], %[mask]" "\n\t"
+            "or %[pb], %[low]" "\n\t"
 
-        "more_bits_zero:" "\n\t"
+        "bit7%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "sbiw %[count], 1" "\n\t"
+            "nop" "\n\t"
             "nop" "\n\t"
             "nop" "\n\t"
+            "st %a[port], %[pb]" "\n\t"
             "nop" "\n\t"
             "nop" "\n\t"
-            "rjmp set_high" "\n\t"
-            
-        "end:" "\n\t"
-        :
-        : "e" (leds_pin->port), "r" (port_high), "r" (color_value), "r" (bit_mask), "r" (leds_count), "e" (color_ptr), "r" (port_low)
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "breq end%=" "\n\t"
+
+        "load%=:" "\n\t"
+            "sbrs %[mask], 0" "\n\t"
+            "rjmp skip0%=" "\n\t"
+            "ld %[d0], %a[ptr]" "\n\t"
+            "add %A[ptr], %A[stride]" "\n\t"
+            "adc %B[ptr], %B[stride]" "\n\t"
+
+        "skip0%=:" "\n\t"
+            "sbrs %[mask], 1" "\n\t"
+            "rjmp skip1%=" "\n\t"
+            "ld %[d1], %a[ptr]" "\n\t"
+            "add %A[ptr], %A[stride]" "\n\t"
+            "adc %B[ptr], %B[stride]" "\n\t"
+
+        "skip1%=:" "\n\t"
+            "sbrs %[mask], 2" "\n\t"
+            "rjmp skip2%=" "\n\t"
+            "ld %[d2], %a[ptr]" "\n\t"
+            "add %A[ptr], %A[stride]" "\n\t"
+            "adc %B[ptr], %B[stride]" "\n\t"
+
+        "skip2%=:" "\n\t"
+            "sbrs %[mask], 3" "\n\t"
+            "rjmp skip3%=" "\n\t"
+            "ld %[d3], %a[ptr]" "\n\t"
+            "add %A[ptr], %A[stride]" "\n\t"
+            "adc %B[ptr], %B[stride]" "\n\t"
+
+        "skip3%=:" "\n\t"
+            "sbrs %[mask], 4" "\n\t"
+            "rjmp skip4%=" "\n\t"
+            "ld %[d4], %a[ptr]" "\n\t"
+            "add %A[ptr], %A[stride]" "\n\t"
+            "adc %B[ptr], %B[stride]" "\n\t"
+
+        "skip4%=:" "\n\t"
+            "sbrs %[mask], 5" "\n\t"
+            "rjmp skip5%=" "\n\t"
+            "ld %[d5], %a[ptr]" "\n\t"
+            "add %A[ptr], %A[stride]" "\n\t"
+            "adc %B[ptr], %B[stride]" "\n\t"
+
+        "skip5%=:" "\n\t"
+            "sbrs %[mask], 6" "\n\t"
+            "rjmp skip6%=" "\n\t"
+            "ld %[d6], %a[ptr]" "\n\t"
+            "add %A[ptr], %A[stride]" "\n\t"
+            "adc %B[ptr], %B[stride]" "\n\t"
+
+        "skip6%=:" "\n\t"
+            "sbrs %[mask], 7" "\n\t"
+            "rjmp skip7%=" "\n\t"
+            "ld %[d7], %a[ptr]" "\n\t"
+            "add %A[ptr], %A[stride]" "\n\t"
+            "adc %B[ptr], %B[stride]" "\n\t"
+
+        "skip7%=:" "\n\t"
+            "sub %A[ptr], %A[back]" "\n\t"
+            "sbc %B[ptr], %B[back]" "\n\t"
+            "lsl %[d7]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "lsl %[d6]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "lsl %[d5]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "lsl %[d4]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "lsl %[d3]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "lsl %[d2]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "lsl %[d1]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "lsl %[d0]" "\n\t"
+            "rol %[pa]" "\n\t"
+            "and %[pa], %[mask]" "\n\t"
+            "or %[pa], %[low]" "\n\t"
+            "rjmp bit0%=" "\n\t"
+
+        "end%=:" "\n\t"
+        : [d0] "=&r" (strip0), [d1] "=&r" (strip1), [d2] "=&r" (strip2), [d3] "=&r" (strip3),
+          [d4] "=&r" (strip4), [d5] "=&r" (strip5), [d6] "=&r" (strip6), [d7] "=&r" (strip7),
+          [pa] "=&r" (plane_a), [pb] "=&r" (plane_b),
+          [count] "+w" (bytes_count), [ptr] "+z" (color_ptr)
+        : [port] "e" (port), [high] "r" (port_high), [low] "r" (port_low), [mask] "r" (pins_mask),
+          [stride] "r" (strip_size), [back] "r" (strips_size)
+        : "memory"
     );
-}
\ No newline at end of file
+}
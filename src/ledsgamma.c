@@ -0,0 +1,236 @@
+/*
+ledsgamma.c - WS2812B LEDs output with brightness and gamma correction
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+#include <rfsavr/leds.h>
+
+
+///////////////////////////////////////////////// PUBLIC VARIABLES ///////////////////////////////////////////////////
+
+const uint8_t RFS_LEDS_GAMMA[256] PROGMEM = {
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   1,   1,   1,
+      1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+      2,   3,   3,   3,   3,   3,   3,   3,   4,   4,   4,   4,   4,   5,   5,   5,
+      5,   6,   6,   6,   6,   7,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,
+     10,  10,  11,  11,  11,  12,  12,  13,  13,  13,  14,  14,  15,  15,  16,  16,
+     17,  17,  18,  18,  19,  19,  20,  20,  21,  21,  22,  22,  23,  24,  24,  25,
+     25,  26,  27,  27,  28,  29,  29,  30,  31,  32,  32,  33,  34,  35,  35,  36,
+     37,  38,  39,  39,  40,  41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  50,
+     51,  52,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,  64,  66,  67,  68,
+     69,  70,  72,  73,  74,  75,  77,  78,  79,  81,  82,  83,  85,  86,  87,  89,
+     90,  92,  93,  95,  96,  98,  99, 101, 102, 104, 105, 107, 109, 110, 112, 114,
+    115, 117, 119, 120, 122, 124, 126, 127, 129, 131, 133, 135, 137, 138, 140, 142,
+    144, 146, 148, 150, 152, 154, 156, 158, 160, 162, 164, 167, 169, 171, 173, 175,
+    177, 180, 182, 184, 186, 189, 191, 193, 196, 198, 200, 203, 205, 208, 210, 213,
+    215, 218, 220, 223, 225, 228, 231, 233, 236, 239, 241, 244, 247, 249, 252, 255
+};
+
+
+///////////////////////////////////////////////// PUBLIC FUNCTIONS ///////////////////////////////////////////////////
+
+void rfs_leds_write_scaled(const struct rfs_grb_t *leds_values, uint16_t leds_count, struct rfs_pin_t *leds_pin,
+    uint8_t brightness, const uint8_t *gamma_table)
+{
+    if (leds_count == 0) {
+        return;
+    }
+    const uint8_t port_value = *leds_pin->port;
+    const uint8_t port_high = port_value | _BV(leds_pin->pin);
+    const uint8_t port_low = port_value & ~_BV(leds_pin->pin);
+    const uint8_t *color_ptr = (const uint8_t *)leds_values;
+    uint16_t bytes_count = leds_count * 3;
+    uint8_t color_value, next_value, bit_value, zero;
+    uint16_t table_ptr;
+
+    // Every bit takes 20 cycles, like in rfs_leds_write, but the bits of a byte are unrolled and have no branches: the
+    // value of the middle store is selected with sbrc, so all the bits have the same timing. The next byte is loaded,
+    // scaled by (brightness + 1) / 256 and corrected with the gamma table in the free slots of the first two bits,
+    // so it is ready when the current byte ends. The byte after the last one is also loaded (and ignored).
+    // r1 (the zero register) is overwritten by mul and cleared right after
+    asm volatile (
+            "clr %[zero]" "\n\t"
+            "movw %[z], %[ptr]" "\n\t"
+            "ld %[next], %a[z]+" "\n\t"
+            "movw %[ptr], %[z]" "\n\t"
+            "mul %[next], %[bright]" "\n\t"
+            "add r0, %[next]" "\n\t"
+            "adc r1, %[zero]" "\n\t"
+            "movw %[z], %[table]" "\n\t"
+            "add %A[z], r1" "\n\t"
+            "adc %B[z], %[zero]" "\n\t"
+            "clr r1" "\n\t"
+            "lpm %[cur], %a[z]" "\n\t"
+
+        "bit0%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "movw %[z], %[ptr]" "\n\t"
+            "nop" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 7" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "ld %[next], %a[z]+" "\n\t"
+            "movw %[ptr], %[z]" "\n\t"
+            "nop" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "mul %[next], %[bright]" "\n\t"
+            "add r0, %[next]" "\n\t"
+            "adc r1, %[zero]" "\n\t"
+            "nop" "\n\t"
+
+        "bit1%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "movw %[z], %[table]" "\n\t"
+            "add %A[z], r1" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 6" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "adc %B[z], %[zero]" "\n\t"
+            "clr r1" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "lpm %[next], %a[z]" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+
+        "bit2%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 5" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+
+        "bit3%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 4" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+
+        "bit4%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 3" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+
+        "bit5%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 2" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+
+        "bit6%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 1" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+
+        "bit7%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 0" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "nop" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "mov %[cur], %[next]" "\n\t"
+            "sbiw %[count], 1" "\n\t"
+            "brne bit0%=" "\n\t"
+
+        "end%=:" "\n\t"
+        : [cur] "=&r" (color_value), [next] "=&r" (next_value), [bit] "=&r" (bit_value), [zero] "=&r" (zero),
+          [z] "=&z" (table_ptr), [count] "+w" (bytes_count), [ptr] "+r" (color_ptr)
+        : [port] "e" (leds_pin->port), [high] "r" (port_high), [low] "r" (port_low), [bright] "r" (brightness),
+          [table] "r" (gamma_table)
+        : "memory"
+    );
+}
@@ -0,0 +1,596 @@
+/*
+ledspalette.c - WS2812B LEDs output from palette indexes
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+/*
+The writers in this file share the same structure. The 8 bits of a byte are unrolled and every bit takes exactly 20
+cycles, like in rfs_leds_write: 7 cycles high, then the value of the bit (selected with sbrc, so both values take the
+same time), then 7 cycles low. The free cycles between the stores are used to load the next byte from the palette entry
+of its LED and to find the palette entry of the following LED, always executing the same instructions (the updates are
+done with sbrc and a one word instruction), so the timing doesn't depend on the data. The free cycles that are left
+are filled with "rjmp .+0", a two cycles nop.
+
+position tells which byte of its LED is the next byte: 4, 2 and 1 for the green, red and blue bytes. When the blue byte
+is loaded, the entry of the following LED, already computed, is taken.
+*/
+
+#include <rfsavr/leds.h>
+
+
+///////////////////////////////////////////////// PUBLIC FUNCTIONS ///////////////////////////////////////////////////
+
+void rfs_leds_write_palette(const uint8_t *leds_indexes, uint16_t leds_count, const struct rfs_grb_t *palette,
+    struct rfs_pin_t *leds_pin)
+{
+    if (leds_count == 0) {
+        return;
+    }
+    const uint8_t port_value = *leds_pin->port;
+    const uint8_t port_high = port_value | _BV(leds_pin->pin);
+    const uint8_t port_low = port_value & ~_BV(leds_pin->pin);
+    uint16_t bytes_count = leds_count * 3;
+    uint8_t position = 4;
+    uint8_t color_value, next_value, bit_value, led_index, last_byte;
+    uint16_t scratch;
+    const struct rfs_grb_t *entry = palette + leds_indexes[0];
+    const uint8_t *index = leds_indexes + 1;
+
+    // index points to the index of the LED after the one of entry. The index after the last LED is also read (and
+    // ignored)
+    asm volatile (
+            "movw %[x], %[entry]" "\n\t"
+            "ld %[next], %a[x]+" "\n\t"
+            "movw %[entry], %[x]" "\n\t"
+            "movw %[x], %[index]" "\n\t"
+            "ld %[led], %a[x]" "\n\t"
+            "movw %[x], %[palette]" "\n\t"
+            "add %A[x], %[led]" "\n\t"
+            "adc %B[x], __zero_reg__" "\n\t"
+            "add %A[x], %[led]" "\n\t"
+            "adc %B[x], __zero_reg__" "\n\t"
+            "add %A[x], %[led]" "\n\t"
+            "adc %B[x], __zero_reg__" "\n\t"
+            "mov %[last], %[position]" "\n\t"
+            "andi %[last], 1" "\n\t"
+            "sbrc %[last], 0" "\n\t"
+            "movw %[entry], %[x]" "\n\t"
+            "add %A[index], %[last]" "\n\t"
+            "adc %B[index], __zero_reg__" "\n\t"
+            "lsr %[position]" "\n\t"
+            "sbrc %[last], 0" "\n\t"
+            "ldi %[position], 4" "\n\t"
+            "mov %[cur], %[next]" "\n\t"
+
+        "bit0%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "movw %[x], %[entry]" "\n\t"
+            "nop" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 7" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "ld %[next], %a[x]+" "\n\t"
+            "movw %[entry], %[x]" "\n\t"
+            "movw %[x], %[index]" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "ld %[led], %a[x]" "\n\t"
+            "movw %[x], %[palette]" "\n\t"
+            "add %A[x], %[led]" "\n\t"
+            "adc %B[x], __zero_reg__" "\n\t"
+
+        "bit1%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "add %A[x], %[led]" "\n\t"
+            "adc %B[x], __zero_reg__" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 6" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "add %A[x], %[led]" "\n\t"
+            "adc %B[x], __zero_reg__" "\n\t"
+            "mov %[last], %[position]" "\n\t"
+            "andi %[last], 1" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "sbrc %[last], 0" "\n\t"
+            "movw %[entry], %[x]" "\n\t"
+            "add %A[index], %[last]" "\n\t"
+            "adc %B[index], __zero_reg__" "\n\t"
+            "lsr %[position]" "\n\t"
+
+        "bit2%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "sbrc %[last], 0" "\n\t"
+            "ldi %[position], 4" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 5" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "rjmp .+0" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "rjmp .+0" "\n\t"
+            "nop" "\n\t"
+
+        "bit3%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 4" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "rjmp .+0" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "rjmp .+0" "\n\t"
+            "nop" "\n\t"
+
+        "bit4%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 3" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "rjmp .+0" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "rjmp .+0" "\n\t"
+            "nop" "\n\t"
+
+        "bit5%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 2" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "rjmp .+0" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "rjmp .+0" "\n\t"
+            "nop" "\n\t"
+
+        "bit6%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 1" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "rjmp .+0" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "rjmp .+0" "\n\t"
+            "nop" "\n\t"
+
+        "bit7%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 0" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "rjmp .+0" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "mov %[cur], %[next]" "\n\t"
+            "sbiw %[count], 1" "\n\t"
+            "brne bit0%=" "\n\t"
+
+        "end%=:" "\n\t"
+        : [cur] "=&r" (color_value), [next] "=&r" (next_value), [bit] "=&r" (bit_value), [led] "=&d" (led_index),
+          [last] "=&d" (last_byte), [position] "+d" (position), [x] "=&x" (scratch), [count] "+w" (bytes_count),
+          [entry] "+r" (entry), [index] "+r" (index)
+        : [port] "z" (leds_pin->port), [high] "r" (port_high), [low] "r" (port_low), [palette] "r" (palette)
+        : "memory"
+    );
+}
+
+void rfs_leds_write_palette4(const uint8_t *leds_indexes, uint16_t leds_count, const struct rfs_grb_t *palette,
+    struct rfs_pin_t *leds_pin)
+{
+    if (leds_count == 0) {
+        return;
+    }
+    const uint8_t port_value = *leds_pin->port;
+    const uint8_t port_high = port_value | _BV(leds_pin->pin);
+    const uint8_t port_low = port_value & ~_BV(leds_pin->pin);
+    uint16_t bytes_count = leds_count * 3;
+    uint8_t position = 4;
+    uint8_t color_value, next_value, bit_value, led_index, last_byte;
+    uint16_t scratch;
+    uint8_t nibble = 1;
+    uint8_t tmp;
+    const struct rfs_grb_t *entry = palette + (leds_indexes[0] >> 4);
+    const uint8_t *index = leds_indexes;
+
+    // index points to the byte that contains the index of the LED after the one of entry, which is in the high
+    // nibble if nibble is 0, or in the low nibble if nibble is 1. index only advances after a low nibble
+    asm volatile (
+            "movw %[x], %[entry]" "\n\t"
+            "ld %[next], %a[x]+" "\n\t"
+            "movw %[entry], %[x]" "\n\t"
+            "movw %[x], %[index]" "\n\t"
+            "ld %[led], %a[x]" "\n\t"
+            "sbrs %[nibble], 0" "\n\t"
+            "swap %[led]" "\n\t"
+            "andi %[led], 0x0f" "\n\t"
+            "movw %[x], %[palette]" "\n\t"
+            "add %A[x], %[led]" "\n\t"
+            "adc %B[x], __zero_reg__" "\n\t"
+            "add %A[x], %[led]" "\n\t"
+            "adc %B[x], __zero_reg__" "\n\t"
+            "add %A[x], %[led]" "\n\t"
+            "adc %B[x], __zero_reg__" "\n\t"
+            "mov %[last], %[position]" "\n\t"
+            "andi %[last], 1" "\n\t"
+            "sbrc %[last], 0" "\n\t"
+            "movw %[entry], %[x]" "\n\t"
+            "mov %[tmp], %[last]" "\n\t"
+            "and %[tmp], %[nibble]" "\n\t"
+            "add %A[index], %[tmp]" "\n\t"
+            "adc %B[index], __zero_reg__" "\n\t"
+            "eor %[nibble], %[last]" "\n\t"
+            "lsr %[position]" "\n\t"
+            "sbrc %[last], 0" "\n\t"
+            "ldi %[position], 4" "\n\t"
+            "mov %[cur], %[next]" "\n\t"
+
+        "bit0%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "movw %[x], %[entry]" "\n\t"
+            "nop" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 7" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "ld %[next], %a[x]+" "\n\t"
+            "movw %[entry], %[x]" "\n\t"
+            "movw %[x], %[index]" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "ld %[led], %a[x]" "\n\t"
+            "sbrs %[nibble], 0" "\n\t"
+            "swap %[led]" "\n\t"
+            "andi %[led], 0x0f" "\n\t"
+
+        "bit1%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "movw %[x], %[palette]" "\n\t"
+            "add %A[x], %[led]" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 6" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "adc %B[x], __zero_reg__" "\n\t"
+            "add %A[x], %[led]" "\n\t"
+            "adc %B[x], __zero_reg__" "\n\t"
+            "add %A[x], %[led]" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "adc %B[x], __zero_reg__" "\n\t"
+            "mov %[last], %[position]" "\n\t"
+            "andi %[last], 1" "\n\t"
+            "sbrc %[last], 0" "\n\t"
+            "movw %[entry], %[x]" "\n\t"
+
+        "bit2%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "mov %[tmp], %[last]" "\n\t"
+            "and %[tmp], %[nibble]" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 5" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "add %A[index], %[tmp]" "\n\t"
+            "adc %B[index], __zero_reg__" "\n\t"
+            "eor %[nibble], %[last]" "\n\t"
+            "lsr %[position]" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "sbrc %[last], 0" "\n\t"
+            "ldi %[position], 4" "\n\t"
+            "rjmp .+0" "\n\t"
+            "nop" "\n\t"
+
+        "bit3%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 4" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "rjmp .+0" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "rjmp .+0" "\n\t"
+            "nop" "\n\t"
+
+        "bit4%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 3" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "rjmp .+0" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "rjmp .+0" "\n\t"
+            "nop" "\n\t"
+
+        "bit5%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 2" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "rjmp .+0" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "rjmp .+0" "\n\t"
+            "nop" "\n\t"
+
+        "bit6%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 1" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "rjmp .+0" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "rjmp .+0" "\n\t"
+            "nop" "\n\t"
+
+        "bit7%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 0" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "rjmp .+0" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "mov %[cur], %[next]" "\n\t"
+            "sbiw %[count], 1" "\n\t"
+            "brne bit0%=" "\n\t"
+
+        "end%=:" "\n\t"
+        : [cur] "=&r" (color_value), [next] "=&r" (next_value), [bit] "=&r" (bit_value), [led] "=&d" (led_index),
+          [last] "=&d" (last_byte), [position] "+d" (position), [x] "=&x" (scratch), [count] "+w" (bytes_count),
+          [entry] "+r" (entry), [index] "+r" (index),
+          [nibble] "+r" (nibble), [tmp] "=&r" (tmp)
+        : [port] "z" (leds_pin->port), [high] "r" (port_high), [low] "r" (port_low), [palette] "r" (palette)
+        : "memory"
+    );
+}
+
+void rfs_leds_write_rle(const struct rfs_leds_span_t *leds_spans, uint16_t leds_count, const struct rfs_grb_t *palette,
+    struct rfs_pin_t *leds_pin)
+{
+    if (leds_count == 0) {
+        return;
+    }
+    const uint8_t port_value = *leds_pin->port;
+    const uint8_t port_high = port_value | _BV(leds_pin->pin);
+    const uint8_t port_low = port_value & ~_BV(leds_pin->pin);
+    uint16_t bytes_count = leds_count * 3;
+    uint8_t position = 4;
+    uint8_t color_value, next_value, bit_value, led_index, last_byte;
+    uint16_t scratch;
+    uint8_t run = leds_spans[0].count - 1;
+    uint8_t tmp, span_count, empty;
+    const struct rfs_grb_t *entry = palette + leds_spans[0].index;
+    const struct rfs_leds_span_t *index = leds_spans;
+
+    // index points to the span of the LED after the one of entry, and run is the number of LEDs left in that span.
+    // Both the index of the current span and the next one are read, and empty (0xff when run is 0) selects one. The
+    // span after the last one is also read (and ignored)
+    asm volatile (
+            "movw %[x], %[entry]" "\n\t"
+            "ld %[next], %a[x]+" "\n\t"
+            "movw %[entry], %[x]" "\n\t"
+            "movw %[x], %[index]" "\n\t"
+            "adiw %[x], 1" "\n\t"
+            "ld %[led], %a[x]+" "\n\t"
+            "ld %[span], %a[x]+" "\n\t"
+            "ld %[tmp], %a[x]" "\n\t"
+            "mov %[last], %[run]" "\n\t"
+            "subi %[last], 1" "\n\t"
+            "sbc %[empty], %[empty]" "\n\t"
+            "sbrc %[empty], 0" "\n\t"
+            "mov %[led], %[tmp]" "\n\t"
+            "movw %[x], %[palette]" "\n\t"
+            "add %A[x], %[led]" "\n\t"
+            "adc %B[x], __zero_reg__" "\n\t"
+            "add %A[x], %[led]" "\n\t"
+            "adc %B[x], __zero_reg__" "\n\t"
+            "add %A[x], %[led]" "\n\t"
+            "adc %B[x], __zero_reg__" "\n\t"
+            "mov %[last], %[position]" "\n\t"
+            "andi %[last], 1" "\n\t"
+            "sbrc %[last], 0" "\n\t"
+            "movw %[entry], %[x]" "\n\t"
+            "dec %[span]" "\n\t"
+            "mov %[tmp], %[run]" "\n\t"
+            "dec %[tmp]" "\n\t"
+            "sbrc %[empty], 0" "\n\t"
+            "mov %[tmp], %[span]" "\n\t"
+            "sbrc %[last], 0" "\n\t"
+            "mov %[run], %[tmp]" "\n\t"
+            "mov %[tmp], %[last]" "\n\t"
+            "and %[tmp], %[empty]" "\n\t"
+            "lsl %[tmp]" "\n\t"
+            "add %A[index], %[tmp]" "\n\t"
+            "adc %B[index], __zero_reg__" "\n\t"
+            "lsr %[position]" "\n\t"
+            "sbrc %[last], 0" "\n\t"
+            "ldi %[position], 4" "\n\t"
+            "mov %[cur], %[next]" "\n\t"
+
+        "bit0%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "movw %[x], %[entry]" "\n\t"
+            "nop" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 7" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "ld %[next], %a[x]+" "\n\t"
+            "movw %[entry], %[x]" "\n\t"
+            "movw %[x], %[index]" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "adiw %[x], 1" "\n\t"
+            "ld %[led], %a[x]+" "\n\t"
+            "nop" "\n\t"
+
+        "bit1%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "ld %[span], %a[x]+" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 6" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "ld %[tmp], %a[x]" "\n\t"
+            "mov %[last], %[run]" "\n\t"
+            "subi %[last], 1" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "sbc %[empty], %[empty]" "\n\t"
+            "sbrc %[empty], 0" "\n\t"
+            "mov %[led], %[tmp]" "\n\t"
+            "movw %[x], %[palette]" "\n\t"
+            "add %A[x], %[led]" "\n\t"
+
+        "bit2%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "adc %B[x], __zero_reg__" "\n\t"
+            "add %A[x], %[led]" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 5" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "adc %B[x], __zero_reg__" "\n\t"
+            "add %A[x], %[led]" "\n\t"
+            "adc %B[x], __zero_reg__" "\n\t"
+            "mov %[last], %[position]" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "andi %[last], 1" "\n\t"
+            "sbrc %[last], 0" "\n\t"
+            "movw %[entry], %[x]" "\n\t"
+            "dec %[span]" "\n\t"
+            "mov %[tmp], %[run]" "\n\t"
+
+        "bit3%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "dec %[tmp]" "\n\t"
+            "nop" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 4" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "sbrc %[empty], 0" "\n\t"
+            "mov %[tmp], %[span]" "\n\t"
+            "sbrc %[last], 0" "\n\t"
+            "mov %[run], %[tmp]" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "mov %[tmp], %[last]" "\n\t"
+            "and %[tmp], %[empty]" "\n\t"
+            "lsl %[tmp]" "\n\t"
+            "add %A[index], %[tmp]" "\n\t"
+            "adc %B[index], __zero_reg__" "\n\t"
+
+        "bit4%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "lsr %[position]" "\n\t"
+            "nop" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 3" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "sbrc %[last], 0" "\n\t"
+            "ldi %[position], 4" "\n\t"
+            "rjmp .+0" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "rjmp .+0" "\n\t"
+            "nop" "\n\t"
+
+        "bit5%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 2" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "rjmp .+0" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "rjmp .+0" "\n\t"
+            "nop" "\n\t"
+
+        "bit6%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 1" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "rjmp .+0" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "rjmp .+0" "\n\t"
+            "nop" "\n\t"
+
+        "bit7%=:" "\n\t"
+            "st %a[port], %[high]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "mov %[bit], %[low]" "\n\t"
+            "sbrc %[cur], 0" "\n\t"
+            "mov %[bit], %[high]" "\n\t"
+            "st %a[port], %[bit]" "\n\t"
+            "rjmp .+0" "\n\t"
+            "rjmp .+0" "\n\t"
+            "st %a[port], %[low]" "\n\t"
+            "mov %[cur], %[next]" "\n\t"
+            "sbiw %[count], 1" "\n\t"
+            "brne bit0%=" "\n\t"
+
+        "end%=:" "\n\t"
+        : [cur] "=&r" (color_value), [next] "=&r" (next_value), [bit] "=&r" (bit_value), [led] "=&d" (led_index),
+          [last] "=&d" (last_byte), [position] "+d" (position), [x] "=&x" (scratch), [count] "+w" (bytes_count),
+          [entry] "+r" (entry), [index] "+r" (index),
+          [run] "+r" (run), [tmp] "=&r" (tmp), [span] "=&r" (span_count), [empty] "=&r" (empty)
+        : [port] "z" (leds_pin->port), [high] "r" (port_high), [low] "r" (port_low), [palette] "r" (palette)
+        : "memory"
+    );
+}
@@ -0,0 +1,81 @@
+/*
+ledsspi.c - Drive WS2812B LEDs with the USART in Master SPI mode
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+#include <rfsavr/leds.h>
+#include <rfsavr/errno.h>
+
+/**
+ * @brief Number of WS2812B symbols sent in each SPI byte.
+ */
+#define RFS_LEDS_SPI_SYMBOLS_PER_BYTE   4
+
+
+///////////////////////////////////////////////// PUBLIC FUNCTIONS ///////////////////////////////////////////////////
+
+int8_t rfs_leds_spi_open(struct rfs_usart_t *usart, uint32_t cpu_frequency)
+{
+    // The SPI bit lasts 2 * (UBRR + 1) cycles. Find the shortest one that is long enough
+    const uint32_t cpu_khz = cpu_frequency / 1000;
+    const uint32_t min_cycles = (cpu_khz * RFS_LEDS_SPI_BIT_MIN_NS + 999999) / 1000000;
+    const uint32_t quotient = (min_cycles + 1) / 2;
+
+    if (quotient == 0 || quotient > RFS_USART_UBRR_MAX + 1
+        || (2 * quotient * 1000000) / cpu_khz > RFS_LEDS_SPI_BIT_MAX_NS) {
+        rfs_errno = RFS_ETIMING;
+        return -1;
+    }
+    rfs_usart_open(usart, RFS_USART_0, RFS_USART_MASTERSPI, RFS_USART_TX | RFS_USART_SPI_MSBFIRST);
+    *(usart->ubrr) = quotient - 1;
+    return 1;
+}
+
+void rfs_leds_spi_write_init(struct rfs_leds_spi_t *leds, struct rfs_usart_t *usart,
+    const struct rfs_grb_t *leds_values, uint16_t leds_count)
+{
+    leds->usart = usart;
+    leds->data = (const uint8_t *)leds_values;
+    leds->size = leds_count * 3;
+    leds->position = 0;
+    leds->pending = 0;
+}
+
+int8_t rfs_leds_spi_write(struct rfs_leds_spi_t *leds)
+{
+    volatile uint8_t *const ucsra = leds->usart->ucsra;
+    volatile uint8_t *const udr = leds->usart->udr;
+
+    while (*ucsra & _BV(UDRE0)) {
+        if (leds->pending == 0) {
+            if (leds->position == leds->size) {
+                return 0;
+            }
+            leds->current = leds->data[leds->position++];
+            leds->pending = RFS_LEDS_SPI_SYMBOLS_PER_BYTE;
+        }
+        // The two most significant bits give the symbols 1000 (0) or 1100 (1) of each nibble
+        const uint8_t value = leds->current;
+        *udr = 0x88 | ((value >> 1) & 0x40) | ((value >> 4) & 0x04);
+        leds->current = value << 2;
+        leds->pending--;
+    }
+    return 1;
+}
@@ -20,51 +20,137 @@ along with RobotsFromScratch; see the file COPYING.  If not, see
 <http://www.gnu.org/licenses/>.
 */
 
+#include <avr/pgmspace.h>
+
 #include <rfsavr/message.h>
 #include <rfsavr/string.h>
 
 //////////////////////////////////////////////////// CONSTANTS ///////////////////////////////////////////////////////
 
 #define RFS_MSG_HEADER  ':'
+#define RFS_MSG_END     '\n'
 
 ///////////////////////////////////////////////// PRIVATE FUNCTIONS //////////////////////////////////////////////////
 
 
 /**
- * @brief Compute the checksum of a given sequence of bytes
+ * @brief Return the segments of the payload of a message
+ *
+ * The messages initialized with rfs_message_init have a null iov, and their only segment is inside the structure.
+ * It is resolved on every call instead of being stored, so the structure can be copied.
+ *
+ * @param message The message
+ *
+ * @returns The segments of the payload
+ */
+static const struct rfs_iovec_t *rfs_message_iov(const struct rfs_message_t *message)
+{
+    return message->iov ? message->iov : &message->segment;
+}
+
+/**
+ * @brief Send as many bytes of the current segment as the USART accepts
  * 
- * @param data The sequence of bytes
- * @param size Number of bytes
+ * @param message The message being sent
+ * @param segment The current segment
  * 
- * @returns The checksum of the given sequence of bytes
+ * @returns The number of bytes sent
  */
-static int8_t rfs_message_checksum(const char *data, uint8_t size)
+static uint8_t rfs_message_send_segment(struct rfs_message_t *message, const struct rfs_iovec_t *segment)
 {
-    int8_t sum = 0;
+    const char *data = segment->base + message->offset;
+    const uint16_t remaining = segment->size - message->offset;
+    uint8_t written = 0;
+    char c;
+
+    if (segment->flags & RFS_IOV_PROGMEM) {
+        // The bytes are read one by one from the flash memory
+        while ((written < remaining) && (written < 0xff)) {
+            c = pgm_read_byte(data + written);
+            if (!rfs_usart_write(message->usart, c)) {
+                break;
+            }
+            message->checksum += c;
+            written++;
+        }
+    } else {
+        written = rfs_usart_write_buf(message->usart, data, (remaining > 0xff) ? 0xff : remaining);
+        for (uint8_t i = 0; i < written; i++) {
+            message->checksum += data[i];
+        }
+    }
+    return written;
+}
 
-    for (int8_t i = 0; i < size; i++) {
-        sum = (sum + data[i]) & 0xff;
+/**
+ * @brief Discard the message being received and wait for the next header
+ * 
+ * @param message The structure that contains the reception information
+ */
+static void rfs_message_recv_drop(struct rfs_message_rx_t *message)
+{
+    if (message->state == RFS_MSG_RECV_STATE_DATA) {
+        message->bad_frames++;
+        message->state = RFS_MSG_RECV_STATE_SYNC;
     }
-    return ((sum ^ 0xff) + 1) & 0xff;
+}
+
+/**
+ * @brief Check the checksum of the message just received
+ * 
+ * The checksum is in the two pending bytes, as hexadecimal characters.
+ * 
+ * @param message The structure that contains the reception information
+ * 
+ * @returns Whether the checksum is correct
+ */
+static int8_t rfs_message_recv_check(const struct rfs_message_rx_t *message)
+{
+    if (message->pending_count < 2) {
+        return 0;
+    }
+    const int8_t high = rfs_str_hextoi(message->pending[0]);
+    const int8_t low = rfs_str_hextoi(message->pending[1]);
+    if ((high < 0) || (low < 0)) {
+        return 0;
+    }
+    return ((uint8_t)(message->sum + ((high << 4) | low))) == 0;
 }
 
 
 ///////////////////////////////////////////////// PUBLIC FUNCTIONS ///////////////////////////////////////////////////
 
 
-void rfs_message_init(struct rfs_message_t *message, struct rfs_usart_t *usart, const char *data, uint8_t size)
+void rfs_message_init(struct rfs_message_t *message, struct rfs_usart_t *usart, const char *data, uint16_t size)
 {
-    message->data = data;
-    message->size = size;
+    message->segment.base = data;
+    message->segment.size = size;
+    message->segment.flags = RFS_IOV_RAM;
+    rfs_message_init_iov(message, usart, 0, 1);
+}
+
+void rfs_message_init_iov(struct rfs_message_t *message, struct rfs_usart_t *usart, const struct rfs_iovec_t *iov,
+    uint8_t iov_count)
+{
+    message->iov = iov;
+    message->iov_count = iov_count;
+    message->iov_index = 0;
+    message->offset = 0;
+    message->size = 0;
+    for (uint8_t i = 0; i < iov_count; i++) {
+        message->size += rfs_message_iov(message)[i].size;
+    }
     message->usart = usart;
     message->written = 0;
-    message->data_ptr = message->data;
     message->state = RFS_MSG_STATE_HEADER;
-    message->checksum = rfs_message_checksum(message->data, message->size);
+    message->checksum = 0;
 }
 
 int8_t rfs_message_send(struct rfs_message_t *message)
 {
+    const struct rfs_iovec_t *segment;
+    uint8_t written;
+
     switch (message->state) {
     case RFS_MSG_STATE_HEADER:
         if (rfs_usart_write(message->usart, RFS_MSG_HEADER)) {
@@ -72,11 +158,20 @@ int8_t rfs_message_send(struct rfs_message_t *message)
         }
         break;
     case RFS_MSG_STATE_DATA:
-        if (rfs_usart_write(message->usart, *message->data_ptr)) {
-            message->written++;
-            message->data_ptr++;
+        // Write as many bytes of the current segment as the USART accepts, and add them to the checksum
+        if (message->iov_index < message->iov_count) {
+            segment = rfs_message_iov(message) + message->iov_index;
+            written = rfs_message_send_segment(message, segment);
+            message->offset += written;
+            message->written += written;
+            if (message->offset == segment->size) {
+                message->iov_index++;
+                message->offset = 0;
+            }
         }
-        if (message->written == message->size) {
+        if (message->iov_index == message->iov_count) {
+            // The checksum is the two's complement of the sum of all the bytes
+            message->checksum = -message->checksum;
             message->state = RFS_MSG_STATE_CHECKSUM1;
         }
         break;
@@ -91,10 +186,69 @@ int8_t rfs_message_send(struct rfs_message_t *message)
         }
         break;
     case RFS_MSG_STATE_END:
-        if (rfs_usart_write(message->usart, '\n')) {
+        if (rfs_usart_write(message->usart, RFS_MSG_END)) {
             return 0;
         }
         break;
     }
     return 1;
 }
+
+
+void rfs_message_recv_init(struct rfs_message_rx_t *message, struct rfs_usart_t *usart, char *data, uint16_t capacity)
+{
+    message->usart = usart;
+    message->data = data;
+    message->capacity = capacity;
+    message->size = 0;
+    message->frames = 0;
+    message->bad_frames = 0;
+    message->state = RFS_MSG_RECV_STATE_SYNC;
+}
+
+int8_t rfs_message_recv(struct rfs_message_rx_t *message)
+{
+    char c;
+    int8_t result;
+
+    while ((result = rfs_usart_read(message->usart, &c)) != 0) {
+        if (result < 0) {
+            // Reception error, the message in progress is lost
+            rfs_message_recv_drop(message);
+            continue;
+        }
+        if (message->state == RFS_MSG_RECV_STATE_SYNC) {
+            // Wait for the header of the next message
+            if (c == RFS_MSG_HEADER) {
+                message->size = 0;
+                message->sum = 0;
+                message->pending_count = 0;
+                message->state = RFS_MSG_RECV_STATE_DATA;
+            }
+            continue;
+        }
+        if (c == RFS_MSG_END) {
+            message->state = RFS_MSG_RECV_STATE_SYNC;
+            if (rfs_message_recv_check(message)) {
+                message->frames++;
+                return 1;
+            }
+            message->bad_frames++;
+            continue;
+        }
+        if (message->pending_count < 2) {
+            message->pending[message->pending_count++] = c;
+            continue;
+        }
+        // The oldest pending byte is not part of the checksum, move it to the payload
+        if (message->size == message->capacity) {
+            rfs_message_recv_drop(message);
+            continue;
+        }
+        message->data[message->size++] = message->pending[0];
+        message->sum += message->pending[0];
+        message->pending[0] = message->pending[1];
+        message->pending[1] = c;
+    }
+    return 0;
+}
@@ -0,0 +1,157 @@
+/*
+msgq.c - Prioritized queue of messages sent through one USART
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+#include <rfsavr/msgq.h>
+
+///////////////////////////////////////////////// PRIVATE FUNCTIONS //////////////////////////////////////////////////
+
+
+/**
+ * @brief Take the first message of the highest priority that is not empty
+ * 
+ * @param queue The queue
+ * 
+ * @returns Whether there was a message to take
+ */
+static int8_t rfs_msgq_next(struct rfs_msgq_t *queue)
+{
+    for (uint8_t priority = 0; priority < RFS_MSGQ_PRIORITIES; priority++) {
+        const uint8_t index = queue->head[priority];
+        if (index != RFS_MSGQ_NONE) {
+            queue->head[priority] = queue->slots[index].next;
+            if (queue->head[priority] == RFS_MSGQ_NONE) {
+                queue->tail[priority] = RFS_MSGQ_NONE;
+            }
+            queue->current = index;
+            queue->current_priority = priority;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Account the message just sent in the statistics and free its slot
+ * 
+ * @param queue The queue
+ */
+static void rfs_msgq_done(struct rfs_msgq_t *queue)
+{
+    struct rfs_msgq_slot_t *slot = queue->slots + queue->current;
+    struct rfs_msgq_stats_t *stats = queue->stats + queue->current_priority;
+    const uint16_t latency = queue->ticks - slot->enqueued;
+
+    stats->depth--;
+    stats->sent++;
+    stats->total_latency += latency;
+    if (latency > stats->max_latency) {
+        stats->max_latency = latency;
+    }
+    slot->next = queue->free;
+    queue->free = queue->current;
+    queue->current = RFS_MSGQ_NONE;
+}
+
+
+///////////////////////////////////////////////// PUBLIC FUNCTIONS ///////////////////////////////////////////////////
+
+
+void rfs_msgq_init(struct rfs_msgq_t *queue, struct rfs_usart_t *usart, struct rfs_msgq_slot_t *slots,
+    uint8_t capacity)
+{
+    queue->usart = usart;
+    queue->slots = slots;
+    for (uint8_t priority = 0; priority < RFS_MSGQ_PRIORITIES; priority++) {
+        queue->head[priority] = RFS_MSGQ_NONE;
+        queue->tail[priority] = RFS_MSGQ_NONE;
+        queue->stats[priority].depth = 0;
+    }
+    // Chain all the slots in the free list
+    queue->free = capacity ? 0 : RFS_MSGQ_NONE;
+    for (uint8_t i = 0; i < capacity; i++) {
+        slots[i].next = (i + 1 < capacity) ? i + 1 : RFS_MSGQ_NONE;
+    }
+    queue->current = RFS_MSGQ_NONE;
+    queue->ticks = 0;
+    rfs_msgq_reset_stats(queue);
+}
+
+int8_t rfs_msgq_enqueue(struct rfs_msgq_t *queue, struct rfs_message_t *message, enum rfs_msgq_priority priority)
+{
+    const uint8_t index = queue->free;
+
+    if (index == RFS_MSGQ_NONE || (uint8_t)priority >= RFS_MSGQ_PRIORITIES) {
+        return 0;
+    }
+    struct rfs_msgq_slot_t *slot = queue->slots + index;
+    queue->free = slot->next;
+    // All the messages go through the USART of the queue, so their frames never interleave
+    message->usart = queue->usart;
+    slot->message = message;
+    slot->enqueued = queue->ticks;
+    slot->next = RFS_MSGQ_NONE;
+
+    // Append the slot at the end of the list of its priority
+    if (queue->tail[priority] == RFS_MSGQ_NONE) {
+        queue->head[priority] = index;
+    } else {
+        queue->slots[queue->tail[priority]].next = index;
+    }
+    queue->tail[priority] = index;
+
+    struct rfs_msgq_stats_t *stats = queue->stats + priority;
+    stats->depth++;
+    if (stats->depth > stats->max_depth) {
+        stats->max_depth = stats->depth;
+    }
+    return 1;
+}
+
+int8_t rfs_msgq_poll(struct rfs_msgq_t *queue)
+{
+    queue->ticks++;
+    if (queue->current == RFS_MSGQ_NONE && !rfs_msgq_next(queue)) {
+        return 0;
+    }
+    if (rfs_message_send(queue->slots[queue->current].message)) {
+        return 1;
+    }
+    rfs_msgq_done(queue);
+    // The message just completed was the last one if all the priority levels are empty
+    for (uint8_t priority = 0; priority < RFS_MSGQ_PRIORITIES; priority++) {
+        if (queue->head[priority] != RFS_MSGQ_NONE) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void rfs_msgq_reset_stats(struct rfs_msgq_t *queue)
+{
+    for (uint8_t priority = 0; priority < RFS_MSGQ_PRIORITIES; priority++) {
+        struct rfs_msgq_stats_t *stats = queue->stats + priority;
+        stats->max_depth = stats->depth;
+        stats->sent = 0;
+        stats->max_latency = 0;
+        stats->total_latency = 0;
+    }
+}
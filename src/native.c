@@ -0,0 +1,120 @@
+/*
+native.c - Simulated register file of the ATmega328P, for the native build
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+#include <avr/io.h>
+#include <string.h>
+
+#include <rfsavr/adc.h>
+#include <rfsavr/crc.h>
+#include <rfsavr/io.h>
+#include <rfsavr/pwm.h>
+#include <rfsavr/ringbuf.h>
+#include <rfsavr/timers.h>
+#include <rfsavr/usart.h>
+
+// The 16-bit registers are accessed as a whole, so they must be aligned like in the AVR data space
+uint8_t rfs_native_sfr[RFS_NATIVE_SFR_SIZE] __attribute__((aligned(2)));
+
+void rfs_native_reset(void)
+{
+    memset(rfs_native_sfr, 0, sizeof(rfs_native_sfr));
+    // The only registers of the library's peripherals whose reset value is not zero
+    UCSR0A = _BV(UDRE0);
+    UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);
+}
+
+/*
+The small functions of the headers are C99 inline functions, that have no external definition. avr-gcc always inlines
+them, but the native compiler may not, so their external definitions are emitted here.
+*/
+
+// adc.h
+extern inline void rfs_adc_enabledigitalinputs(int8_t inputs);
+extern inline void rfs_adc_disabledigitalinputs(int8_t inputs);
+extern inline void rfs_adc_setadjustment(enum rfs_adc_adjustment adjustment);
+extern inline void rfs_adc_setautotrigger(int8_t enabled);
+extern inline void rfs_adc_setautotriggersource(enum rfs_adc_autotriggersource source);
+extern inline void rfs_adc_setchannel(enum rfs_adc_channel channel);
+extern inline void rfs_adc_setenabled(int8_t enabled);
+extern inline void rfs_adc_setinterruptenabled(int8_t enabled);
+extern inline void rfs_adc_setprescaler(enum rfs_adc_prescaler prescaler);
+extern inline void rfs_adc_setreference(enum rfs_adc_reference reference);
+extern inline void rfs_adc_start();
+
+// crc.h
+extern inline uint16_t rfs_crc16_update(uint16_t crc, uint8_t data);
+
+// io.h
+extern inline void rfs_pin_set_output(const struct rfs_pin_t *pin);
+extern inline uint8_t rfs_pin_read(const struct rfs_pin_t *pin);
+extern inline void rfs_pin_set(const struct rfs_pin_t *pin);
+extern inline void rfs_pin_reset(const struct rfs_pin_t *pin);
+extern inline uint8_t rfs_pin_readport(const struct rfs_pin_t *pin);
+extern inline void rfs_pin_toggle(const struct rfs_pin_t *pin);
+
+// pwm.h
+extern inline uint32_t rfs_pwm_plan_error(uint32_t period, uint32_t frequency, uint32_t cpu_frequency);
+extern inline void rfs_pwm_plan_candidate(struct rfs_pwm_plan_t *plan, uint32_t frequency, uint32_t cpu_frequency,
+    uint32_t min_steps, uint16_t max_top, uint16_t divisor, uint8_t clock, uint8_t phase_correct);
+extern inline void rfs_pwm_plan_divisor(struct rfs_pwm_plan_t *plan, uint32_t frequency, uint32_t cpu_frequency,
+    uint32_t min_steps, uint16_t max_top, uint16_t divisor, uint8_t clock);
+extern inline void rfs_pwm_plan(struct rfs_pwm_plan_t *plan, enum rfs_timer_enum timer, uint32_t frequency,
+    uint32_t cpu_frequency, uint32_t min_steps);
+extern inline void rfs_pwm_set_frequency(const struct rfs_pwm_t *pwm, uint32_t frequency, uint32_t cpu_frequency);
+extern inline void rfs_pwm_set_frequency_hint(const struct rfs_pwm_t *pwm, uint32_t frequency, uint32_t cpu_frequency);
+extern inline void rfs_pwm_set_duty_cycle_8(const struct rfs_pwm_t *pwm, uint8_t duty_cycle);
+extern inline void rfs_pwm_set_duty_cycle_16(const struct rfs_pwm_t *pwm, uint16_t duty_cycle);
+extern inline void rfs_pwm_group_set(struct rfs_pwm_group_t *group, uint8_t index, uint16_t duty_cycle);
+extern inline void rfs_pwm_group_commit(struct rfs_pwm_group_t *group);
+
+// ringbuf.h
+extern inline int8_t rfs_ringbuf_init(struct rfs_ringbuf_t *buffer, char *data, uint16_t size);
+extern inline uint8_t rfs_ringbuf_empty(const struct rfs_ringbuf_t *buffer);
+extern inline int8_t rfs_ringbuf_put(struct rfs_ringbuf_t *buffer, char data);
+extern inline int8_t rfs_ringbuf_get(struct rfs_ringbuf_t *buffer, char *data);
+
+// timers.h
+extern inline uint8_t rfs_timer_get_8(const struct rfs_timer_t *timer);
+extern inline uint16_t rfs_timer_get_16(const struct rfs_timer_t *timer);
+extern inline int8_t rfs_timer_get_mode(const struct rfs_timer_t *timer);
+extern inline void rfs_timer_set_8(const struct rfs_timer_t *timer, uint8_t value);
+extern inline void rfs_timer_set_16(const struct rfs_timer_t *timer, uint16_t value);
+extern inline void rfs_timer_set_clock(const struct rfs_timer_t *timer, enum rfs_timer_clock clock);
+extern inline void rfs_timer_set_compare_match_output_mode_a(const struct rfs_timer_t *timer,
+    enum rfs_timer_com_a mode);
+extern inline void rfs_timer_set_compare_match_output_mode_b(const struct rfs_timer_t *timer,
+    enum rfs_timer_com_b mode);
+extern inline void rfs_timer_set_icr(const struct rfs_timer_t *timer, uint16_t value);
+extern inline void rfs_timer_set_mode_16(const struct rfs_timer_t *timer, enum rfs_timer_mode_16 mode);
+extern inline void rfs_timer_set_ocra_8(const struct rfs_timer_t *timer, uint8_t ocra);
+extern inline void rfs_timer_set_ocra_16(const struct rfs_timer_t *timer, uint16_t ocra);
+extern inline void rfs_timer_set_ocrb_8(const struct rfs_timer_t *timer, uint8_t ocrb);
+extern inline void rfs_timer_set_ocrb_16(const struct rfs_timer_t *timer, uint16_t ocrb);
+
+// usart.h
+extern inline uint16_t rfs_usart_getubrr(uint32_t baudrate, uint32_t cpu_frequency,
+    enum rfs_usart_clockdivisor clock_divisor);
+extern inline void rfs_usart_getspeed(struct rfs_usart_speed_t *speed, uint32_t baudrate, uint32_t cpu_frequency);
+extern inline void rfs_usart_applyspeed(struct rfs_usart_t *usart, const struct rfs_usart_speed_t *speed);
+extern inline void rfs_usart_countrx(struct rfs_usart_stats_t *stats, uint8_t status);
+extern inline int8_t rfs_usart_write_address(struct rfs_usart_t *usart, uint8_t address);
+extern inline void rfs_usart_setmultiprocessor(struct rfs_usart_t *usart, uint8_t enabled);
@@ -0,0 +1,38 @@
+/*
+interrupt.h - Interrupt handling, for the native build
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+/*
+In the native build an interrupt service routine is an ordinary function named after its vector, that the tests call
+to simulate the interrupt. sei and cli change the I flag of the simulated SREG register.
+*/
+
+#ifndef RFS_NATIVE_AVR_INTERRUPT_H
+#define RFS_NATIVE_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+
+#define ISR(vector, ...)    void vector(void); void vector(void)
+
+#define sei()   (SREG |= _BV(SREG_I))
+#define cli()   (SREG &= ~_BV(SREG_I))
+
+#endif
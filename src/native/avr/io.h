@@ -0,0 +1,256 @@
+/*
+io.h - Simulated register file of the ATmega328P, for the native build
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+/*
+This header replaces <avr/io.h> when the library is compiled for the build machine (configure --enable-native). The
+I/O registers are plain memory in rfs_native_sfr, placed at their data space addresses, so the code that derives a
+register address from another one (like rfs_ddr or rfs_timer_crb) works unchanged, and the tests can observe and
+modify the registers. Nothing happens by itself: the flags set by the hardware must be set by the test.
+*/
+
+#ifndef RFS_NATIVE_AVR_IO_H
+#define RFS_NATIVE_AVR_IO_H
+
+#include <stdint.h>
+
+/**
+ * @brief Size of the simulated data space, that contains all the I/O registers of the ATmega328P
+ */
+#define RFS_NATIVE_SFR_SIZE 0x100
+
+/**
+ * @brief The simulated I/O registers, indexed by data space address
+ */
+extern uint8_t rfs_native_sfr[RFS_NATIVE_SFR_SIZE];
+
+/**
+ * @brief Set all the simulated registers to their reset value
+ */
+void rfs_native_reset(void);
+
+#define _BV(bit)            (1 << (bit))
+#define _SFR_MEM8(address)  (*(volatile uint8_t *)&rfs_native_sfr[address])
+#define _SFR_MEM16(address) (*(volatile uint16_t *)&rfs_native_sfr[address])
+
+#define bit_is_set(sfr, bit)    ((sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit)  (!((sfr) & _BV(bit)))
+
+/* Ports */
+#define PINB    _SFR_MEM8(0x23)
+#define DDRB    _SFR_MEM8(0x24)
+#define PORTB   _SFR_MEM8(0x25)
+#define PINC    _SFR_MEM8(0x26)
+#define DDRC    _SFR_MEM8(0x27)
+#define PORTC   _SFR_MEM8(0x28)
+#define PIND    _SFR_MEM8(0x29)
+#define DDRD    _SFR_MEM8(0x2A)
+#define PORTD   _SFR_MEM8(0x2B)
+
+#define DDD1    1
+#define DDD3    3
+#define DDD4    4
+#define DDD5    5
+#define DDD6    6
+#define DDB1    1
+#define DDB2    2
+#define DDB3    3
+#define PORTD1  1
+
+/* Timer interrupt flags and general control */
+#define TIFR0   _SFR_MEM8(0x35)
+#define TIFR1   _SFR_MEM8(0x36)
+#define TIFR2   _SFR_MEM8(0x37)
+#define GTCCR   _SFR_MEM8(0x43)
+
+#define TOV0    0
+#define OCF0A   1
+#define OCF0B   2
+#define TOV1    0
+#define OCF1A   1
+#define OCF1B   2
+#define ICF1    5
+#define TOV2    0
+#define OCF2A   1
+#define OCF2B   2
+#define PSRSYNC 0
+#define PSRASY  1
+#define TSM     7
+
+/* Timer 0 */
+#define TCCR0A  _SFR_MEM8(0x44)
+#define TCCR0B  _SFR_MEM8(0x45)
+#define TCNT0   _SFR_MEM8(0x46)
+#define OCR0A   _SFR_MEM8(0x47)
+#define OCR0B   _SFR_MEM8(0x48)
+
+#define WGM00   0
+#define WGM01   1
+#define COM0B0  4
+#define COM0B1  5
+#define COM0A0  6
+#define COM0A1  7
+#define CS00    0
+#define CS01    1
+#define CS02    2
+#define WGM02   3
+#define FOC0B   6
+#define FOC0A   7
+
+/* Status register */
+#define SREG    _SFR_MEM8(0x5F)
+
+#define SREG_I  7
+
+/* Timer interrupt masks */
+#define TIMSK0  _SFR_MEM8(0x6E)
+#define TIMSK1  _SFR_MEM8(0x6F)
+#define TIMSK2  _SFR_MEM8(0x70)
+
+#define TOIE0   0
+#define OCIE0A  1
+#define OCIE0B  2
+#define TOIE1   0
+#define OCIE1A  1
+#define OCIE1B  2
+#define ICIE1   5
+#define TOIE2   0
+#define OCIE2A  1
+#define OCIE2B  2
+
+/* ADC */
+#define ADC     _SFR_MEM16(0x78)
+#define ADCL    _SFR_MEM8(0x78)
+#define ADCH    _SFR_MEM8(0x79)
+#define ADCSRA  _SFR_MEM8(0x7A)
+#define ADCSRB  _SFR_MEM8(0x7B)
+#define ADMUX   _SFR_MEM8(0x7C)
+#define DIDR0   _SFR_MEM8(0x7E)
+
+#define ADPS0   0
+#define ADPS1   1
+#define ADPS2   2
+#define ADIE    3
+#define ADIF    4
+#define ADATE   5
+#define ADSC    6
+#define ADEN    7
+#define ADTS0   0
+#define ADTS1   1
+#define ADTS2   2
+#define MUX0    0
+#define MUX1    1
+#define MUX2    2
+#define MUX3    3
+#define ADLAR   5
+#define REFS0   6
+#define REFS1   7
+
+/* Timer 1 */
+#define TCCR1A  _SFR_MEM8(0x80)
+#define TCCR1B  _SFR_MEM8(0x81)
+#define TCCR1C  _SFR_MEM8(0x82)
+#define TCNT1   _SFR_MEM16(0x84)
+#define TCNT1L  _SFR_MEM8(0x84)
+#define TCNT1H  _SFR_MEM8(0x85)
+#define ICR1    _SFR_MEM16(0x86)
+#define ICR1L   _SFR_MEM8(0x86)
+#define ICR1H   _SFR_MEM8(0x87)
+#define OCR1A   _SFR_MEM16(0x88)
+#define OCR1AL  _SFR_MEM8(0x88)
+#define OCR1AH  _SFR_MEM8(0x89)
+#define OCR1B   _SFR_MEM16(0x8A)
+#define OCR1BL  _SFR_MEM8(0x8A)
+#define OCR1BH  _SFR_MEM8(0x8B)
+
+#define WGM10   0
+#define WGM11   1
+#define COM1B0  4
+#define COM1B1  5
+#define COM1A0  6
+#define COM1A1  7
+#define CS10    0
+#define CS11    1
+#define CS12    2
+#define WGM12   3
+#define WGM13   4
+#define ICES1   6
+#define ICNC1   7
+#define FOC1B   6
+#define FOC1A   7
+
+/* Timer 2 */
+#define TCCR2A  _SFR_MEM8(0xB0)
+#define TCCR2B  _SFR_MEM8(0xB1)
+#define TCNT2   _SFR_MEM8(0xB2)
+#define OCR2A   _SFR_MEM8(0xB3)
+#define OCR2B   _SFR_MEM8(0xB4)
+
+#define WGM20   0
+#define WGM21   1
+#define COM2B0  4
+#define COM2B1  5
+#define COM2A0  6
+#define COM2A1  7
+#define CS20    0
+#define CS21    1
+#define CS22    2
+#define WGM22   3
+#define FOC2B   6
+#define FOC2A   7
+
+/* USART 0 */
+#define UCSR0A  _SFR_MEM8(0xC0)
+#define UCSR0B  _SFR_MEM8(0xC1)
+#define UCSR0C  _SFR_MEM8(0xC2)
+#define UBRR0   _SFR_MEM16(0xC4)
+#define UBRR0L  _SFR_MEM8(0xC4)
+#define UBRR0H  _SFR_MEM8(0xC5)
+#define UDR0    _SFR_MEM8(0xC6)
+
+#define MPCM0   0
+#define U2X0    1
+#define UPE0    2
+#define DOR0    3
+#define FE0     4
+#define UDRE0   5
+#define TXC0    6
+#define RXC0    7
+#define TXB80   0
+#define RXB80   1
+#define UCSZ02  2
+#define TXEN0   3
+#define RXEN0   4
+#define UDRIE0  5
+#define TXCIE0  6
+#define RXCIE0  7
+#define UCPOL0  0
+#define UCPHA0  1
+#define UDORD0  2
+#define UCSZ00  1
+#define UCSZ01  2
+#define USBS0   3
+#define UPM00   4
+#define UPM01   5
+#define UMSEL00 6
+#define UMSEL01 7
+
+#endif
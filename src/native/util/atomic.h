@@ -0,0 +1,51 @@
+/*
+atomic.h - Atomic blocks, for the native build
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+/*
+Like the avr-libc version, ATOMIC_BLOCK clears the I flag of the simulated SREG register and restores it when the
+block is left, also by return or break. The tests can check the flag to verify that a block was executed atomically.
+*/
+
+#ifndef RFS_NATIVE_UTIL_ATOMIC_H
+#define RFS_NATIVE_UTIL_ATOMIC_H
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+
+static inline void rfs_native_restore_sreg(const uint8_t *sreg)
+{
+    SREG = *sreg;
+}
+
+static inline uint8_t rfs_native_set_sreg(uint8_t sreg)
+{
+    SREG = sreg;
+    return 1;
+}
+
+#define ATOMIC_RESTORESTATE uint8_t rfs_native_sreg __attribute__((__cleanup__(rfs_native_restore_sreg))) = SREG
+#define ATOMIC_FORCEON      uint8_t rfs_native_sreg __attribute__((__cleanup__(rfs_native_restore_sreg))) = SREG | _BV(SREG_I)
+
+#define ATOMIC_BLOCK(type)  \
+    for (type, rfs_native_once = rfs_native_set_sreg(SREG & ~_BV(SREG_I)); rfs_native_once; rfs_native_once = 0)
+
+#endif
@@ -0,0 +1,33 @@
+/*
+delay.h - Busy waits, for the native build
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+/*
+The native build doesn't simulate time, the busy waits return immediately.
+*/
+
+#ifndef RFS_NATIVE_UTIL_DELAY_H
+#define RFS_NATIVE_UTIL_DELAY_H
+
+#define _delay_ms(ms)   ((void)(ms))
+#define _delay_us(us)   ((void)(us))
+
+#endif
@@ -20,6 +20,8 @@ along with RobotsFromScratch; see the file COPYING.  If not, see
 <http://www.gnu.org/licenses/>.
 */
 
+#include <util/atomic.h>
+
 #include "rfsavr/pwm.h"
 
 enum rfs_pwm_mode {
@@ -37,13 +39,13 @@ static void rfs_pwm_set_frequency_16(const struct rfs_pwm_t *pwm, uint32_t frequ
 static void rfs_pwm_set_frequency_hint_8(const struct rfs_pwm_t *pwm, uint32_t frequency, uint32_t cpu_frequency);
 static void rfs_pwm_set_frequency_hint_16(const struct rfs_pwm_t *pwm, uint32_t frequency, uint32_t cpu_frequency);
 
-static const void (*RFS_PWM_SET_FREQUENCY_FUNCTION_TABLE[3])(const struct rfs_pwm_t *, uint32_t, uint32_t) = {
+static void (*const RFS_PWM_SET_FREQUENCY_FUNCTION_TABLE[3])(const struct rfs_pwm_t *, uint32_t, uint32_t) = {
     rfs_pwm_set_frequency_8,
     rfs_pwm_set_frequency_16,
     rfs_pwm_set_frequency_8
 };
 
-static const void (*RFS_PWM_SET_FREQUENCY_FUNCTION_TABLE_HINT[3])(const struct rfs_pwm_t *, uint32_t, uint32_t) = {
+static void (*const RFS_PWM_SET_FREQUENCY_FUNCTION_TABLE_HINT[3])(const struct rfs_pwm_t *, uint32_t, uint32_t) = {
     rfs_pwm_set_frequency_hint_8,
     rfs_pwm_set_frequency_hint_16,
     rfs_pwm_set_frequency_hint_8
@@ -86,6 +88,120 @@ void rfs_pwm_close(const struct rfs_pwm_t *pwm)
     rfs_timer_set_clock(&pwm->timer, RFS_TIMER_CLOCK_NONE);
 }
 
+void rfs_pwm_set_plan(const struct rfs_pwm_t *pwm, const struct rfs_pwm_plan_t *plan)
+{
+    if (plan->timer == RFS_TIMER1) {
+        rfs_timer_set_mode_16(&pwm->timer, plan->mode);
+        rfs_timer_set_icr(&pwm->timer, plan->top);
+    } else {
+        rfs_timer_set_mode_8(&pwm->timer, plan->mode);
+        if (plan->top != 0xff) {
+            rfs_timer_set_ocra_8(&pwm->timer, plan->top);
+        }
+    }
+    rfs_timer_set_clock(&pwm->timer, plan->clock);
+}
+
+uint16_t rfs_pwm_get_top(const struct rfs_pwm_t *pwm)
+{
+    const int8_t mode = rfs_timer_get_mode(&pwm->timer);
+
+    if (pwm->timer.cra != &TCCR1A) {
+        return (mode & RFS_TIMER_CRB_MODE_MASK) ? *pwm->timer.ocra8 : 0xff;
+    }
+    switch (mode) {
+    case RFS_TIMER16_MODE_NORMAL:
+        return 0xffff;
+    case RFS_TIMER16_MODE_PWM_PHASE_CORRECT_8:
+    case RFS_TIMER16_MODE_FAST_PWM_8:
+        return 0xff;
+    case RFS_TIMER16_MODE_PWM_PHASE_CORRECT_9:
+    case RFS_TIMER16_MODE_FAST_PWM_9:
+        return 0x1ff;
+    case RFS_TIMER16_MODE_PWM_PHASECORRECT_10:
+    case RFS_TIMER16_MODE_FAST_PWM_10:
+        return 0x3ff;
+    case RFS_TIMER16_MODE_PWM_PHASE_FREQUENCY_CORRECT_ICR:
+    case RFS_TIMER16_MODE_PWM_PHASE_CORRECT_ICR:
+    case RFS_TIMER16_MODE_CTC_ICR:
+    case RFS_TIMER16_MODE_FAST_PWM_ICR:
+        return *rfs_timer_icr(&pwm->timer);
+    default:
+        return *pwm->timer.ocra16;
+    }
+}
+
+void rfs_pwm_retune(struct rfs_pwm_retune_t *retune, const struct rfs_pwm_t *pwm, const struct rfs_pwm_plan_t *plan)
+{
+    // A change replaced after its first step has already scaled the duty cycle to its own TOP
+    retune->top = (retune->pending == 2 && retune->pwm == pwm) ? retune->plan.top : rfs_pwm_get_top(pwm);
+    retune->pwm = pwm;
+    retune->plan = *plan;
+    // TIFR0, TIFR1 and TIFR2 are consecutive, and the TOVn bits are all bit 0
+    retune->tifr = &TIFR0 + plan->timer;
+    *retune->tifr = _BV(TOV0);
+    retune->pending = 1;
+}
+
+int8_t rfs_pwm_retune_poll(struct rfs_pwm_retune_t *retune)
+{
+    const struct rfs_pwm_t *pwm = retune->pwm;
+    const uint16_t new_top = retune->plan.top;
+    // A stopped timer never overflows, so everything is written at once
+    const uint8_t running = *rfs_timer_crb(&pwm->timer) & RFS_TIMER_CLOCK_MASK;
+
+    if (!retune->pending) {
+        return 1;
+    }
+    if (running && !(*retune->tifr & _BV(TOV0))) {
+        return 0;
+    }
+
+    if (retune->pending == 1) {
+        // First step: the duty cycle registers, and TOP of the 8-bit timers, are double buffered, so they take the
+        // new values at the start of the next period
+        uint16_t top = retune->top;
+        if (top == 0) {
+            // TOP in OCRA, that was never set
+            top = 1;
+        }
+        retune->top = rfs_pwm_get_top(pwm);
+        if (retune->plan.timer == RFS_TIMER1) {
+            rfs_pwm_set_duty_cycle_16(pwm, ((uint32_t)*pwm->ocr16 * new_top + (top >> 1)) / top);
+        } else {
+            rfs_pwm_set_duty_cycle_8(pwm, ((uint16_t)*pwm->ocr8 * new_top + (top >> 1)) / top);
+            if (new_top != 0xff) {
+                rfs_timer_set_ocra_8(&pwm->timer, new_top);
+            }
+        }
+        retune->pending = 2;
+        if (running) {
+            *retune->tifr = _BV(TOV0);
+            return 0;
+        }
+    }
+
+    // Second step, once the new period has started: ICR1, the mode and the clock divisor take effect at once. ICR1
+    // is only written while the counter is below both TOP values, so the counter can't miss the new one, and the new
+    // period gets the new duty cycle. The first half of the shorter period leaves time to write them.
+    int8_t written = 1;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (running) {
+            const uint16_t count = (retune->plan.timer == RFS_TIMER1)
+                ? *rfs_timer_cnt_16(&pwm->timer) : *rfs_timer_cnt_8(&pwm->timer);
+            written = count < (((retune->top < new_top) ? retune->top : new_top) >> 1);
+        }
+        if (written) {
+            rfs_pwm_set_plan(pwm, &retune->plan);
+        }
+    }
+    if (!written) {
+        return 0;
+    }
+    retune->pending = 0;
+    return 1;
+}
+
 static void rfs_pwm_set_clock_divisor_and_mode(const struct rfs_pwm_t *pwm, uint32_t target_frequency, uint32_t max_frequency,
     struct rfs_pwm_divisor_mode_t *divisor_mode)
 {
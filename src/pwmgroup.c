@@ -0,0 +1,99 @@
+/*
+pwmgroup.c - Change the duty cycles of several PWM signals in the same period.
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+#include "rfsavr/pwm.h"
+
+/**
+ * @brief Return the timer used by a PWM signal
+ */
+static enum rfs_timer_enum rfs_pwm_group_timer(const struct rfs_pwm_t *pwm)
+{
+    if (pwm->timer.cra == &TCCR0A) {
+        return RFS_TIMER0;
+    } else if (pwm->timer.cra == &TCCR1A) {
+        return RFS_TIMER1;
+    }
+    return RFS_TIMER2;
+}
+
+void rfs_pwm_group_init(struct rfs_pwm_group_t *group, struct rfs_pwm_group_slot_t *slots, uint8_t capacity)
+{
+    group->slots = slots;
+    group->capacity = capacity;
+    group->count = 0;
+    group->pending = 0;
+    group->tifr = 0;
+}
+
+int8_t rfs_pwm_group_add(struct rfs_pwm_group_t *group, const struct rfs_pwm_t *pwm)
+{
+    if (group->count == group->capacity) {
+        return 0;
+    }
+    const enum rfs_timer_enum timer = rfs_pwm_group_timer(pwm);
+    struct rfs_pwm_group_slot_t *slot = &group->slots[group->count++];
+    slot->pwm = pwm;
+    slot->duty_cycle = 0;
+    slot->wide = (timer == RFS_TIMER1);
+    if (!group->tifr) {
+        // TIFR0, TIFR1 and TIFR2 are consecutive
+        group->tifr = &TIFR0 + timer;
+    }
+    return 1;
+}
+
+void rfs_pwm_group_sync(const struct rfs_pwm_group_t *group)
+{
+    GTCCR = _BV(TSM) | _BV(PSRASY) | _BV(PSRSYNC);
+    for (uint8_t i = 0; i < group->count; i++) {
+        const struct rfs_pwm_group_slot_t *slot = &group->slots[i];
+        if (slot->wide) {
+            rfs_timer_set_16(&slot->pwm->timer, 0);
+        } else {
+            rfs_timer_set_8(&slot->pwm->timer, 0);
+        }
+    }
+    // Clearing TSM releases the prescalers, and all the timers start at the same time
+    GTCCR = 0;
+}
+
+int8_t rfs_pwm_group_poll(struct rfs_pwm_group_t *group)
+{
+    // An empty group has no overflow flag to wait for
+    if (!group->pending || group->count == 0) {
+        group->pending = 0;
+        return 1;
+    }
+    if (!(*group->tifr & _BV(TOV0))) {
+        return 0;
+    }
+    for (uint8_t i = 0; i < group->count; i++) {
+        const struct rfs_pwm_group_slot_t *slot = &group->slots[i];
+        if (slot->wide) {
+            rfs_pwm_set_duty_cycle_16(slot->pwm, slot->duty_cycle);
+        } else {
+            rfs_pwm_set_duty_cycle_8(slot->pwm, slot->duty_cycle);
+        }
+    }
+    group->pending = 0;
+    return 1;
+}
@@ -0,0 +1,56 @@
+/*
+crc.h - CRC-16 computation.
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RFS_CRC_H
+#define RFS_CRC_H
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+/**
+ * @brief Initial value of the CRC-16
+ */
+#define RFS_CRC16_INIT  0xffff
+
+/**
+ * @brief Lookup table for the CRC-16/CCITT (polynomial 0x1021), stored in flash
+ */
+extern const uint16_t RFS_CRC16_TABLE[256] PROGMEM;
+
+/**
+ * @brief Update the CRC-16 with a new byte
+ * 
+ * The CRC is the CRC-16/CCITT-FALSE: polynomial 0x1021, initial value 0xffff, no reflection and no final xor.
+ * Appending the CRC to the data, most significant byte first, and computing the CRC of the whole sequence
+ * gives 0.
+ * 
+ * @param crc The current CRC value
+ * @param data The new byte
+ * 
+ * @returns The updated CRC value
+ */
+inline uint16_t rfs_crc16_update(uint16_t crc, uint8_t data)
+{
+    return (crc << 8) ^ pgm_read_word(&RFS_CRC16_TABLE[(crc >> 8) ^ data]);
+}
+
+#endif
@@ -34,7 +34,8 @@ extern uint8_t rfs_errno;
 enum rfs_errno_codes {
     RFS_EFRAME = 1,
     RFS_EOVERRUN,
-    RFS_EPARITY
+    RFS_EPARITY,
+    RFS_ETIMING
 };
 
 #endif
\ No newline at end of file
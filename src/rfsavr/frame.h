@@ -0,0 +1,165 @@
+/*
+frame.h - Binary message protocol (COBS framing and CRC-16) to be sent using the USART subsystem
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RFS_FRAME_H
+#define RFS_FRAME_H
+
+#include <stdint.h>
+
+#include <rfsavr/usart.h>
+
+/**
+ * @brief Byte that delimits the frames
+ */
+#define RFS_FRAME_DELIMITER 0x00
+
+/**
+ * @brief Maximum number of data bytes in a COBS block
+ */
+#define RFS_FRAME_BLOCK_SIZE    254
+
+/**
+ * @brief Size of the CRC appended to the payload
+ */
+#define RFS_FRAME_CRC_SIZE  2
+
+/**
+ * @brief Used internaly to implement the state machine that sends the frame through the serial port
+ */
+enum rfs_frame_state
+{
+    RFS_FRAME_STATE_CODE,
+    RFS_FRAME_STATE_DATA,
+    RFS_FRAME_STATE_END
+};
+
+/**
+ * @brief Used internaly to implement the state machine that receives the frames through the serial port
+ */
+enum rfs_frame_recv_state
+{
+    RFS_FRAME_RECV_STATE_SYNC,
+    RFS_FRAME_RECV_STATE_IDLE,
+    RFS_FRAME_RECV_STATE_DATA
+};
+
+/**
+ * @brief Struct that contains all the necessary information to send a frame.
+ *
+ * The encoded stream is the payload followed by its CRC-16. position is the next byte of the stream to send,
+ * block_end the end of the current COBS block and scanned the number of payload bytes already added to the CRC.
+ */
+struct rfs_frame_t
+{
+    struct rfs_usart_t *usart;
+    const uint8_t *data;
+    uint16_t size;
+    uint16_t position;
+    uint16_t block_end;
+    uint16_t scanned;
+    uint16_t crc;
+    uint8_t code;
+    enum rfs_frame_state state;
+};
+
+/**
+ * @brief Struct that contains all the necessary information to receive frames.
+ *
+ * The last two decoded bytes are kept in pending until the next byte arrives, because they may be the CRC of
+ * the frame. This way, only the payload is written to data.
+ */
+struct rfs_frame_rx_t
+{
+    struct rfs_usart_t *usart;
+    uint8_t *data;
+    uint16_t capacity;
+    uint16_t size;
+    uint16_t crc;
+    uint8_t pending[RFS_FRAME_CRC_SIZE];
+    uint8_t pending_count;
+    uint8_t remaining;
+    uint8_t zero;
+    uint16_t frames;
+    uint16_t bad_frames;
+    enum rfs_frame_recv_state state;
+};
+
+/**
+ * @brief Initializes the frame
+ *
+ * The frame is the payload followed by its CRC-16, encoded with COBS (Consistent Overhead Byte Stuffing)
+ * and terminated by a 0x00 delimiter. The encoded payload never contains the delimiter, so any binary
+ * payload can be sent. The overhead is 1 byte every 254 bytes of payload, plus the CRC and the delimiter.
+ * 
+ * @param frame The frame to be sent
+ * @param usart The USART device used to send the frame
+ * @param data The data to be sent
+ * @param size The size of the data to be sent
+ */
+void rfs_frame_init(struct rfs_frame_t *frame, struct rfs_usart_t *usart, const uint8_t *data, uint16_t size);
+
+/**
+ * @brief Send a part of the frame
+ *
+ * This function is non blocking. If the frame has not been completely sent, then it returns
+ * 1. Otherwise, it returns 0.
+ *
+ * The CRC is computed incrementally, while the payload is being encoded. At the beginning of each COBS block
+ * the payload is scanned up to the next zero byte (at most 254 bytes), and each byte is scanned only once.
+ * 
+ * @param frame The frame to be sent
+ * 
+ * @returns Whether the frame has been completely sent or not
+ */
+int8_t rfs_frame_send(struct rfs_frame_t *frame);
+
+/**
+ * @brief Initializes the reception of frames
+ * 
+ * @param frame The structure that contains the reception information
+ * @param usart The USART device used to receive the frames
+ * @param data The buffer where the payload of the frames is written
+ * @param capacity The size of the buffer
+ */
+void rfs_frame_recv_init(struct rfs_frame_rx_t *frame, struct rfs_usart_t *usart, uint8_t *data, uint16_t capacity);
+
+/**
+ * @brief Receive a part of a frame
+ *
+ * This function is non blocking. It decodes all the bytes already received by the USART, until a complete
+ * frame is found. The payload is written directly in the buffer given to rfs_frame_recv_init and the CRC
+ * is computed as the bytes arrive.
+ *
+ * When a valid frame has been received, it returns 1, and the size field contains the size of its payload. The
+ * payload is valid until the next call to this function. Otherwise, it returns 0.
+ *
+ * The frames with a wrong CRC, with a reception error, with a wrong encoding or that don't fit in the buffer are
+ * discarded and counted in the bad_frames field. After a bad frame, the reception restarts after the next
+ * delimiter. The frames field counts the valid frames.
+ * 
+ * @param frame The structure that contains the reception information
+ * 
+ * @returns Whether a complete frame has been received or not
+ */
+int8_t rfs_frame_recv(struct rfs_frame_rx_t *frame);
+
+#endif
@@ -24,7 +24,43 @@ along with RobotsFromScratch; see the file COPYING.  If not, see
 #define RFS_LEDS_H
 
 #include <stdint.h>
+#include <avr/pgmspace.h>
 #include <rfsavr/io.h>
+#include <rfsavr/usart.h>
+
+/**
+ * @brief Limits of the duration of a SPI bit when the LEDs are driven with the USART in Master SPI mode, in ns.
+ *
+ * Each WS2812B bit is sent as a symbol of 4 SPI bits: 1000 for a 0 and 1100 for a 1. The high time of a 1 (two SPI
+ * bits) must be between 650 and 950 ns, and the high time of a 0 (one SPI bit) below 550 ns.
+ */
+#define RFS_LEDS_SPI_BIT_MIN_NS 325
+#define RFS_LEDS_SPI_BIT_MAX_NS 475
+
+/**
+ * @brief Nominal timing of the supported LED chips, in ns.
+ *
+ * The WS2811 values are the ones of its low speed (400 kHz) mode.
+ */
+#define RFS_LEDS_WS2812_T0H_NS      400
+#define RFS_LEDS_WS2812_T1H_NS      800
+#define RFS_LEDS_WS2812_PERIOD_NS   1250
+#define RFS_LEDS_SK6812_T0H_NS      300
+#define RFS_LEDS_SK6812_T1H_NS      600
+#define RFS_LEDS_SK6812_PERIOD_NS   1250
+#define RFS_LEDS_WS2811_T0H_NS      500
+#define RFS_LEDS_WS2811_T1H_NS      1200
+#define RFS_LEDS_WS2811_PERIOD_NS   2500
+
+/**
+ * @brief Maximum number of strips driven by rfs_leds_write_parallel, one for each pin of the port.
+ */
+#define RFS_LEDS_PARALLEL_STRIPS    8
+
+/**
+ * @brief Gamma correction table (gamma 2.8) for the LED colors, stored in flash.
+ */
+extern const uint8_t RFS_LEDS_GAMMA[256] PROGMEM;
 
 /**
  * @brief Struct that contains the color value of a LED.
@@ -35,13 +71,303 @@ struct rfs_grb_t {
     uint8_t blue;
 };
 
+/**
+ * @brief Struct that contains the color value of a RGBW LED, like the SK6812.
+ */
+struct rfs_grbw_t {
+    uint8_t green;
+    uint8_t red;
+    uint8_t blue;
+    uint8_t white;
+};
+
+/**
+ * @brief A span of consecutive LEDs with the same color, used by rfs_leds_write_rle.
+ */
+struct rfs_leds_span_t {
+    uint8_t count;
+    uint8_t index;
+};
+
+/**
+ * @brief Struct that contains the state of a write of LEDs values through the USART in Master SPI mode.
+ */
+struct rfs_leds_spi_t {
+    struct rfs_usart_t *usart;
+    const uint8_t *data;
+    uint16_t size;
+    uint16_t position;
+    uint8_t current;
+    uint8_t pending;
+};
+
 /**
  * @brief Writes a sequence of LED values to an output pin using the WS2812B serial protocol.
  *
  * @param leds_values The colors of the LEDs to write.
+ * @param leds_count The number of LEDs to write. Up to 21845.
+ * @param leds_pin The pin where to write the LEDs new colors.
+ */
+void rfs_leds_write(const struct rfs_grb_t *leds_values, uint16_t leds_count, struct rfs_pin_t *leds_pin);
+
+/**
+ * @brief Writes a sequence of LED values to an output pin, with brightness and gamma correction.
+ *
+ * Each color byte is scaled by (brightness + 1) / 256 and then passed through the gamma table while it is written,
+ * so the LED values stay in linear color and no second buffer is needed. The timing is the same as in
+ * rfs_leds_write.
+ *
+ * @param leds_values The colors of the LEDs to write.
+ * @param leds_count The number of LEDs to write. Up to 21845.
+ * @param leds_pin The pin where to write the LEDs new colors.
+ * @param brightness The global brightness, 255 is the full brightness.
+ * @param gamma_table Table of 256 bytes stored in flash, usually RFS_LEDS_GAMMA. A table with the identity only
+ *                    applies the brightness.
+ */
+void rfs_leds_write_scaled(const struct rfs_grb_t *leds_values, uint16_t leds_count, struct rfs_pin_t *leds_pin,
+    uint8_t brightness, const uint8_t *gamma_table);
+
+/**
+ * @brief Writes a sequence of LEDs given as indexes in a palette of colors.
+ *
+ * Each LED takes one byte, instead of the three of a struct rfs_grb_t. The colors are looked up in the palette while
+ * they are written, and the timing is the same as in rfs_leds_write.
+ *
+ * @param leds_indexes The index in the palette of the color of each LED.
+ * @param leds_count The number of LEDs to write. Up to 21845.
+ * @param palette The colors of the palette, up to 256.
+ * @param leds_pin The pin where to write the LEDs new colors.
+ */
+void rfs_leds_write_palette(const uint8_t *leds_indexes, uint16_t leds_count, const struct rfs_grb_t *palette,
+    struct rfs_pin_t *leds_pin);
+
+/**
+ * @brief Writes a sequence of LEDs given as 4-bit indexes in a palette of colors.
+ *
+ * Like rfs_leds_write_palette, but each byte contains the indexes of two LEDs: the first one in the high nibble and
+ * the second one in the low nibble.
+ *
+ * @param leds_indexes The index in the palette of the color of each LED, two per byte.
+ * @param leds_count The number of LEDs to write. Up to 21845.
+ * @param palette The colors of the palette, up to 16.
+ * @param leds_pin The pin where to write the LEDs new colors.
+ */
+void rfs_leds_write_palette4(const uint8_t *leds_indexes, uint16_t leds_count, const struct rfs_grb_t *palette,
+    struct rfs_pin_t *leds_pin);
+
+/**
+ * @brief Writes a sequence of LEDs given as spans of LEDs with the same color of a palette.
+ *
+ * Like rfs_leds_write_palette, but the LEDs are run-length encoded: each span gives the number of consecutive LEDs
+ * (from 1 to 255) that have the color with the given index.
+ *
+ * @param leds_spans The spans of LEDs.
+ * @param leds_count The total number of LEDs to write. Up to 21845.
+ * @param palette The colors of the palette, up to 256.
+ * @param leds_pin The pin where to write the LEDs new colors.
+ */
+void rfs_leds_write_rle(const struct rfs_leds_span_t *leds_spans, uint16_t leds_count, const struct rfs_grb_t *palette,
+    struct rfs_pin_t *leds_pin);
+
+/**
+ * @brief Writes a sequence of LED values to up to 8 strips at the same time, using the pins of one port.
+ *
+ * The values of the strips are stored one after the other in leds_values, leds_count LEDs each, in the order of
+ * their pins: the first strip is the one connected to the lowest pin in pins_mask, so the buffer takes 3 bytes per
+ * LED and strip. The pins that are not in pins_mask keep their value. All the strips are written in the time it
+ * takes to write one. The timing is generated by the CPU, so the interrupts should be disabled during the write.
+ *
+ * @param leds_values The colors of the LEDs to write, strip after strip.
+ * @param leds_count The number of LEDs to write in each strip. Up to 21845.
+ * @param port The port where the strips are connected. The pins in pins_mask must be outputs.
+ * @param pins_mask The pins of the port connected to a strip.
+ */
+void rfs_leds_write_parallel(const struct rfs_grb_t *leds_values, uint16_t leds_count, volatile uint8_t *port,
+    uint8_t pins_mask);
+
+/**
+ * @brief Opens the USART in Master SPI mode to drive WS2812B LEDs.
+ *
+ * The LEDs data is output at the TXD pin, and it is generated by the USART hardware, so the timing doesn't depend on
+ * the CPU and the interrupts can be left enabled. The XCK pin is also driven by the USART.
+ * 
+ * @param usart At output, the USART device to use in rfs_leds_spi_write_init.
+ * @param cpu_frequency The CPU frequency.
+ * 
+ * @returns 1 on success, or -1 if the WS2812B timing can't be obtained with this CPU frequency. In this last case,
+ *          rfs_errno is RFS_ETIMING.
+ */
+int8_t rfs_leds_spi_open(struct rfs_usart_t *usart, uint32_t cpu_frequency);
+
+/**
+ * @brief Initializes a write of a sequence of LED values through the USART in Master SPI mode.
+ *
+ * @param leds The structure that contains the state of the write.
+ * @param usart The USART device, opened with rfs_leds_spi_open.
+ * @param leds_values The colors of the LEDs to write. Must be valid until the write is completed.
  * @param leds_count The number of LEDs to write.
+ */
+void rfs_leds_spi_write_init(struct rfs_leds_spi_t *leds, struct rfs_usart_t *usart,
+    const struct rfs_grb_t *leds_values, uint16_t leds_count);
+
+/**
+ * @brief Writes a part of the LED values through the USART in Master SPI mode.
+ *
+ * This function is non blocking. It refills the USART transmit buffer, which holds two WS2812B bits (3 us at 16
+ * MHz). If the buffer is not refilled in time, the line stays low longer: the LEDs tolerate it, unless the line
+ * stays low for more than 50 us, which they take as the end of the sequence. Then, the function must be called
+ * often enough until the sequence is completed.
+ * When the function returns 0, the last byte is still being sent. The next sequence can start 50 us later.
+ * 
+ * @param leds The structure that contains the state of the write.
+ * 
+ * @returns 1 if the sequence has not been completely written, 0 otherwise.
+ */
+int8_t rfs_leds_spi_write(struct rfs_leds_spi_t *leds);
+
+#ifdef F_CPU
+
+/**
+ * @brief Number of CPU cycles, rounded to the closest, of a time in ns.
+ */
+#define RFS_LEDS_CYCLES(ns) ((long)(((F_CPU) / 1000UL * (ns) + 500000UL) / 1000000UL))
+
+/**
+ * @brief Number of nops to wait in each part of a bit, given its timing in ns.
+ *
+ * A bit is: store the high level, wait, store the bit value (the low level for a 0), wait, store the low level,
+ * select the value of the next bit (3 cycles) and wait. Each store takes 2 cycles. The nops can't be negative, so
+ * at low frequencies the bit gets longer than the nominal period, which the LEDs accept.
+ */
+#define RFS_LEDS_NOPS(cycles)                           ((cycles) > 0 ? (cycles) : 0)
+#define RFS_LEDS_T0H_NOPS(t0h_ns)                       RFS_LEDS_NOPS(RFS_LEDS_CYCLES(t0h_ns) - 2)
+#define RFS_LEDS_T1H_NOPS(t0h_ns, t1h_ns) \
+    RFS_LEDS_NOPS(RFS_LEDS_CYCLES(t1h_ns) - RFS_LEDS_CYCLES(t0h_ns) - 2)
+#define RFS_LEDS_LOW_NOPS(t0h_ns, t1h_ns, period_ns) \
+    RFS_LEDS_NOPS(RFS_LEDS_CYCLES(period_ns) - RFS_LEDS_T0H_NOPS(t0h_ns) - RFS_LEDS_T1H_NOPS(t0h_ns, t1h_ns) - 9)
+
+/**
+ * @brief Writes a sequence of bytes to an output pin, with the timing given in ns.
+ *
+ * The timing is computed from F_CPU at compile time, so the timing arguments must be constants. The bits of a byte
+ * have the same timing, except the last one, that is up to 7 cycles longer at low level, because the next byte is
+ * loaded. Usually, one of the rfs_leds_write_<chip> functions is used instead of this macro.
+ *
+ * @param data The bytes to write, as a const uint8_t *.
+ * @param bytes_count The number of bytes to write, greater than 0.
+ * @param leds_pin The pin where to write the bytes, as a struct rfs_pin_t *.
+ * @param t0h_ns The high time of a 0.
+ * @param t1h_ns The high time of a 1.
+ * @param period_ns The duration of a bit.
+ */
+#define RFS_LEDS_WRITE_TIMED(data, bytes_count, leds_pin, t0h_ns, t1h_ns, period_ns) \
+    do { \
+        _Static_assert(RFS_LEDS_CYCLES(t0h_ns) >= 2 && RFS_LEDS_CYCLES(t1h_ns) - RFS_LEDS_CYCLES(t0h_ns) >= 2, \
+            "LED timing not attainable with this F_CPU"); \
+        const uint8_t rfs_port_value = *(leds_pin)->port; \
+        const uint8_t rfs_port_high = rfs_port_value | _BV((leds_pin)->pin); \
+        const uint8_t rfs_port_low = rfs_port_value & ~_BV((leds_pin)->pin); \
+        const uint8_t *rfs_data_ptr = (data); \
+        uint16_t rfs_bytes_count = (bytes_count); \
+        uint8_t rfs_color_value, rfs_bit_value; \
+        asm volatile ( \
+                "ld %[cur], %a[ptr]+" "\n\t" \
+                "mov %[bit], %[low]" "\n\t" \
+                "sbrc %[cur], 7" "\n\t" \
+                "mov %[bit], %[high]" "\n\t" \
+            "bits%=:" "\n\t" \
+                ".irp next_bit, 6, 5, 4, 3, 2, 1, 0" "\n\t" \
+                "st %a[port], %[high]" "\n\t" \
+                ".rept %[t0h_nops]" "\n\t" "nop" "\n\t" ".endr" "\n\t" \
+                "st %a[port], %[bit]" "\n\t" \
+                ".rept %[t1h_nops]" "\n\t" "nop" "\n\t" ".endr" "\n\t" \
+                "st %a[port], %[low]" "\n\t" \
+                "mov %[bit], %[low]" "\n\t" \
+                "sbrc %[cur], \\next_bit" "\n\t" \
+                "mov %[bit], %[high]" "\n\t" \
+                ".rept %[low_nops]" "\n\t" "nop" "\n\t" ".endr" "\n\t" \
+                ".endr" "\n\t" \
+                "st %a[port], %[high]" "\n\t" \
+                ".rept %[t0h_nops]" "\n\t" "nop" "\n\t" ".endr" "\n\t" \
+                "st %a[port], %[bit]" "\n\t" \
+                ".rept %[t1h_nops]" "\n\t" "nop" "\n\t" ".endr" "\n\t" \
+                "st %a[port], %[low]" "\n\t" \
+                "sbiw %[count], 1" "\n\t" \
+                "breq end%=" "\n\t" \
+                "ld %[cur], %a[ptr]+" "\n\t" \
+                "mov %[bit], %[low]" "\n\t" \
+                "sbrc %[cur], 7" "\n\t" \
+                "mov %[bit], %[high]" "\n\t" \
+                ".rept %[last_nops]" "\n\t" "nop" "\n\t" ".endr" "\n\t" \
+                "rjmp bits%=" "\n\t" \
+            "end%=:" "\n\t" \
+            : [cur] "=&r" (rfs_color_value), [bit] "=&r" (rfs_bit_value), [count] "+w" (rfs_bytes_count), \
+              [ptr] "+e" (rfs_data_ptr) \
+            : [port] "e" ((leds_pin)->port), [high] "r" (rfs_port_high), [low] "r" (rfs_port_low), \
+              [t0h_nops] "n" (RFS_LEDS_T0H_NOPS(t0h_ns)), [t1h_nops] "n" (RFS_LEDS_T1H_NOPS(t0h_ns, t1h_ns)), \
+              [low_nops] "n" (RFS_LEDS_LOW_NOPS(t0h_ns, t1h_ns, period_ns)), \
+              [last_nops] "n" (RFS_LEDS_NOPS(RFS_LEDS_LOW_NOPS(t0h_ns, t1h_ns, period_ns) - 7)) \
+            : "memory" \
+        ); \
+    } while (0)
+
+/**
+ * @brief Writes a sequence of LED values to an output pin using the WS2812B protocol, timed for F_CPU.
+ *
+ * Unlike rfs_leds_write, that is tuned for 16 MHz, the timing is computed at compile time for the F_CPU of the
+ * program (8 MHz or more). The interrupts should be disabled during the write.
+ *
+ * @param leds_values The colors of the LEDs to write.
+ * @param leds_count The number of LEDs to write. Up to 21845.
+ * @param leds_pin The pin where to write the LEDs new colors.
+ */
+inline void rfs_leds_write_ws2812(const struct rfs_grb_t *leds_values, uint16_t leds_count,
+    struct rfs_pin_t *leds_pin)
+{
+    if (leds_count) {
+        RFS_LEDS_WRITE_TIMED((const uint8_t *)leds_values, leds_count * 3, leds_pin, RFS_LEDS_WS2812_T0H_NS,
+            RFS_LEDS_WS2812_T1H_NS, RFS_LEDS_WS2812_PERIOD_NS);
+    }
+}
+
+/**
+ * @brief Writes a sequence of RGBW LED values to an output pin using the SK6812 protocol, timed for F_CPU.
+ *
+ * @see rfs_leds_write_ws2812
+ *
+ * @param leds_values The colors of the LEDs to write.
+ * @param leds_count The number of LEDs to write. Up to 16383.
  * @param leds_pin The pin where to write the LEDs new colors.
  */
-void rfs_leds_write(const struct rfs_grb_t *leds_values, uint8_t leds_count, struct rfs_pin_t *leds_pin);
+inline void rfs_leds_write_sk6812(const struct rfs_grbw_t *leds_values, uint16_t leds_count,
+    struct rfs_pin_t *leds_pin)
+{
+    if (leds_count) {
+        RFS_LEDS_WRITE_TIMED((const uint8_t *)leds_values, leds_count * 4, leds_pin, RFS_LEDS_SK6812_T0H_NS,
+            RFS_LEDS_SK6812_T1H_NS, RFS_LEDS_SK6812_PERIOD_NS);
+    }
+}
+
+/**
+ * @brief Writes a sequence of LED values to an output pin using the WS2811 low speed protocol, timed for F_CPU.
+ *
+ * The bytes are sent in the order of struct rfs_grb_t. Many WS2811 strips expect the red value first, in that case
+ * the fields of each LED must be filled accordingly.
+ * @see rfs_leds_write_ws2812
+ *
+ * @param leds_values The colors of the LEDs to write.
+ * @param leds_count The number of LEDs to write. Up to 21845.
+ * @param leds_pin The pin where to write the LEDs new colors.
+ */
+inline void rfs_leds_write_ws2811(const struct rfs_grb_t *leds_values, uint16_t leds_count,
+    struct rfs_pin_t *leds_pin)
+{
+    if (leds_count) {
+        RFS_LEDS_WRITE_TIMED((const uint8_t *)leds_values, leds_count * 3, leds_pin, RFS_LEDS_WS2811_T0H_NS,
+            RFS_LEDS_WS2811_T1H_NS, RFS_LEDS_WS2811_PERIOD_NS);
+    }
+}
+
+#endif
 
 #endif
\ No newline at end of file
@@ -39,29 +39,106 @@ enum rfs_message_state
     RFS_MSG_STATE_END
 };
 
+/**
+ * @brief Used internaly to implement the state machine that receives the message through the serial port
+ */
+enum rfs_message_recv_state
+{
+    RFS_MSG_RECV_STATE_SYNC,
+    RFS_MSG_RECV_STATE_DATA
+};
+
+/**
+ * @brief Flags of the segments of a message
+ */
+enum rfs_iovec_flags
+{
+    RFS_IOV_RAM = 0x00,
+    RFS_IOV_PROGMEM = 0x01
+};
+
+/**
+ * @brief A segment of the payload of a message
+ *
+ * If flags contains RFS_IOV_PROGMEM, base is an address in the flash memory (PROGMEM).
+ */
+struct rfs_iovec_t
+{
+    const char *base;
+    uint16_t size;
+    uint8_t flags;
+};
+
 /**
  * @brief Struct that contains all the necessary information to operate with the message.
+ *
+ * The payload is a list of segments. iov_index is the segment being sent and offset the number of bytes
+ * of that segment already sent. checksum accumulates the sum of the bytes as they are sent. segment is
+ * used to hold the payload of the messages initialized with rfs_message_init, whose iov is null, so the structure
+ * has no pointer to itself and can be copied.
  */
 struct rfs_message_t
 {
-    const char *data;
-    uint8_t size;
+    const struct rfs_iovec_t *iov;
+    uint8_t iov_count;
+    uint8_t iov_index;
+    uint16_t offset;
+    uint16_t size;
     struct rfs_usart_t *usart;
-    int8_t checksum;
-    uint8_t written;
-    const char *data_ptr;
+    uint8_t checksum;
+    uint16_t written;
     enum rfs_message_state state;
+    struct rfs_iovec_t segment;
+};
+
+/**
+ * @brief Struct that contains all the necessary information to receive messages.
+ *
+ * The last two bytes received are kept in pending until the next byte arrives, because they may be the
+ * checksum of the message. This way, only the payload is written to data.
+ */
+struct rfs_message_rx_t
+{
+    struct rfs_usart_t *usart;
+    char *data;
+    uint16_t capacity;
+    uint16_t size;
+    uint8_t sum;
+    char pending[2];
+    uint8_t pending_count;
+    uint16_t frames;
+    uint16_t bad_frames;
+    enum rfs_message_recv_state state;
 };
 
 /**
  * @brief Initializes the message
  * 
+ * The checksum is not computed here, but accumulated while the data is being sent. So, init takes constant
+ * time, and the data can still be produced after this call, as long as each byte is ready before
+ * rfs_message_send reaches it.
+ * 
  * @param message The message to be sent
  * @param usart The USART devide used to send the message
  * @param data The data to be sent
- * @param size The size of the data to be sent
+ * @param size The size of the data to be sent (up to 65535 bytes)
  */
-void rfs_message_init(struct rfs_message_t *message, struct rfs_usart_t *usart, const char *data, uint8_t size);
+void rfs_message_init(struct rfs_message_t *message, struct rfs_usart_t *usart, const char *data, uint16_t size);
+
+/**
+ * @brief Initializes a message whose payload is made of several segments
+ * 
+ * The segments are sent one after the other, as a single message, so they don't need to be copied to a
+ * single buffer first. The segments marked with RFS_IOV_PROGMEM are read directly from the flash memory.
+ * The array of segments must be valid until the message has been sent.
+ * 
+ * @param message The message to be sent
+ * @param usart The USART devide used to send the message
+ * @param iov The segments of the payload
+ * @param iov_count The number of segments
+ */
+void rfs_message_init_iov(struct rfs_message_t *message, struct rfs_usart_t *usart, const struct rfs_iovec_t *iov,
+    uint8_t iov_count);
 
 /**
  * @brief Send a part of the message
@@ -75,4 +152,34 @@ void rfs_message_init(struct rfs_message_t *message, struct rfs_usart_t *usart,
  */
 int8_t rfs_message_send(struct rfs_message_t *message);
 
+/**
+ * @brief Initializes the reception of messages
+ * 
+ * @param message The structure that contains the reception information
+ * @param usart The USART device used to receive the messages
+ * @param data The buffer where the payload of the messages is written
+ * @param capacity The size of the buffer
+ */
+void rfs_message_recv_init(struct rfs_message_rx_t *message, struct rfs_usart_t *usart, char *data, uint16_t capacity);
+
+/**
+ * @brief Receive a part of a message
+ *
+ * This function is non blocking. It processes all the bytes already received by the USART, until a complete
+ * message is found. The payload is written directly in the buffer given to rfs_message_recv_init and the checksum
+ * is accumulated as the bytes arrive.
+ *
+ * When a valid message has been received, it returns 1, and the size field contains the size of its payload. The
+ * payload is valid until the next call to this function. Otherwise, it returns 0.
+ *
+ * The messages with a wrong checksum, with a reception error or that don't fit in the buffer are discarded and
+ * counted in the bad_frames field. After a bad message, the reception restarts at the next ':' header. The
+ * frames field counts the valid messages.
+ * 
+ * @param message The structure that contains the reception information
+ * 
+ * @returns Whether a complete message has been received or not
+ */
+int8_t rfs_message_recv(struct rfs_message_rx_t *message);
+
 #endif
\ No newline at end of file
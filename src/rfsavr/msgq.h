@@ -0,0 +1,142 @@
+/*
+msgq.h - Prioritized queue of messages sent through one USART
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RFS_MSGQ_H
+#define RFS_MSGQ_H
+
+#include <stdint.h>
+
+#include <rfsavr/message.h>
+
+/**
+ * @brief Index used to mark the end of a list of slots
+ */
+#define RFS_MSGQ_NONE   0xff
+
+/**
+ * @brief Priorities of the messages. Lower values are sent first.
+ */
+enum rfs_msgq_priority
+{
+    RFS_MSGQ_URGENT,
+    RFS_MSGQ_NORMAL,
+    RFS_MSGQ_BULK,
+    RFS_MSGQ_PRIORITIES
+};
+
+/**
+ * @brief A slot of the queue, that holds one message
+ *
+ * Callers only have to provide the storage for the slots, the fields are used internaly.
+ */
+struct rfs_msgq_slot_t
+{
+    struct rfs_message_t *message;
+    uint16_t enqueued;
+    uint8_t next;
+};
+
+/**
+ * @brief Statistics of one priority level of the queue
+ *
+ * The latencies are measured in calls to rfs_msgq_poll, from the moment the message is enqueued until
+ * the moment it has been completely sent.
+ */
+struct rfs_msgq_stats_t
+{
+    uint8_t depth;
+    uint8_t max_depth;
+    uint16_t sent;
+    uint16_t max_latency;
+    uint32_t total_latency;
+};
+
+/**
+ * @brief Struct that contains all the necessary information to operate the queue
+ *
+ * Each priority level is a FIFO list of slots, given by the indexes of its first and last slots. The free
+ * slots are kept in another list.
+ */
+struct rfs_msgq_t
+{
+    struct rfs_usart_t *usart;
+    struct rfs_msgq_slot_t *slots;
+    uint8_t head[RFS_MSGQ_PRIORITIES];
+    uint8_t tail[RFS_MSGQ_PRIORITIES];
+    uint8_t free;
+    uint8_t current;
+    uint8_t current_priority;
+    uint16_t ticks;
+    struct rfs_msgq_stats_t stats[RFS_MSGQ_PRIORITIES];
+};
+
+/**
+ * @brief Initializes the queue
+ * 
+ * @param queue The queue
+ * @param usart The USART device used to send all the messages of the queue. The queue owns it: while the queue is
+ *              not empty, it must not be written by other means.
+ * @param slots The storage for the slots of the queue
+ * @param capacity The number of slots (up to 255). This is the maximum number of messages in the queue.
+ */
+void rfs_msgq_init(struct rfs_msgq_t *queue, struct rfs_usart_t *usart, struct rfs_msgq_slot_t *slots,
+    uint8_t capacity);
+
+/**
+ * @brief Add a message to the queue
+ * 
+ * The message must have been initialized with rfs_message_init or rfs_message_init_iov, and it must be valid
+ * until it has been sent. It is sent through the USART of the queue, whatever USART it was initialized with.
+ * The messages with the same priority are sent in the same order they were enqueued.
+ * 
+ * @param queue The queue
+ * @param message The message to send
+ * @param priority The priority of the message
+ * 
+ * @returns 1 if the message has been enqueued, 0 if the queue is full or the priority is not valid
+ */
+int8_t rfs_msgq_enqueue(struct rfs_msgq_t *queue, struct rfs_message_t *message, enum rfs_msgq_priority priority);
+
+/**
+ * @brief Send a part of the queued messages
+ * 
+ * This function is non blocking. The messages are sent frame by frame: a message that has started is always
+ * completed before the next one, so the frames never interleave. When a message is completed, the next one
+ * is the oldest message of the highest priority, so the urgent messages jump ahead of the others.
+ * 
+ * @param queue The queue
+ * 
+ * @returns 1 if there are still messages to send, 0 if the queue is empty, also when this call has completed the
+ *          last message
+ */
+int8_t rfs_msgq_poll(struct rfs_msgq_t *queue);
+
+/**
+ * @brief Reset the statistics of the queue
+ * 
+ * The current depth of each priority level is kept.
+ * 
+ * @param queue The queue
+ */
+void rfs_msgq_reset_stats(struct rfs_msgq_t *queue);
+
+#endif
@@ -26,6 +26,16 @@ along with RobotsFromScratch; see the file COPYING.  If not, see
 #include "rfsavr/io.h"
 #include "rfsavr/timers.h"
 
+/**
+ * @brief Fraction bits of the frequencies compared by rfs_pwm_plan. With 7 bits, the CPU frequency can be up to 33 MHz
+ */
+#define RFS_PWM_PLAN_FRACTION_BITS  7
+
+/**
+ * @brief The planner functions are always inlined, even with -Os, so that constant arguments are folded
+ */
+#define RFS_PWM_PLAN_INLINE inline __attribute__((always_inline))
+
 /**
  * @brief Enumeration for the possible PWM channels
  */
@@ -50,6 +60,37 @@ struct rfs_pwm_t {
     void (*set_frequency_hint)(const struct rfs_pwm_t *, uint32_t, uint32_t);
 };
 
+/**
+ * @brief Struct that contains a PWM frequency configuration, computed by rfs_pwm_plan
+ *
+ * steps is the number of different duty cycle values, that is, TOP + 1. It is zero when no configuration was found,
+ * and then all the other fields but timer are zero too. period is the number of CPU cycles of each PWM period, and
+ * frequency the obtained PWM frequency, rounded to Hz.
+ */
+struct rfs_pwm_plan_t {
+    enum rfs_timer_enum timer;
+    uint8_t clock;
+    uint8_t mode;
+    uint16_t top;
+    uint32_t steps;
+    uint32_t period;
+    uint32_t frequency;
+};
+
+/**
+ * @brief Struct that contains a frequency change of a PWM signal, waiting for the next PWM period
+ *
+ * pending is the step of the change that is waiting, or zero when there's none. top is the TOP value that the duty
+ * cycle is scaled from until the first step, and then the TOP value of the period that was running at that step.
+ */
+struct rfs_pwm_retune_t {
+    const struct rfs_pwm_t *pwm;
+    struct rfs_pwm_plan_t plan;
+    volatile uint8_t *tifr;
+    uint16_t top;
+    uint8_t pending;
+};
+
 /**
  * @brief Initialize the PWM structure
  * 
@@ -66,6 +107,63 @@ void rfs_pwm_init(struct rfs_pwm_t *pwm, enum rfs_timer_enum timer, enum rfs_pwm
  */
 void rfs_pwm_close(const struct rfs_pwm_t *pwm);
 
+/**
+ * @brief Configure the PWM signal frequency with a configuration computed by rfs_pwm_plan
+ *
+ * The duty cycle values go from 0 to plan->top. The plan has to be computed for the timer of the PWM signal, and
+ * plan->steps must not be zero.
+ *
+ * @param pwm The structure that contains the PWM information
+ * @param plan The timer configuration
+ */
+void rfs_pwm_set_plan(const struct rfs_pwm_t *pwm, const struct rfs_pwm_plan_t *plan);
+
+/**
+ * @brief Return the TOP value of the timer of the PWM signal, that depends on its current mode
+ *
+ * @param pwm The structure that contains the PWM information
+ *
+ * @returns The TOP value
+ */
+uint16_t rfs_pwm_get_top(const struct rfs_pwm_t *pwm);
+
+/**
+ * @brief Request to change the frequency of a running PWM signal at the start of the next PWM period
+ *
+ * The registers are written by rfs_pwm_retune_poll, after the next overflow of the timer, so that no period is cut.
+ * If the timer is stopped, they are written at once. If a change is still pending, it is replaced by this one, so
+ * that a frequency sweep only has to call this function with every new frequency. For that, retune has to be zeroed
+ * before its first use, like a static variable.
+ *
+ * @param retune The state of the change
+ * @param pwm The structure that contains the PWM information
+ * @param plan The new timer configuration, computed by rfs_pwm_plan for the timer of pwm. It is copied.
+ */
+void rfs_pwm_retune(struct rfs_pwm_retune_t *retune, const struct rfs_pwm_t *pwm, const struct rfs_pwm_plan_t *plan);
+
+/**
+ * @brief Write the frequency requested by rfs_pwm_retune, if the PWM period has started
+ *
+ * The duty cycle of the signal is scaled to the new TOP value, so that it keeps the same ratio. The other channel of
+ * the timer is not changed. The change takes two steps, so that every period has either the previous configuration
+ * or the new one:
+ * - After an overflow, the duty cycle registers, and TOP for the 8-bit timers, are written. They are double
+ *   buffered, and take the new values at the start of the next period.
+ * - At the start of that period, the mode, the clock divisor and, for timer 1, TOP (ICR1, that is not buffered)
+ *   are written. This is done while the counter is in the first half of both the previous and the new periods, so
+ *   the counter can't miss the new TOP.
+ *
+ * The ticks of the new period before the second step are counted with the previous clock divisor, so a change of
+ * divisor lengthens or shortens that period a little. The 8-bit timers in phase correct mode update their registers
+ * at TOP, so their first new period has the previous TOP in its first half. This has to be called at least twice per
+ * PWM period while a change is pending.
+ *
+ * @param retune The state of the change
+ *
+ * @returns 1 if there's no change pending, after writing the registers, or 0 if the change is still pending
+ */
+int8_t rfs_pwm_retune_poll(struct rfs_pwm_retune_t *retune);
+
 /**
  * @brief Set an extact value for the PWM signal frequency
  * 
@@ -112,6 +210,166 @@ inline void rfs_pwm_set_frequency_hint(const struct rfs_pwm_t *pwm, uint32_t fre
     pwm->set_frequency_hint(pwm, frequency, cpu_frequency);
 }
 
+/**
+ * @brief Return the difference between the target frequency and the frequency of a PWM period
+ *
+ * @param period The CPU cycles of the PWM period
+ * @param frequency The target frequency
+ * @param cpu_frequency The CPU's clock frequency
+ *
+ * @returns The difference, in 1/2^RFS_PWM_PLAN_FRACTION_BITS Hz
+ */
+RFS_PWM_PLAN_INLINE uint32_t rfs_pwm_plan_error(uint32_t period, uint32_t frequency, uint32_t cpu_frequency)
+{
+    const uint32_t obtained = ((cpu_frequency << RFS_PWM_PLAN_FRACTION_BITS) + (period >> 1)) / period;
+    const uint32_t target = frequency << RFS_PWM_PLAN_FRACTION_BITS;
+    return (obtained > target) ? (obtained - target) : (target - obtained);
+}
+
+/**
+ * @brief Try one clock divisor and mode for rfs_pwm_plan
+ *
+ * The TOP value closest to the target frequency is computed, raised to give min_steps duty cycle values, and clamped
+ * to the timer range. The plan is replaced
+ * if this TOP gives less error, or the same error with more steps. While searching, plan->mode only tells whether
+ * the mode is phase correct.
+ *
+ * @param plan The best configuration found so far
+ * @param frequency The target frequency
+ * @param cpu_frequency The CPU's clock frequency
+ * @param min_steps The minimum number of duty cycle values
+ * @param max_top The maximum TOP value of the timer
+ * @param divisor The clock divisor
+ * @param clock The clock source that selects the divisor
+ * @param phase_correct 1 for phase correct mode, 0 for fast mode
+ */
+RFS_PWM_PLAN_INLINE void rfs_pwm_plan_candidate(struct rfs_pwm_plan_t *plan, uint32_t frequency, uint32_t cpu_frequency,
+    uint32_t min_steps, uint16_t max_top, uint16_t divisor, uint8_t clock, uint8_t phase_correct)
+{
+    // Not even one timer tick per period. Otherwise, the product below is not greater than the CPU frequency
+    if (frequency > ((cpu_frequency / divisor) >> phase_correct)) {
+        return;
+    }
+
+    // The period is TOP + 1 ticks in fast mode, and 2 * TOP ticks in phase correct mode
+    const uint32_t ticks_frequency = (frequency * divisor) << phase_correct;
+    uint32_t top = (cpu_frequency + (ticks_frequency >> 1)) / ticks_frequency;
+    if (!phase_correct) {
+        top--;
+    }
+    if (top + 1 < min_steps) {
+        top = min_steps - 1;
+    }
+    if (top > max_top) {
+        if (min_steps > (uint32_t)max_top + 1) {
+            return;
+        }
+        top = max_top;
+    }
+    if (top == 0) {
+        return;
+    }
+
+    const uint32_t period = (uint32_t)divisor * (phase_correct ? (top << 1) : (top + 1));
+    if (plan->steps) {
+        const uint32_t error = rfs_pwm_plan_error(period, frequency, cpu_frequency);
+        const uint32_t best_error = rfs_pwm_plan_error(plan->period, frequency, cpu_frequency);
+        if (error > best_error || (error == best_error && top + 1 <= plan->steps)) {
+            return;
+        }
+    }
+    plan->clock = clock;
+    plan->mode = phase_correct;
+    plan->top = top;
+    plan->steps = top + 1;
+    plan->period = period;
+}
+
+/**
+ * @brief Try one clock divisor in fast and phase correct modes for rfs_pwm_plan
+ *
+ * @param plan The best configuration found so far
+ * @param frequency The target frequency
+ * @param cpu_frequency The CPU's clock frequency
+ * @param min_steps The minimum number of duty cycle values
+ * @param max_top The maximum TOP value of the timer
+ * @param divisor The clock divisor
+ * @param clock The clock source that selects the divisor
+ */
+RFS_PWM_PLAN_INLINE void rfs_pwm_plan_divisor(struct rfs_pwm_plan_t *plan, uint32_t frequency, uint32_t cpu_frequency,
+    uint32_t min_steps, uint16_t max_top, uint16_t divisor, uint8_t clock)
+{
+    rfs_pwm_plan_candidate(plan, frequency, cpu_frequency, min_steps, max_top, divisor, clock, 0);
+    rfs_pwm_plan_candidate(plan, frequency, cpu_frequency, min_steps, max_top, divisor, clock, 1);
+}
+
+/**
+ * @brief Compute the timer configuration that gives the closest PWM frequency to a target frequency
+ *
+ * All the clock divisors of the timer are tried, in fast and phase correct modes, with the TOP value closest to the
+ * target frequency that gives at least min_steps duty cycle values. The configuration with the least frequency error
+ * is chosen and, on equal error, the one with more duty cycle values. If the timer can't give min_steps values,
+ * plan->steps is zero.
+ *
+ * For the 8-bit timers, TOP is in the OCRA register, so only channel B can be used, unless TOP is 255. For timer 1,
+ * TOP is in the ICR1 register, and both channels can be used. The phase correct mode of timer 1 is the phase and
+ * frequency correct one, that gives the same signal, but updates the duty cycle at BOTTOM, like the fast mode, so
+ * rfs_pwm_retune_poll can change TOP without a malformed period.
+ *
+ * This routine takes constant time. It is always inlined and, when all the arguments are constants, the whole
+ * computation is done at compile time, and only the register writes of rfs_pwm_set_plan remain. With variable
+ * arguments, every call inlines the whole search, so it is better wrapped in a function of the program.
+ *
+ * @param plan At output, the timer configuration
+ * @param timer The timer that generates the PWM signal
+ * @param frequency The target frequency
+ * @param cpu_frequency The CPU's clock frequency
+ * @param min_steps The minimum number of duty cycle values
+ */
+RFS_PWM_PLAN_INLINE void rfs_pwm_plan(struct rfs_pwm_plan_t *plan, enum rfs_timer_enum timer, uint32_t frequency,
+    uint32_t cpu_frequency, uint32_t min_steps)
+{
+    const uint16_t max_top = (timer == RFS_TIMER1) ? 0xffff : 0xff;
+
+    // All the fields are set, even when no configuration is found
+    plan->timer = timer;
+    plan->clock = 0;
+    plan->mode = 0;
+    plan->top = 0;
+    plan->steps = 0;
+    plan->period = 0;
+    plan->frequency = 0;
+    if (frequency == 0) {
+        return;
+    }
+    rfs_pwm_plan_divisor(plan, frequency, cpu_frequency, min_steps, max_top, 1, 1);
+    rfs_pwm_plan_divisor(plan, frequency, cpu_frequency, min_steps, max_top, 8, 2);
+    if (timer == RFS_TIMER2) {
+        rfs_pwm_plan_divisor(plan, frequency, cpu_frequency, min_steps, max_top, 32, 3);
+        rfs_pwm_plan_divisor(plan, frequency, cpu_frequency, min_steps, max_top, 64, 4);
+        rfs_pwm_plan_divisor(plan, frequency, cpu_frequency, min_steps, max_top, 128, 5);
+        rfs_pwm_plan_divisor(plan, frequency, cpu_frequency, min_steps, max_top, 256, 6);
+        rfs_pwm_plan_divisor(plan, frequency, cpu_frequency, min_steps, max_top, 1024, 7);
+    } else {
+        rfs_pwm_plan_divisor(plan, frequency, cpu_frequency, min_steps, max_top, 64, 3);
+        rfs_pwm_plan_divisor(plan, frequency, cpu_frequency, min_steps, max_top, 256, 4);
+        rfs_pwm_plan_divisor(plan, frequency, cpu_frequency, min_steps, max_top, 1024, 5);
+    }
+    if (!plan->steps) {
+        return;
+    }
+
+    const uint8_t phase_correct = plan->mode;
+    if (timer == RFS_TIMER1) {
+        plan->mode = phase_correct ? RFS_TIMER16_MODE_PWM_PHASE_FREQUENCY_CORRECT_ICR : RFS_TIMER16_MODE_FAST_PWM_ICR;
+    } else if (plan->top == 0xff) {
+        plan->mode = phase_correct ? RFS_TIMER8_MODE_PWM_PHASE_CORRECT : RFS_TIMER8_MODE_FAST_PWM;
+    } else {
+        plan->mode = phase_correct ? RFS_TIMER8_MODE_PWM_PHASE_CORRECT_OCRA : RFS_TIMER8_MODE_FAST_PWM_OCRA;
+    }
+    plan->frequency = (cpu_frequency + (plan->period >> 1)) / plan->period;
+}
+
 /**
  * @brief Set the duty cycle (8-bit timer)
  * 
@@ -138,4 +396,194 @@ inline void rfs_pwm_set_duty_cycle_16(const struct rfs_pwm_t *pwm, uint16_t duty
     *pwm->ocr16 = duty_cycle;
 }
 
+/**
+ * @brief A PWM signal of a group, and its staged duty cycle
+ *
+ * Callers only have to provide the storage for the slots, the fields are used internaly.
+ */
+struct rfs_pwm_group_slot_t {
+    const struct rfs_pwm_t *pwm;
+    uint16_t duty_cycle;
+    uint8_t wide;
+};
+
+/**
+ * @brief Struct that contains a group of PWM signals whose duty cycles change in the same PWM period
+ *
+ * The overflow flag of the timer of the first signal tells when the values can be written.
+ */
+struct rfs_pwm_group_t {
+    struct rfs_pwm_group_slot_t *slots;
+    uint8_t capacity;
+    uint8_t count;
+    uint8_t pending;
+    volatile uint8_t *tifr;
+};
+
+/**
+ * @brief Initialize a group of PWM signals
+ *
+ * @param group The group
+ * @param slots The storage for the slots of the group
+ * @param capacity The number of slots, that is, the maximum number of signals in the group
+ */
+void rfs_pwm_group_init(struct rfs_pwm_group_t *group, struct rfs_pwm_group_slot_t *slots, uint8_t capacity);
+
+/**
+ * @brief Add a PWM signal to the group
+ *
+ * The signals are identified by their index in the group, in the order they are added. The staged duty cycle is 0.
+ *
+ * @param group The group
+ * @param pwm An initialized PWM signal
+ *
+ * @returns 1 if the signal has been added, 0 if the group is full
+ */
+int8_t rfs_pwm_group_add(struct rfs_pwm_group_t *group, const struct rfs_pwm_t *pwm);
+
+/**
+ * @brief Align the counters of the timers of the group
+ *
+ * The prescalers are held in reset while the counters are cleared, using the timer synchronization mode of GTCCR, so
+ * that all the timers start counting in the same CPU cycle. With the clock divisor 1, that doesn't go through the
+ * prescaler, the counters are some CPU cycles apart. This only makes sense if all the timers use the same period,
+ * and it has to be called after setting their frequencies.
+ *
+ * @param group The group
+ */
+void rfs_pwm_group_sync(const struct rfs_pwm_group_t *group);
+
+/**
+ * @brief Stage the duty cycle of a signal of the group
+ *
+ * The value is not written until rfs_pwm_group_commit and rfs_pwm_group_poll are called.
+ *
+ * @param group The group
+ * @param index The index of the signal in the group
+ * @param duty_cycle The new duty cycle, that is truncated to 8 bits for the 8-bit timers
+ */
+inline void rfs_pwm_group_set(struct rfs_pwm_group_t *group, uint8_t index, uint16_t duty_cycle)
+{
+    group->slots[index].duty_cycle = duty_cycle;
+}
+
+/**
+ * @brief Request to write the staged duty cycles at the start of the next PWM period
+ *
+ * The overflow flag of the first timer is cleared, and rfs_pwm_group_poll writes the values when it is set again.
+ * A group without signals has no timer, and nothing to write, so the commit is ignored.
+ *
+ * @param group The group
+ */
+inline void rfs_pwm_group_commit(struct rfs_pwm_group_t *group)
+{
+    if (group->count == 0) {
+        return;
+    }
+    // The TOVn bits are all bit 0
+    *group->tifr = _BV(TOV0);
+    group->pending = 1;
+}
+
+/**
+ * @brief Write the committed duty cycles, if the PWM period has started
+ *
+ * The OCRnx registers are double buffered in the PWM modes, and the new values are used from the next TOP or BOTTOM.
+ * The values are all written just after the overflow, so that every timer takes them in the same PWM period, as long
+ * as the timers have been aligned with rfs_pwm_group_sync. This has to be called at least once per PWM period while
+ * a commit is pending.
+ *
+ * @param group The group
+ *
+ * @returns 1 if there's no commit pending, after writing the values, or 0 if the commit is still pending
+ */
+int8_t rfs_pwm_group_poll(struct rfs_pwm_group_t *group);
+
+/**
+ * @brief Data direction register and bit of the compare output pin of each timer and channel, used by RFS_PWM_DEFINE
+ */
+#define RFS_PWM_STATIC_DDR_0A   DDRD
+#define RFS_PWM_STATIC_BIT_0A   6
+#define RFS_PWM_STATIC_DDR_0B   DDRD
+#define RFS_PWM_STATIC_BIT_0B   5
+#define RFS_PWM_STATIC_DDR_1A   DDRB
+#define RFS_PWM_STATIC_BIT_1A   1
+#define RFS_PWM_STATIC_DDR_1B   DDRB
+#define RFS_PWM_STATIC_BIT_1B   2
+#define RFS_PWM_STATIC_DDR_2A   DDRB
+#define RFS_PWM_STATIC_BIT_2A   3
+#define RFS_PWM_STATIC_DDR_2B   DDRD
+#define RFS_PWM_STATIC_BIT_2B   3
+
+/**
+ * @brief Type of the duty cycle of each timer, used by RFS_PWM_DEFINE
+ */
+#define RFS_PWM_STATIC_DUTY_0   uint8_t
+#define RFS_PWM_STATIC_DUTY_1   uint16_t
+#define RFS_PWM_STATIC_DUTY_2   uint8_t
+
+/**
+ * @brief Write the TOP value of a rfs_pwm_plan_t to each timer, used by RFS_PWM_DEFINE
+ */
+#define RFS_PWM_STATIC_SET_TOP_0(top)   if ((top) != 0xff) { OCR0A = (top); }
+#define RFS_PWM_STATIC_SET_TOP_1(top)   ICR1 = (top)
+#define RFS_PWM_STATIC_SET_TOP_2(top)   if ((top) != 0xff) { OCR2A = (top); }
+
+/**
+ * @brief Define a PWM signal whose timer and channel are fixed at compile time
+ *
+ * Instead of a struct rfs_pwm_t, that holds the addresses of the registers, this macro generates a set of static
+ * inline functions that access the registers directly, so that they take no RAM and setting the duty cycle is a single
+ * store to OCRnx. The generated functions are:
+ *
+ * - name_init(): like rfs_pwm_init.
+ * - name_close(): like rfs_pwm_close.
+ * - name_set_plan(plan): like rfs_pwm_set_plan.
+ * - name_set_frequency(frequency, cpu_frequency, min_steps): compute the plan with rfs_pwm_plan and write it, if
+ *   the timer can give min_steps duty cycle values. With constant arguments, only the register writes remain.
+ * - name_set_duty_cycle(duty_cycle): set the duty cycle, 8-bit for timers 0 and 2 and 16-bit for timer 1.
+ *
+ * For example, RFS_PWM_DEFINE(motor, 0, A) defines motor_init(), motor_set_duty_cycle(), etc., for timer 0 and
+ * channel A.
+ *
+ * @param name The prefix of the generated functions
+ * @param timer The timer number, 0, 1 or 2
+ * @param channel The channel letter, A or B
+ */
+#define RFS_PWM_DEFINE(name, timer, channel) \
+    static inline void name##_init(void) \
+    { \
+        RFS_PWM_STATIC_DDR_##timer##channel |= _BV(RFS_PWM_STATIC_BIT_##timer##channel); \
+        rfs_bits_set_mask(TCCR##timer##A, RFS_TIMER_COM##channel##_MASK, RFS_TIMER_COM##channel##_NONINVERT); \
+    } \
+    \
+    static inline void name##_close(void) \
+    { \
+        TCCR##timer##A &= ~(RFS_TIMER_COM##channel##_MASK | RFS_TIMER_CRA_MODE_MASK); \
+        TCCR##timer##B &= ~(RFS_TIMER_CRB_MODE_MASK | RFS_TIMER_CLOCK_MASK); \
+    } \
+    \
+    static RFS_PWM_PLAN_INLINE void name##_set_plan(const struct rfs_pwm_plan_t *plan) \
+    { \
+        rfs_bits_set_mask(TCCR##timer##A, RFS_TIMER_CRA_MODE_MASK, plan->mode & RFS_TIMER_CRA_MODE_MASK); \
+        rfs_bits_set_mask(TCCR##timer##B, RFS_TIMER_CRB_MODE_MASK, plan->mode & RFS_TIMER_CRB_MODE_MASK); \
+        RFS_PWM_STATIC_SET_TOP_##timer(plan->top); \
+        rfs_bits_set_mask(TCCR##timer##B, RFS_TIMER_CLOCK_MASK, plan->clock); \
+    } \
+    \
+    static RFS_PWM_PLAN_INLINE void name##_set_frequency(uint32_t frequency, uint32_t cpu_frequency, \
+        uint32_t min_steps) \
+    { \
+        struct rfs_pwm_plan_t plan; \
+        rfs_pwm_plan(&plan, RFS_TIMER##timer, frequency, cpu_frequency, min_steps); \
+        if (plan.steps) { \
+            name##_set_plan(&plan); \
+        } \
+    } \
+    \
+    static inline void name##_set_duty_cycle(RFS_PWM_STATIC_DUTY_##timer duty_cycle) \
+    { \
+        OCR##timer##channel = duty_cycle; \
+    }
+
 #endif
\ No newline at end of file
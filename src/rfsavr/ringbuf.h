@@ -0,0 +1,143 @@
+/*
+ringbuf.h - Single-producer single-consumer ring buffer.
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RFS_RINGBUF_H
+#define RFS_RINGBUF_H
+
+#include <stdint.h>
+
+/**
+ * @brief Compiler barrier, to avoid that the accesses to the data are reordered with the index updates
+ */
+#define rfs_ringbuf_barrier()   __asm__ __volatile__ ("" ::: "memory")
+
+/**
+ * @brief Struct that contains a ring buffer of bytes
+ *
+ * The buffer can be safely shared by one producer and one consumer, for instance an interrupt handler and
+ * the main loop, without disabling the interrupts. The producer only modifies head and the consumer only
+ * modifies tail. Both indexes are 8 bits wide, so they are read and written atomically.
+ */
+struct rfs_ringbuf_t {
+    char *data;
+    uint8_t mask;
+    volatile uint8_t head;
+    volatile uint8_t tail;
+};
+
+/**
+ * @brief Whether a size is valid for the storage of a ring buffer: a power of two from 2 to 256
+ */
+#define RFS_RINGBUF_VALID_SIZE(size)    ((size) >= 2 && (size) <= 256 && ((size) & ((size) - 1)) == 0)
+
+/**
+ * @brief Initialize a ring buffer whose storage is an array, checking its size at compile time
+ *
+ * @param buffer The ring buffer, as a struct rfs_ringbuf_t *.
+ * @param data The array used as storage.
+ */
+#define RFS_RINGBUF_INIT(buffer, data) \
+    do { \
+        _Static_assert(RFS_RINGBUF_VALID_SIZE(sizeof(data)), "The ring buffer size must be a power of two"); \
+        rfs_ringbuf_init((buffer), (data), sizeof(data)); \
+    } while (0)
+
+/**
+ * @brief Initialize the ring buffer
+ *
+ * The size of the storage must be a power of two, from 2 to 256 bytes, because the indexes wrap around with a mask.
+ * One of the positions is always kept empty, so the buffer can hold up to size - 1 bytes. With any other size, the
+ * buffer is left both full and empty, so nothing can be put in it. RFS_RINGBUF_INIT checks the size at compile time.
+ *
+ * @param buffer The ring buffer
+ * @param data The storage for the ring buffer
+ * @param size The size of the storage
+ *
+ * @returns 1 if the buffer has been initialized, 0 if the size is not valid
+ */
+inline int8_t rfs_ringbuf_init(struct rfs_ringbuf_t *buffer, char *data, uint16_t size)
+{
+    const uint8_t valid = RFS_RINGBUF_VALID_SIZE(size);
+
+    buffer->data = data;
+    buffer->mask = valid ? size - 1 : 0;
+    buffer->head = 0;
+    buffer->tail = 0;
+    return valid;
+}
+
+/**
+ * @brief Return whether the ring buffer is empty
+ *
+ * @param buffer The ring buffer
+ *
+ * @returns Whether the ring buffer is empty
+ */
+inline uint8_t rfs_ringbuf_empty(const struct rfs_ringbuf_t *buffer)
+{
+    return buffer->head == buffer->tail;
+}
+
+/**
+ * @brief Put a byte in the ring buffer (producer side)
+ *
+ * @param buffer The ring buffer
+ * @param data The byte to put
+ *
+ * @returns 1 if the byte has been put, 0 if the buffer is full
+ */
+inline int8_t rfs_ringbuf_put(struct rfs_ringbuf_t *buffer, char data)
+{
+    const uint8_t head = buffer->head;
+    const uint8_t next = (head + 1) & buffer->mask;
+
+    if (next == buffer->tail) {
+        return 0;
+    }
+    buffer->data[head] = data;
+    rfs_ringbuf_barrier();
+    buffer->head = next;
+    return 1;
+}
+
+/**
+ * @brief Get a byte from the ring buffer (consumer side)
+ *
+ * @param buffer The ring buffer
+ * @param data At output, contains the byte
+ *
+ * @returns 1 if a byte has been got, 0 if the buffer is empty
+ */
+inline int8_t rfs_ringbuf_get(struct rfs_ringbuf_t *buffer, char *data)
+{
+    const uint8_t tail = buffer->tail;
+
+    if (tail == buffer->head) {
+        return 0;
+    }
+    *data = buffer->data[tail];
+    rfs_ringbuf_barrier();
+    buffer->tail = (tail + 1) & buffer->mask;
+    return 1;
+}
+
+#endif
@@ -0,0 +1,201 @@
+/*
+servo.h - Drive several servos from timer 1.
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RFS_SERVO_H
+#define RFS_SERVO_H
+
+#include <stdint.h>
+
+#include "rfsavr/io.h"
+#include "rfsavr/timers.h"
+
+/**
+ * @brief Index used to mark the end of the list of pulses
+ */
+#define RFS_SERVO_NONE  0xff
+
+/**
+ * @brief Number of I/O ports of the microcontroller (B, C and D)
+ */
+#define RFS_SERVO_PORTS 3
+
+/**
+ * @brief Fraction bits of the servo angles. The angles are given in 1/2^RFS_SERVO_ANGLE_FRACTION_BITS degrees
+ */
+#define RFS_SERVO_ANGLE_FRACTION_BITS   8
+
+/**
+ * @brief Convert an angle in degrees to the fixed point units of the servo angles
+ */
+#define RFS_SERVO_DEGREES(degrees)  ((uint16_t)((degrees) * (1L << RFS_SERVO_ANGLE_FRACTION_BITS)))
+
+/**
+ * @brief The maximum servo angle, that gives the longest pulse
+ */
+#define RFS_SERVO_ANGLE_MAX RFS_SERVO_DEGREES(180)
+
+/**
+ * @brief The period of the servo pulses, in microseconds
+ */
+#define RFS_SERVO_FRAME_US  20000
+
+/**
+ * @brief The default pulse widths of the minimum and maximum angles, in microseconds
+ */
+#define RFS_SERVO_MIN_US    1000
+#define RFS_SERVO_MAX_US    2000
+
+/**
+ * @brief How long before a pulse edge rfs_servo_bank_poll starts waiting for it, in microseconds
+ */
+#define RFS_SERVO_GUARD_US  40
+
+/**
+ * @brief A servo of a bank
+ *
+ * Callers only have to provide the storage for the servos, the fields are used internaly. ticks is the pulse width
+ * of the current angle, in timer ticks, or zero if the servo is disabled, and edge the tick where the pulse of the
+ * current frame ends.
+ */
+struct rfs_servo_t {
+    const struct rfs_pin_t *pin;
+    uint16_t angle;
+    uint16_t ticks;
+    uint16_t edge;
+    uint8_t next;
+};
+
+/**
+ * @brief The pins of a port that start a pulse at the same time
+ */
+struct rfs_servo_port_t {
+    volatile uint8_t *port;
+    uint8_t mask;
+};
+
+/**
+ * @brief Struct that contains all the necessary information to operate a bank of servos
+ *
+ * Timer 1 counts the 20 ms frames, with a clock divisor of 8. All the pulses start at the start of the frame, and
+ * end in order of width. The servos are kept in a list sorted by the end of their pulses, first is the shortest
+ * pulse and next the next pulse to end, while the pulses are running.
+ */
+struct rfs_servo_bank_t {
+    struct rfs_timer_t timer;
+    struct rfs_servo_t *servos;
+    uint8_t capacity;
+    uint8_t count;
+    uint8_t first;
+    uint8_t next;
+    uint8_t dirty;
+    uint8_t ports_count;
+    struct rfs_servo_port_t ports[RFS_SERVO_PORTS];
+    uint16_t tick_khz;
+    uint16_t top;
+    uint16_t guard;
+    uint16_t min_ticks;
+    uint16_t range_ticks;
+};
+
+/**
+ * @brief Initialize a bank of servos, and start timer 1
+ *
+ * The bank takes timer 1, that can't be used for anything else, and its pins are controlled by rfs_servo_bank_poll.
+ * The pulse widths are set to RFS_SERVO_MIN_US and RFS_SERVO_MAX_US.
+ *
+ * @param bank The bank
+ * @param servos The storage for the servos of the bank
+ * @param capacity The number of servos of the storage (up to 255)
+ * @param cpu_frequency The CPU's clock frequency, up to 26 MHz
+ */
+void rfs_servo_bank_init(struct rfs_servo_bank_t *bank, struct rfs_servo_t *servos, uint8_t capacity,
+    uint32_t cpu_frequency);
+
+/**
+ * @brief Stop the bank of servos
+ *
+ * Timer 1 is stopped, and the servo pins are set low.
+ *
+ * @param bank The bank
+ */
+void rfs_servo_bank_close(struct rfs_servo_bank_t *bank);
+
+/**
+ * @brief Add a servo to the bank
+ *
+ * The servos are identified by their index in the bank, in the order they are added. The pin is configured as output
+ * and set low. The servo is disabled until its angle is set.
+ *
+ * @param bank The bank
+ * @param pin The pin of the servo signal, that can be any output pin
+ *
+ * @returns 1 if the servo has been added, 0 if the bank is full
+ */
+int8_t rfs_servo_bank_add(struct rfs_servo_bank_t *bank, const struct rfs_pin_t *pin);
+
+/**
+ * @brief Set the pulse widths of the minimum and maximum angles
+ *
+ * The pulse widths of the servos that are enabled are updated.
+ *
+ * @param bank The bank
+ * @param min_us The pulse width of angle 0, in microseconds
+ * @param max_us The pulse width of RFS_SERVO_ANGLE_MAX, in microseconds
+ */
+void rfs_servo_bank_set_range(struct rfs_servo_bank_t *bank, uint16_t min_us, uint16_t max_us);
+
+/**
+ * @brief Set the angle of a servo, and enable it
+ *
+ * The new pulse width is used from the next frame.
+ *
+ * @param bank The bank
+ * @param index The index of the servo in the bank
+ * @param angle The new angle, from 0 to RFS_SERVO_ANGLE_MAX, in 1/2^RFS_SERVO_ANGLE_FRACTION_BITS degrees
+ */
+void rfs_servo_bank_set_angle(struct rfs_servo_bank_t *bank, uint8_t index, uint16_t angle);
+
+/**
+ * @brief Disable a servo, that doesn't receive more pulses
+ *
+ * @param bank The bank
+ * @param index The index of the servo in the bank
+ */
+void rfs_servo_bank_disable(struct rfs_servo_bank_t *bank, uint8_t index);
+
+/**
+ * @brief Start and end the pulses of the servos
+ *
+ * When an edge of a pulse is less than RFS_SERVO_GUARD_US away, this routine waits for it by polling timer 1, so
+ * the edges are written within some CPU cycles of their time. Otherwise, it returns at once. So, it never takes much
+ * more than RFS_SERVO_GUARD_US, and it has to be called at least once every RFS_SERVO_GUARD_US while the pulses run,
+ * and in the last RFS_SERVO_GUARD_US of the frame. If the start of a frame is missed, no pulses are generated in that
+ * frame, so that they never are shorter than requested.
+ *
+ * @param bank The bank
+ *
+ * @returns 1 if the pulses of the frame have ended, 0 while they are running. When it returns 1, the rest of the
+ *          frame, until RFS_SERVO_GUARD_US before the next one, is free for other work.
+ */
+int8_t rfs_servo_bank_poll(struct rfs_servo_bank_t *bank);
+
+#endif
@@ -33,6 +33,17 @@ along with RobotsFromScratch; see the file COPYING.  If not, see
  */
 char rfs_str_itohex(uint8_t value);
 
+/**
+ * @brief Transform an hexadecimal character to an integer value
+ * 
+ * Both lowercase and uppercase characters are accepted
+ * 
+ * @param value The hexadecimal character
+ * 
+ * @returns The integer value, from 0 to 15, or -1 if the character is not an hexadecimal digit
+ */
+int8_t rfs_str_hextoi(char value);
+
 /**
  * @brief Converts a 16 bit unsigned integer to hexadecimal and put the result in the given buffer
  * 
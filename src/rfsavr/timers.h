@@ -56,12 +56,14 @@ struct rfs_timer_t {
 
 /**
  * @brief Macros to obtain the addresses of the timer related registers from the TCCRXA register
+ *
+ * rfs_timer_cnt_16 and rfs_timer_icr point to whole 16-bit registers, so both bytes are accessed.
  */
 #define rfs_timer_crb(timer)        ((timer)->cra + 1)
 #define rfs_timer_crc(timer)        ((timer)->cra + 2)
 #define rfs_timer_cnt_8(timer)      ((timer)->cra + 2)
-#define rfs_timer_cnt_16(timer)     ((timer)->cra + 4)
-#define rfs_timer_icr(timer)        (uint16_t *)((timer)->cra + 6)
+#define rfs_timer_cnt_16(timer)     ((volatile uint16_t *)((timer)->cra + 4))
+#define rfs_timer_icr(timer)        ((volatile uint16_t *)((timer)->cra + 6))
 
 /**
  * @brief Enumeration with the valid timers
@@ -294,7 +296,8 @@ void rfs_timer_set_mode_8(const struct rfs_timer_t *timer, enum rfs_timer_mode_8
  */
 inline void rfs_timer_set_mode_16(const struct rfs_timer_t *timer, enum rfs_timer_mode_16 mode)
 {
-    rfs_timer_set_mode_8(timer, mode);
+    // Both enumerations place the WGM bits at the same positions
+    rfs_timer_set_mode_8(timer, (enum rfs_timer_mode_8)mode);
 }
 
 /**
@@ -24,6 +24,23 @@ along with RobotsFromScratch; see the file COPYING.  If not, see
 #define RFS_USART_H
 
 #include <stdint.h>
+#include <avr/io.h>
+
+#include <rfsavr/ringbuf.h>
+
+/**
+ * Maximum value that fits in the 12-bit UBRR register.
+ */
+#define RFS_USART_UBRR_MAX  0x0fff
+
+/**
+ * Compute the UBRR register value for a given baudrate, CPU frequency and clock divisor.
+ *
+ * The result is rounded to the closest value, but it is not clamped to the valid range of the register.
+ * All the arguments are constants in the usual case, so the value is computed at compile time.
+ */
+#define RFS_USART_UBRR(baudrate, cpu_frequency, clock_divisor) \
+    ((((cpu_frequency) + ((clock_divisor) * (baudrate) >> 1)) / ((clock_divisor) * (baudrate))) - 1)
 
 /**
  * The most typical Baudrate values.
@@ -79,6 +96,10 @@ enum rfs_usart_mode
 
 /**
  * Flags to setup the USART.
+ *
+ * The RFS_USART_SPI_* flags are only valid in Master SPI mode, where the UCSRC register has a different layout.
+ * In this mode, the frame format is always 8 bits, and the character size, parity and stop bits flags don't apply.
+ * The parity flags are the UPM0 bits shifted to the third byte: UPM0 = 10 is even parity and UPM0 = 11 is odd parity.
  */
 enum rfs_usart_flags
 {
@@ -94,12 +115,89 @@ enum rfs_usart_flags
     RFS_USART_9BITS = 0x060400,
     RFS_USART_1STOPBIT = 0x000000,
     RFS_USART_2STOPBITS = 0x080000,
-    RFS_USART_PARITYODD = 0x200000,
-    RFS_USART_PARITYEVEN = 0x300000,
+    RFS_USART_PARITYODD = 0x300000,
+    RFS_USART_PARITYEVEN = 0x200000,
+    RFS_USART_SPI_MSBFIRST = 0x000000,
+    RFS_USART_SPI_LSBFIRST = 0x040000,
+    RFS_USART_SPI_CPHA = 0x020000,
+    RFS_USART_SPI_CPOL = 0x010000,
+    RFS_USART_SPI_MODE0 = 0x000000,
+    RFS_USART_SPI_MODE1 = 0x020000,
+    RFS_USART_SPI_MODE2 = 0x010000,
+    RFS_USART_SPI_MODE3 = 0x030000,
+};
+
+/**
+ * Bit of a 9-bit frame that marks it as an address frame in multi-processor communication mode.
+ */
+#define RFS_USART_ADDRESS_BIT   0x0100
+
+/**
+ * The two possible values for the clock divisor when computing the USART baudrate.
+ */
+enum rfs_usart_clockdivisor
+{
+    RFS_USART_NORMAL_SPEED = 16,
+    RFS_USART_DOUBLE_SPEED = 8
+};
+
+/**
+ * Struct that contains the result of computing the USART speed parameters for a given baudrate.
+ */
+struct rfs_usart_speed_t
+{
+    uint16_t ubrr;
+    uint8_t double_speed;
+    uint32_t baudrate;
+    int32_t error_ppm;
+};
+
+/**
+ * Counters of the traffic and the errors of a USART.
+ *
+ * rx_bytes only counts the bytes received without errors. rx_dropped counts the bytes lost because the reception
+ * ring buffer was full, in buffered mode. max_poll_gap is the longest time between two consecutive reception
+ * polls, in ticks of the clock given to rfs_usart_setstats.
+ */
+struct rfs_usart_counters_t
+{
+    uint32_t rx_bytes;
+    uint32_t tx_bytes;
+    uint16_t frame_errors;
+    uint16_t overrun_errors;
+    uint16_t parity_errors;
+    uint16_t rx_dropped;
+    uint16_t max_poll_gap;
+};
+
+/**
+ * Struct that contains the statistics of a USART.
+ */
+struct rfs_usart_stats_t
+{
+    struct rfs_usart_counters_t counters;
+    volatile uint16_t *clock;
+    uint16_t last_poll;
+};
+
+/**
+ * Struct that contains the state of a full-duplex transfer in Master SPI mode.
+ */
+struct rfs_usart_spi_transfer_t
+{
+    struct rfs_usart_t *usart;
+    const uint8_t *tx_data;
+    uint8_t *rx_data;
+    uint16_t size;
+    uint16_t written;
+    uint16_t read;
 };
 
 /**
  * Struct that contains all the information to operate the USART.
+ *
+ * rx_buffer and tx_buffer are only used in buffered mode (see rfs_usart_setbuffers). In the default polled mode
+ * they are null. stats is only used if statistics are enabled (see rfs_usart_setstats), otherwise it is null.
  */
 struct rfs_usart_t
 {
@@ -108,8 +206,102 @@ struct rfs_usart_t
     volatile uint8_t *ucsrb;
     volatile uint8_t *ucsrc;
     volatile uint16_t *ubrr;
+    struct rfs_ringbuf_t *rx_buffer;
+    struct rfs_ringbuf_t *tx_buffer;
+    volatile uint8_t rx_error;
+    struct rfs_usart_stats_t *stats;
 };
 
+/**
+ * Compute the UBRR register value given a baudrate.
+ *
+ * The UBRR register value depends on the desired baudrate, the CPU frequency and the clock divisor.
+ * The formula is:
+ *
+ *     UBRR = (F_CPU / (clock_divisor * baudrate)) - 1
+ *
+ * The division is rounded to the closest value, so the error between the desired baudrate and the obtained one
+ * is minimized. The result is clamped to the range of the UBRR register.
+ *
+ * @param baudrate The desired baudrate.
+ * @param cpu_frequency The CPU frequency.
+ * @param clock_divisor Clock divisor applied to the CPU frequency.
+ *
+ * @returns The value to write on the UBRR register that obtains the closest USART transmission baudrate to
+ *          the specified baudrate.
+ */
+inline uint16_t
+rfs_usart_getubrr(uint32_t baudrate, uint32_t cpu_frequency, enum rfs_usart_clockdivisor clock_divisor)
+{
+    const uint32_t ubrr = RFS_USART_UBRR(baudrate, cpu_frequency, (uint32_t)clock_divisor);
+
+    if (ubrr == UINT32_MAX) {
+        // The baudrate is faster than the fastest one, and the unsigned result wrapped around
+        return 0;
+    } else if (ubrr > RFS_USART_UBRR_MAX) {
+        return RFS_USART_UBRR_MAX;
+    }
+    return ubrr;
+}
+
+
+/**
+ * Compute the parameters to configure the desired baudrate.
+ *
+ * The UBRR value is computed using both the normal and the double speed clock divisors, and the one that gives
+ * less error is chosen. On output, speed contains the UBRR value, whether the double speed has to be used, the
+ * baudrate actually obtained and the error in parts per million between the obtained and the desired baudrate.
+ * The error is positive when the obtained baudrate is faster than the desired one.
+ *
+ * This routine takes constant time. When baudrate and cpu_frequency are constants, the whole computation is
+ * done at compile time. This allows to reject the configurations that are out of tolerance before the USART
+ * is opened.
+ *
+ * @param speed At output, contains the parameters to configure the USART speed.
+ * @param baudrate The desired baudrate.
+ * @param cpu_frequency The CPU frequency.
+ */
+inline void
+rfs_usart_getspeed(struct rfs_usart_speed_t *speed, uint32_t baudrate, uint32_t cpu_frequency)
+{
+    const uint16_t normal_speed_ubrr = rfs_usart_getubrr(baudrate, cpu_frequency, RFS_USART_NORMAL_SPEED);
+    const uint16_t double_speed_ubrr = rfs_usart_getubrr(baudrate, cpu_frequency, RFS_USART_DOUBLE_SPEED);
+    const uint32_t normal_speed_clock = (uint32_t)RFS_USART_NORMAL_SPEED * (normal_speed_ubrr + 1);
+    const uint32_t double_speed_clock = (uint32_t)RFS_USART_DOUBLE_SPEED * (double_speed_ubrr + 1);
+
+    // Both errors are measured on the CPU frequency, so they can be compared directly
+    const int32_t normal_speed_error = cpu_frequency - baudrate * normal_speed_clock;
+    const int32_t double_speed_error = cpu_frequency - baudrate * double_speed_clock;
+
+    uint32_t clock;
+    int32_t error;
+    if ((normal_speed_error < 0 ? -normal_speed_error : normal_speed_error)
+        <= (double_speed_error < 0 ? -double_speed_error : double_speed_error)) {
+        speed->ubrr = normal_speed_ubrr;
+        speed->double_speed = 0;
+        clock = normal_speed_clock;
+        error = normal_speed_error;
+    } else {
+        speed->ubrr = double_speed_ubrr;
+        speed->double_speed = 1;
+        clock = double_speed_clock;
+        error = double_speed_error;
+    }
+    speed->baudrate = (cpu_frequency + (clock >> 1)) / clock;
+
+    // error * 1000000 / (baudrate * clock), in 32 bits: 1000000 is 15625 * 64, so the divisor is scaled down by 64,
+    // and both are halved while the product with 15625 would overflow. This only happens with large errors, that
+    // lose some ppm of precision
+    int32_t scaled_error = error;
+    uint32_t scaled_divisor = (baudrate * clock) >> 6;
+    while (scaled_error > INT32_MAX / 15625 || scaled_error < -(INT32_MAX / 15625)) {
+        scaled_error /= 2;
+        scaled_divisor >>= 1;
+    }
+    speed->error_ppm = scaled_error * 15625 / (int32_t)scaled_divisor;
+}
+
+
 /**
  * Initializes the USART.
  *
@@ -135,7 +327,8 @@ rfs_usart_open(struct rfs_usart_t *usart, enum rfs_usart_device device, enum rfs
  * Set the speed for the USART communication.
  *
  * To correctly compute the parameters to configure the desired baudrate, the CPU frequency must
- * be known.
+ * be known. The parameters are computed in constant time.
+ * @see rfs_usart_getspeed
  * 
  * @param usart The usart to use.
  * @param baudrate The desired baudrate.
@@ -145,6 +338,148 @@ void
 rfs_usart_setspeed(struct rfs_usart_t *usart, enum rfs_usart_baudrate baudrate, uint32_t cpu_frequency);
 
 
+/**
+ * Set the speed for the USART communication from already computed parameters.
+ *
+ * @see rfs_usart_getspeed
+ *
+ * @param usart The usart to use.
+ * @param speed The parameters to configure the USART speed.
+ */
+inline void
+rfs_usart_applyspeed(struct rfs_usart_t *usart, const struct rfs_usart_speed_t *speed)
+{
+    *(usart->ubrr) = speed->ubrr;
+    // Only U2X0 and MPCM0 are written back, like in rfs_usart_setmultiprocessor
+    const uint8_t ucsra = *(usart->ucsra) & _BV(MPCM0);
+    *(usart->ucsra) = speed->double_speed ? (ucsra | _BV(U2X0)) : ucsra;
+}
+
+
+/**
+ * Switch the USART to buffered (interrupt driven) mode.
+ *
+ * By default the USART works in polled mode, and no interrupts are used. In buffered mode, the reception and
+ * transmission interrupt handlers move the data between the USART and the given ring buffers, so no byte is
+ * lost if the main loop takes longer than one byte time to poll the USART. rfs_usart_read and rfs_usart_write
+ * keep working as usual, but on top of the ring buffers.
+ * Any of the buffers can be null, in which case that direction keeps working in polled mode.
+ *
+ * The interrupt handlers are only linked in the program if this routine is used. The global interrupts must be
+ * enabled (sei()) for the buffered mode to work.
+ *
+ * @param usart The usart to use.
+ * @param rx_buffer The ring buffer for the received bytes, or null.
+ * @param tx_buffer The ring buffer for the bytes to transmit, or null.
+ */
+void
+rfs_usart_setbuffers(struct rfs_usart_t *usart, struct rfs_ringbuf_t *rx_buffer, struct rfs_ringbuf_t *tx_buffer);
+
+
+/**
+ * Set the clock frequency of the USART in Master SPI mode.
+ *
+ * The SPI clock is F_CPU / (2 * (UBRR + 1)), so the fastest clock is F_CPU / 2. The obtained frequency is the
+ * closest one that is not faster than the desired frequency, so the limits of the slave device are respected.
+ *
+ * @param usart The usart to use. Must have been opened in RFS_USART_MASTERSPI mode.
+ * @param frequency The desired SPI clock frequency. 0 selects the slowest clock.
+ * @param cpu_frequency The CPU frequency.
+ *
+ * @returns The obtained SPI clock frequency.
+ */
+uint32_t
+rfs_usart_spi_setspeed(struct rfs_usart_t *usart, uint32_t frequency, uint32_t cpu_frequency);
+
+
+/**
+ * Initialize a full-duplex transfer in Master SPI mode.
+ *
+ * The bytes still pending in the reception buffer, from a previous transfer, are discarded. The slave select pin
+ * is not managed by the USART, it must be set by the caller around the transfer.
+ *
+ * @param transfer The transfer to initialize.
+ * @param usart The usart to use. Must have been opened in RFS_USART_MASTERSPI mode, with RFS_USART_RXTX.
+ * @param tx_data The bytes to send. If null, 0xff is sent for each byte.
+ * @param rx_data At output, contains the received bytes. If null, the received bytes are discarded.
+ * @param size The number of bytes to transfer.
+ */
+void
+rfs_usart_spi_transfer_init(struct rfs_usart_spi_transfer_t *transfer, struct rfs_usart_t *usart,
+    const uint8_t *tx_data, uint8_t *rx_data, uint16_t size);
+
+
+/**
+ * Transfer a part of the bytes.
+ *
+ * This function is non blocking. It refills the transmit buffer right after each read, so the bytes are sent back
+ * to back while it is called often enough and the clock is slow enough for its loop; at the fastest clocks there can
+ * be gaps between the bytes. At most two bytes are in flight, so the reception buffer never overruns.
+ * If the transfer has not been completed, then it returns 1. Otherwise, it returns 0.
+ *
+ * @param transfer The transfer.
+ *
+ * @returns Whether the transfer has been completed or not.
+ */
+int8_t
+rfs_usart_spi_transfer(struct rfs_usart_spi_transfer_t *transfer);
+
+
+/**
+ * Count a received byte in the statistics of the USART.
+ *
+ * Used internally by the reception routines and interrupt handler.
+ *
+ * @param stats The statistics of the USART.
+ * @param status The value of the UCSRA register when the byte was received.
+ */
+inline void
+rfs_usart_countrx(struct rfs_usart_stats_t *stats, uint8_t status)
+{
+    if (status & _BV(FE0)) {
+        stats->counters.frame_errors++;
+    } else if (status & _BV(DOR0)) {
+        stats->counters.overrun_errors++;
+    } else if (status & _BV(UPE0)) {
+        stats->counters.parity_errors++;
+    } else {
+        stats->counters.rx_bytes++;
+    }
+}
+
+
+/**
+ * Enable the statistics of the USART.
+ *
+ * Once enabled, the USART routines (and the interrupt handlers, in buffered mode) count the bytes received and
+ * transmitted and the reception errors by kind, that otherwise are only reported through rfs_errno.
+ * If a clock is given, the time between consecutive calls to the reception routines is also measured, to know
+ * if the main loop polls the USART fast enough. Any free running 16-bit counter can be used, like TCNT1.
+ *
+ * @param usart The usart to use.
+ * @param stats The statistics, or null to disable them. The counters are reset.
+ * @param clock The clock used to measure the time between polls, or null.
+ */
+void
+rfs_usart_setstats(struct rfs_usart_t *usart, struct rfs_usart_stats_t *stats, volatile uint16_t *clock);
+
+
+/**
+ * Take a snapshot of the statistics of the USART.
+ *
+ * The copy is done atomically with respect to the interrupt handlers, so the counters are consistent between
+ * them. The snapshot can be sent as the payload of a message:
+ *
+ *     rfs_message_init(&message, &usart, (const char *)&snapshot, sizeof(snapshot));
+ *
+ * @param usart The usart to use. Its statistics must be enabled.
+ * @param snapshot At output, contains the counters.
+ * @param reset Whether to reset the counters after taking the snapshot.
+ */
+void
+rfs_usart_getstats(struct rfs_usart_t *usart, struct rfs_usart_counters_t *snapshot, uint8_t reset);
+
+
 /**
  * Read the next available character received by the USART.
  *
@@ -156,26 +491,152 @@ rfs_usart_setspeed(struct rfs_usart_t *usart, enum rfs_usart_baudrate baudrate,
  *          - RFS_EFRAME: Frame error, the stop bit was zero.
  *          - RFS_EOVERRUN: Data overrun, the input buffer is full and a start bit is detected.
  *          - RFS_EPARITY: Parity checking is enabled and the received bit has a parity error.
+ *          In buffered mode, RFS_EOVERRUN is also returned when the reception ring buffer has overflowed.
  */
 int8_t
 rfs_usart_read(struct rfs_usart_t *usart, char *data);
 
 
+/**
+ * Read as many received bytes as available, up to a maximum.
+ *
+ * This routine doesn't block. It reads all the bytes that the USART has already received (or that are in the
+ * reception buffer, in buffered mode), up to size bytes.
+ * If a byte was received with errors, the reading stops before it, so the good bytes received previously are
+ * returned first. The next call consumes the erroneous byte and returns -1.
+ *
+ * @param usart The usart to use.
+ * @param data At output, contains the read bytes.
+ * @param size The maximum number of bytes to read.
+ *
+ * @returns The number of bytes read (0 if there's no data) or -1 on error. In this last case, rfs_errno
+ *          contains the error, like in rfs_usart_read.
+ */
+int16_t
+rfs_usart_read_buf(struct rfs_usart_t *usart, char *data, uint8_t size);
+
+
 /**
  * Writes one byte to the USART.
  *
  * @param usart The usart to use.
  * @param data The byte to write.
  * 
- * @returns 1 if the byte has been written, 0 otherwise.
+ * @returns 1 if the byte has been written (or queued, in buffered mode), 0 otherwise.
  */
 int8_t
 rfs_usart_write(struct rfs_usart_t *usart, char data);
 
 
+/**
+ * Writes as many bytes as the USART accepts, up to a maximum.
+ *
+ * This routine doesn't block. It writes bytes while the transmit buffer is empty (or while the transmission
+ * ring buffer has room, in buffered mode).
+ *
+ * @param usart The usart to use.
+ * @param data The bytes to write.
+ * @param size The number of bytes to write.
+ *
+ * @returns The number of bytes written.
+ */
+uint8_t
+rfs_usart_write_buf(struct rfs_usart_t *usart, const char *data, uint8_t size);
+
+
+/**
+ * Read the next available 9-bit frame received by the USART.
+ *
+ * The ninth bit is returned in the bit 8 of data (RFS_USART_ADDRESS_BIT). The USART must be configured with
+ * RFS_USART_9BITS. This routine only works in polled mode, the buffered mode only keeps the low 8 bits.
+ *
+ * @param usart The usart to use.
+ * @param data At output, contains the read frame.
+ *
+ * @returns 1 if a frame have been received without errors, 0 if there's no data or -1 on error, like in
+ *          rfs_usart_read.
+ */
+int8_t
+rfs_usart_read9(struct rfs_usart_t *usart, uint16_t *data);
+
+
+/**
+ * Writes one 9-bit frame to the USART.
+ *
+ * The bit 8 of data is sent as the ninth bit. The USART must be configured with RFS_USART_9BITS. This routine
+ * only works in polled mode.
+ *
+ * @param usart The usart to use.
+ * @param data The frame to write.
+ *
+ * @returns 1 if the frame has been written, 0 otherwise.
+ */
+int8_t
+rfs_usart_write9(struct rfs_usart_t *usart, uint16_t data);
+
+
+/**
+ * Writes an address frame to the USART.
+ *
+ * In multi-processor communication mode, an address frame selects the node that receives the data frames
+ * that follow it, written with rfs_usart_write or rfs_usart_write_buf, that send the ninth bit cleared.
+ *
+ * @param usart The usart to use.
+ * @param address The address of the destination node.
+ *
+ * @returns 1 if the frame has been written, 0 otherwise.
+ */
+inline int8_t
+rfs_usart_write_address(struct rfs_usart_t *usart, uint8_t address)
+{
+    return rfs_usart_write9(usart, RFS_USART_ADDRESS_BIT | address);
+}
+
+
+/**
+ * Enables or disables the multi-processor communication mode.
+ *
+ * When enabled, the USART ignores all the received frames that are not address frames, without any
+ * intervention of the CPU.
+ * @see rfs_usart_read_addressed
+ *
+ * @param usart The usart to use.
+ * @param enabled Whether to enable the multi-processor communication mode or not.
+ */
+inline void
+rfs_usart_setmultiprocessor(struct rfs_usart_t *usart, uint8_t enabled)
+{
+    // Only U2X0 and MPCM0 are written back: writing a one to TXC0 would clear it, and FE0, DOR0 and UPE0 must be
+    // written as zero
+    const uint8_t ucsra = *(usart->ucsra) & (_BV(U2X0) | _BV(MPCM0));
+    *(usart->ucsra) = enabled ? (ucsra | _BV(MPCM0)) : (ucsra & ~_BV(MPCM0));
+}
+
+
+/**
+ * Read the next data byte addressed to this node.
+ *
+ * The USART must be configured with RFS_USART_9BITS and RFS_USART_MULTIPROCESSOR. While the node is not
+ * addressed, the multi-processor communication mode is enabled, so the data frames are filtered by the hardware.
+ * When an address frame with the node address is received, the filter is disabled and the following data frames
+ * are returned, until an address frame for another node is received.
+ *
+ * @param usart The usart to use.
+ * @param address The address of this node.
+ * @param data At output, contains the read byte.
+ *
+ * @returns 1 if a data byte addressed to this node has been received, 0 if there's no data (address frames
+ *          are consumed and return 0) or -1 on error, like in rfs_usart_read.
+ */
+int8_t
+rfs_usart_read_addressed(struct rfs_usart_t *usart, uint8_t address, char *data);
+
+
 /**
  * Disables the USART.
  *
+ * If the USART was in buffered mode, it returns to polled mode, and the bytes still in the buffers are dropped.
+ *
  * @param usart The usart to disable.
  * 
  */
@@ -0,0 +1,199 @@
+/*
+servo.c - Drive several servos from timer 1.
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+#include "rfsavr/servo.h"
+
+/**
+ * @brief Return the pulse width of an angle, in timer ticks
+ */
+static uint16_t rfs_servo_bank_ticks(const struct rfs_servo_bank_t *bank, uint16_t angle)
+{
+    return bank->min_ticks + (uint32_t)angle * bank->range_ticks / RFS_SERVO_ANGLE_MAX;
+}
+
+/**
+ * @brief Build the list of the enabled servos, sorted by the end of their pulses, and the pins of each port
+ */
+static void rfs_servo_bank_sort(struct rfs_servo_bank_t *bank)
+{
+    bank->first = RFS_SERVO_NONE;
+    bank->ports_count = 0;
+    for (uint8_t i = 0; i < bank->count; i++) {
+        struct rfs_servo_t *servo = &bank->servos[i];
+        if (!servo->ticks) {
+            continue;
+        }
+
+        // The pulse starts when the counter reaches TOP, one tick before it is zero
+        servo->edge = servo->ticks - 1;
+        uint8_t *link = &bank->first;
+        while (*link != RFS_SERVO_NONE && bank->servos[*link].edge <= servo->edge) {
+            link = &bank->servos[*link].next;
+        }
+        servo->next = *link;
+        *link = i;
+
+        uint8_t port = 0;
+        while (port < bank->ports_count && bank->ports[port].port != servo->pin->port) {
+            port++;
+        }
+        if (port == bank->ports_count) {
+            bank->ports[port].port = servo->pin->port;
+            bank->ports[port].mask = 0;
+            bank->ports_count++;
+        }
+        bank->ports[port].mask |= _BV(servo->pin->pin);
+    }
+    bank->dirty = 0;
+}
+
+/**
+ * @brief Start the pulses at the start of the frame
+ *
+ * @returns 1 if the pulses haven't started, 0 if they have
+ */
+static int8_t rfs_servo_bank_start(struct rfs_servo_bank_t *bank)
+{
+    if (bank->dirty) {
+        rfs_servo_bank_sort(bank);
+    }
+    if (bank->first == RFS_SERVO_NONE) {
+        return 1;
+    }
+    if (TIFR1 & _BV(ICF1)) {
+        // The frame started before this call, so the pulses would be short. Wait for the next one
+        TIFR1 = _BV(ICF1);
+        return 1;
+    }
+    if (TCNT1 + bank->guard < bank->top) {
+        return 1;
+    }
+
+    // The timer registers are used directly, so that the loop takes 3 cycles
+    while (!(TIFR1 & _BV(ICF1))) {}
+    for (uint8_t i = 0; i < bank->ports_count; i++) {
+        *bank->ports[i].port |= bank->ports[i].mask;
+    }
+    TIFR1 = _BV(ICF1);
+    bank->next = bank->first;
+    return 0;
+}
+
+void rfs_servo_bank_init(struct rfs_servo_bank_t *bank, struct rfs_servo_t *servos, uint8_t capacity,
+    uint32_t cpu_frequency)
+{
+    bank->servos = servos;
+    bank->capacity = capacity;
+    bank->count = 0;
+    bank->first = RFS_SERVO_NONE;
+    bank->next = RFS_SERVO_NONE;
+    bank->dirty = 0;
+    bank->ports_count = 0;
+    bank->tick_khz = cpu_frequency / 8000;
+    bank->top = (uint32_t)bank->tick_khz * RFS_SERVO_FRAME_US / 1000 - 1;
+    bank->guard = (uint32_t)bank->tick_khz * RFS_SERVO_GUARD_US / 1000;
+    rfs_servo_bank_set_range(bank, RFS_SERVO_MIN_US, RFS_SERVO_MAX_US);
+
+    // CTC mode, the counter goes from 0 to ICR1 once per frame and sets ICF1 at TOP
+    rfs_timer_init(&bank->timer, RFS_TIMER1);
+    rfs_timer_set_clock(&bank->timer, RFS_TIMER_CLOCK_NONE);
+    rfs_timer_set_mode_16(&bank->timer, RFS_TIMER16_MODE_CTC_ICR);
+    rfs_timer_set_icr(&bank->timer, bank->top);
+    rfs_timer_set_16(&bank->timer, 0);
+    TIFR1 = _BV(ICF1);
+    rfs_timer_set_clock(&bank->timer, RFS_TIMER0_CLOCK_8);
+}
+
+void rfs_servo_bank_close(struct rfs_servo_bank_t *bank)
+{
+    rfs_timer_set_clock(&bank->timer, RFS_TIMER_CLOCK_NONE);
+    rfs_timer_set_mode_16(&bank->timer, RFS_TIMER16_MODE_NORMAL);
+    for (uint8_t i = 0; i < bank->count; i++) {
+        rfs_pin_reset(bank->servos[i].pin);
+    }
+    bank->next = RFS_SERVO_NONE;
+}
+
+int8_t rfs_servo_bank_add(struct rfs_servo_bank_t *bank, const struct rfs_pin_t *pin)
+{
+    if (bank->count == bank->capacity) {
+        return 0;
+    }
+    struct rfs_servo_t *servo = &bank->servos[bank->count++];
+    servo->pin = pin;
+    servo->angle = 0;
+    servo->ticks = 0;
+    rfs_pin_reset(pin);
+    rfs_pin_set_output(pin);
+    return 1;
+}
+
+void rfs_servo_bank_set_range(struct rfs_servo_bank_t *bank, uint16_t min_us, uint16_t max_us)
+{
+    bank->min_ticks = (uint32_t)bank->tick_khz * min_us / 1000;
+    bank->range_ticks = (uint32_t)bank->tick_khz * max_us / 1000 - bank->min_ticks;
+    for (uint8_t i = 0; i < bank->count; i++) {
+        struct rfs_servo_t *servo = &bank->servos[i];
+        if (servo->ticks) {
+            servo->ticks = rfs_servo_bank_ticks(bank, servo->angle);
+        }
+    }
+    bank->dirty = 1;
+}
+
+void rfs_servo_bank_set_angle(struct rfs_servo_bank_t *bank, uint8_t index, uint16_t angle)
+{
+    struct rfs_servo_t *servo = &bank->servos[index];
+
+    if (angle > RFS_SERVO_ANGLE_MAX) {
+        angle = RFS_SERVO_ANGLE_MAX;
+    }
+    servo->angle = angle;
+    servo->ticks = rfs_servo_bank_ticks(bank, angle);
+    bank->dirty = 1;
+}
+
+void rfs_servo_bank_disable(struct rfs_servo_bank_t *bank, uint8_t index)
+{
+    bank->servos[index].ticks = 0;
+    bank->dirty = 1;
+}
+
+int8_t rfs_servo_bank_poll(struct rfs_servo_bank_t *bank)
+{
+    if (bank->next == RFS_SERVO_NONE) {
+        return rfs_servo_bank_start(bank);
+    }
+
+    // End all the pulses that are due before the guard time
+    do {
+        struct rfs_servo_t *servo = &bank->servos[bank->next];
+        const uint16_t edge = servo->edge;
+        if (TCNT1 + bank->guard < edge) {
+            return 0;
+        }
+        while (TCNT1 < edge) {}
+        rfs_pin_reset(servo->pin);
+        bank->next = servo->next;
+    } while (bank->next != RFS_SERVO_NONE);
+    return 1;
+}
@@ -29,6 +29,19 @@ char rfs_str_itohex(uint8_t value)
     return hextable[value & 0xf];
 }
 
+int8_t rfs_str_hextoi(char value)
+{
+    if ((value >= '0') && (value <= '9')) {
+        return value - '0';
+    }
+    // Accept both lowercase and uppercase letters
+    value |= 0x20;
+    if ((value >= 'a') && (value <= 'f')) {
+        return value - 'a' + 10;
+    }
+    return -1;
+}
+
 void rfs_str_u16tohex(uint16_t value, char *output_string)
 {
     uint8_t index = value & 0xf;
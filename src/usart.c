@@ -21,6 +21,8 @@ along with RobotsFromScratch; see the file COPYING.  If not, see
 */
 
 #include <avr/io.h>
+#include <string.h>
+#include <util/atomic.h>
 
 #include <rfsavr/usart.h>
 #include <rfsavr/errno.h>
@@ -32,79 +34,79 @@ along with RobotsFromScratch; see the file COPYING.  If not, see
 #define RFS_USART_A_MASK    0b00000001
 #define RFS_USART_B_MASK    0b00011100
 #define RFS_USART_C_MASK    0b00111111
-
-
-///////////////////////////////////////////////// PRIVATE TYPES ///////////////////////////////////////////////////
-
+#define RFS_USART_SPI_C_MASK    0b00000111
 
 /**
- * The two possible values for the clock divisor when computing the USART baudrate.
+ * Mask of the reception error flags in the UCSRA register.
  */
-enum rfs_usart_clockdivisor
-{
-    RFS_USART_NORMAL_SPEED = 16,
-    RFS_USART_DOUBLE_SPEED = 8
-};
+#define RFS_USART_ERROR_MASK    (_BV(FE0) | _BV(DOR0) | _BV(UPE0))
 
 
 ///////////////////////////////////////////////// PRIVATE FUNCTIONS ///////////////////////////////////////////////////
 
 
 /**
- * Compute tue UBRR register value given a baudrate.
+ * Translate the error flags of the reception status into an error code.
  *
- * The UBRR register value depends on the desired baudrate, the CPU frequency and the clock divisor.
- * The formula is:
- * 
- *     UBRR = (F_CPU / (16 * baudrate)) - 1
- * 
- * The division is performed in an iterative way, and the value of UBRR is found such as the error in the given baudrate
- * and the desired one is minimized.
- * On output, baudrate_error parameter contains the error between the desired baudrate and the obtained baudrate.
+ * @param status The value of the UCSRA register, with at least one of the error flags set.
  *
- * @param baudrate The desired baudrate.
- * @param cpu_frequency The CPU frequency.
- * @param clock_divisor Clock divisor applied to the CPU frequency.
- * @param baudrate_error At exit, contains the error between the desired baudrate and the obtained baudrate
- *                       using the given UBRR value.
- * 
- * @returns The value to write on the UBRR register that obtains the closest USART transmission baudrate to
- *          the specified baudrate.
+ * @returns The error code (RFS_EFRAME, RFS_EOVERRUN or RFS_EPARITY).
  */
-static uint16_t
-rfs_usart_getubrr(enum rfs_usart_baudrate baudrate, uint32_t cpu_frequency, enum rfs_usart_clockdivisor clock_divisor, uint32_t *baudrate_error)
+static uint8_t
+rfs_usart_geterror(uint8_t status)
 {
-    uint16_t ubrr = 0;
-    uint32_t baudrate_sum = 0;
-    uint32_t divisor = baudrate * clock_divisor;
-    
-    // Check that the conditions are met to calculate the UBRR value
-    if (cpu_frequency < divisor) {
-        return 0;
+    if (status & _BV(FE0)) {
+        // Frame error
+        return RFS_EFRAME;
+    } else if (status & _BV(DOR0)) {
+        // Buffer overrun
+        return RFS_EOVERRUN;
     }
+    // Parity error
+    return RFS_EPARITY;
+}
 
-    /* Search for the result of dividing cpu_frequency by divisor.
-       The loop will exit so that:
 
-       divisor * (ubrr - 1) < cpu_frequency <= divisor * ubrr
-    */
-    while (baudrate_sum < cpu_frequency) {
-        baudrate_sum += divisor;
-        ubrr++;
+/**
+ * Take the reception error recorded by the interrupt handler, in buffered mode.
+ *
+ * The error is read and cleared with the interrupts disabled, so an error recorded in between is not lost.
+ *
+ * @param usart The usart in buffered mode.
+ *
+ * @returns The error code, or 0 if there was no error.
+ */
+static uint8_t
+rfs_usart_takeerror(struct rfs_usart_t *usart)
+{
+    uint8_t error = 0;
+
+    if (usart->rx_error) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            error = usart->rx_error;
+            usart->rx_error = 0;
+        }
     }
+    return error;
+}
 
-    // Check which division value gives less error
-    if ((baudrate_sum - cpu_frequency) < (divisor >> 1)) {
-        // The current result is the closest one to the real result
-        // Subtract one from UBRR (see formula in the header)
-        ubrr--;
-        *baudrate_error = baudrate_sum - cpu_frequency;
-    } else {
-        // The closest result was adding one less time the divisor
-        ubrr -= 2;
-        *baudrate_error = cpu_frequency - (baudrate_sum - divisor);
+
+/**
+ * Measure the time since the previous reception poll.
+ *
+ * @param stats The statistics of the USART.
+ */
+static void
+rfs_usart_countpoll(struct rfs_usart_stats_t *stats)
+{
+    if (stats->clock) {
+        const uint16_t now = *(stats->clock);
+        const uint16_t gap = now - stats->last_poll;
+        if (gap > stats->counters.max_poll_gap) {
+            stats->counters.max_poll_gap = gap;
+        }
+        stats->last_poll = now;
     }
-    return ubrr;
 }
 
 
@@ -122,12 +124,20 @@ rfs_usart_open(struct rfs_usart_t *usart, enum rfs_usart_device device, enum rfs
         usart->ucsrc = &UCSR0C;
         usart->ubrr = &UBRR0;
     }
+    usart->rx_buffer = 0;
+    usart->tx_buffer = 0;
+    usart->rx_error = 0;
+    usart->stats = 0;
 
     // Set USART mode
     if (mode == RFS_USART_SYNCMASTER) {
         DDRD |= _BV(DDD4);
     } else if (mode == RFS_USART_SYNCSLAVE) {
         DDRD &= ~_BV(DDD4);
+    } else if (mode == RFS_USART_MASTERSPI) {
+        // In Master SPI mode, UBRR must be zero when the transmitter is enabled, and XCK is the clock output
+        *(usart->ubrr) = 0;
+        DDRD |= _BV(DDD4);
     }
     *(usart->ucsrc) &= ~RFS_USART_MODE_MASK;
     *(usart->ucsrc) |= (mode & RFS_USART_MODE_MASK);
@@ -137,35 +147,44 @@ rfs_usart_open(struct rfs_usart_t *usart, enum rfs_usart_device device, enum rfs
     *(usart->ucsra) |= (flags & 0xff);
     *(usart->ucsrb) &= ~RFS_USART_B_MASK;
     *(usart->ucsrb) |= ((flags >> 8) & 0xff);
-    *(usart->ucsrc) &= ~RFS_USART_C_MASK;
-    *(usart->ucsrc) |= ((flags >> 16) & 0xff);
+    if (mode == RFS_USART_MASTERSPI) {
+        // Only the data order and clock phase and polarity bits are valid in this mode
+        *(usart->ucsrc) &= ~RFS_USART_SPI_C_MASK;
+        *(usart->ucsrc) |= ((flags >> 16) & RFS_USART_SPI_C_MASK);
+    } else {
+        *(usart->ucsrc) &= ~RFS_USART_C_MASK;
+        *(usart->ucsrc) |= ((flags >> 16) & 0xff);
+    }
 }
 
 
 void
 rfs_usart_setspeed(struct rfs_usart_t *usart, enum rfs_usart_baudrate baudrate, uint32_t cpu_frequency)
 {
-    uint32_t normal_speed_error;
-    uint32_t double_speed_error;
+    struct rfs_usart_speed_t speed;
 
-    // Compute the UBRR register using normal and double speed, and check the error that each of them gives.
-    uint16_t normal_speed_ubrr = rfs_usart_getubrr(baudrate, cpu_frequency, RFS_USART_NORMAL_SPEED, &normal_speed_error);
-    uint16_t double_speed_ubrr = rfs_usart_getubrr(baudrate, cpu_frequency, RFS_USART_DOUBLE_SPEED, &double_speed_error);
-
-    // Use the UBRR value that gives less error
-    if (normal_speed_error <= double_speed_error) {
-        *(usart->ubrr) = normal_speed_ubrr;
-        *(usart->ucsra) &= ~_BV(U2X0);
-    } else {
-        *(usart->ubrr) = double_speed_ubrr;
-        *(usart->ucsra) |= _BV(U2X0);
-    }
+    // Compute the UBRR register using normal and double speed, and use the one that gives less error
+    rfs_usart_getspeed(&speed, baudrate, cpu_frequency);
+    rfs_usart_applyspeed(usart, &speed);
 }
 
 
 int8_t
 rfs_usart_read(struct rfs_usart_t *usart, char *data)
 {
+    if (usart->stats) {
+        rfs_usart_countpoll(usart->stats);
+    }
+    if (usart->rx_buffer) {
+        // Buffered mode. Report the errors recorded by the interrupt handler
+        const uint8_t error = rfs_usart_takeerror(usart);
+        if (error) {
+            rfs_errno = error;
+            return -1;
+        }
+        return rfs_ringbuf_get(usart->rx_buffer, data);
+    }
+
     // Check if a new byte has been received
     if ((*(usart->ucsra) & _BV(RXC0)) == 0) {
         // Return 0 to indicate that there's no data
@@ -175,43 +194,235 @@ rfs_usart_read(struct rfs_usart_t *usart, char *data)
     // Byte received. Read the reception status and the byte itself
     uint8_t status = *(usart->ucsra);
     *data = *(usart->udr);
+    if (usart->stats) {
+        rfs_usart_countrx(usart->stats, status);
+    }
 
     // Check for error status
-    if (status & (_BV(FE0) | _BV(DOR0) | _BV(UPE0)) == 0) {
+    if ((status & RFS_USART_ERROR_MASK) == 0) {
         // No error
         // Return 1 to indicate that there's data
         return 1;
     }
 
     // Error
-    if (status & _BV(FE0)) {
-        // Frame error
-        rfs_errno = RFS_EFRAME;
-    } else if (status & _BV(DOR0)) {
-        // Buffer overrun
-        rfs_errno = RFS_EOVERRUN;
-    } else {
-        // Parity error
-        rfs_errno = RFS_EPARITY;
-    }
+    rfs_errno = rfs_usart_geterror(status);
     // Return -1 to indicate that an error has occurred
     return -1;
 }
 
 
+int16_t
+rfs_usart_read_buf(struct rfs_usart_t *usart, char *data, uint8_t size)
+{
+    uint8_t count = 0;
+
+    if (usart->stats) {
+        rfs_usart_countpoll(usart->stats);
+    }
+    if (usart->rx_buffer) {
+        // Buffered mode. Report the errors recorded by the interrupt handler
+        const uint8_t error = rfs_usart_takeerror(usart);
+        if (error) {
+            rfs_errno = error;
+            return -1;
+        }
+        while ((count < size) && rfs_ringbuf_get(usart->rx_buffer, data + count)) {
+            count++;
+        }
+        return count;
+    }
+
+    // Keep the registers addresses in local variables, so they are loaded only once
+    volatile uint8_t *const ucsra = usart->ucsra;
+    volatile uint8_t *const udr = usart->udr;
+
+    while (count < size) {
+        // The status flags refer to the byte at the head of the reception buffer, that is not read yet
+        const uint8_t status = *ucsra;
+        if ((status & _BV(RXC0)) == 0) {
+            break;
+        }
+        if (status & RFS_USART_ERROR_MASK) {
+            if (count) {
+                // Leave the erroneous byte for the next call, so the good bytes are returned first
+                break;
+            }
+            (void)*udr;
+            if (usart->stats) {
+                rfs_usart_countrx(usart->stats, status);
+            }
+            rfs_errno = rfs_usart_geterror(status);
+            return -1;
+        }
+        data[count++] = *udr;
+    }
+    if (usart->stats) {
+        usart->stats->counters.rx_bytes += count;
+    }
+    return count;
+}
+
+
 int8_t
 rfs_usart_write(struct rfs_usart_t *usart, char data)
 {
+    if (usart->tx_buffer) {
+        // Buffered mode. Queue the byte and let the interrupt handler send it
+        if (!rfs_ringbuf_put(usart->tx_buffer, data)) {
+            return 0;
+        }
+        *(usart->ucsrb) |= _BV(UDRIE0);
+        return 1;
+    }
     if (*(usart->ucsra) & _BV(UDRE0)) {
+        // In 9-bit mode, this is a data frame. The previous frame, maybe an address, is already in the shift register
+        *(usart->ucsrb) &= ~_BV(TXB80);
         *(usart->udr) = data;
+        if (usart->stats) {
+            usart->stats->counters.tx_bytes++;
+        }
         return 1;
     }
     return 0;
 }
 
 
+uint8_t
+rfs_usart_write_buf(struct rfs_usart_t *usart, const char *data, uint8_t size)
+{
+    uint8_t count = 0;
+
+    if (usart->tx_buffer) {
+        // Buffered mode. Queue as many bytes as fit and let the interrupt handler send them
+        while ((count < size) && rfs_ringbuf_put(usart->tx_buffer, data[count])) {
+            count++;
+        }
+        if (count) {
+            *(usart->ucsrb) |= _BV(UDRIE0);
+        }
+        return count;
+    }
+
+    // Keep the registers addresses in local variables, so they are loaded only once
+    volatile uint8_t *const ucsra = usart->ucsra;
+    volatile uint8_t *const udr = usart->udr;
+
+    // In 9-bit mode, these are data frames, see rfs_usart_write
+    if ((count < size) && (*ucsra & _BV(UDRE0))) {
+        *(usart->ucsrb) &= ~_BV(TXB80);
+    }
+
+    // Write while the transmit buffer accepts data. When the transmitter is idle, the first byte goes
+    // immediately to the shift register, so up to two bytes can be written in one call
+    while ((count < size) && (*ucsra & _BV(UDRE0))) {
+        *udr = data[count++];
+    }
+    if (usart->stats) {
+        usart->stats->counters.tx_bytes += count;
+    }
+    return count;
+}
+
+
+int8_t
+rfs_usart_read9(struct rfs_usart_t *usart, uint16_t *data)
+{
+    if (usart->stats) {
+        rfs_usart_countpoll(usart->stats);
+    }
+
+    // The status and the ninth bit must be read before UDR, that pops the frame from the reception buffer
+    const uint8_t status = *(usart->ucsra);
+    if ((status & _BV(RXC0)) == 0) {
+        return 0;
+    }
+    const uint8_t high = *(usart->ucsrb) & _BV(RXB80);
+    *data = *(usart->udr);
+    if (usart->stats) {
+        rfs_usart_countrx(usart->stats, status);
+    }
+    if (status & RFS_USART_ERROR_MASK) {
+        rfs_errno = rfs_usart_geterror(status);
+        return -1;
+    }
+    if (high) {
+        *data |= RFS_USART_ADDRESS_BIT;
+    }
+    return 1;
+}
+
+
+int8_t
+rfs_usart_write9(struct rfs_usart_t *usart, uint16_t data)
+{
+    if ((*(usart->ucsra) & _BV(UDRE0)) == 0) {
+        return 0;
+    }
+    // The ninth bit must be written before UDR, that starts the transmission
+    if (data & RFS_USART_ADDRESS_BIT) {
+        *(usart->ucsrb) |= _BV(TXB80);
+    } else {
+        *(usart->ucsrb) &= ~_BV(TXB80);
+    }
+    *(usart->udr) = data;
+    if (usart->stats) {
+        usart->stats->counters.tx_bytes++;
+    }
+    return 1;
+}
+
+
+int8_t
+rfs_usart_read_addressed(struct rfs_usart_t *usart, uint8_t address, char *data)
+{
+    uint16_t frame;
+    const int8_t result = rfs_usart_read9(usart, &frame);
+
+    if (result != 1) {
+        return result;
+    }
+    if (frame & RFS_USART_ADDRESS_BIT) {
+        // Listen to the data frames only if this node is addressed
+        rfs_usart_setmultiprocessor(usart, (uint8_t)frame != address);
+        return 0;
+    }
+    *data = frame;
+    return 1;
+}
+
+
+void
+rfs_usart_setstats(struct rfs_usart_t *usart, struct rfs_usart_stats_t *stats, volatile uint16_t *clock)
+{
+    if (stats) {
+        memset(&stats->counters, 0, sizeof(stats->counters));
+        stats->clock = clock;
+        stats->last_poll = clock ? *clock : 0;
+    }
+    // The interrupt handlers use the statistics too
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        usart->stats = stats;
+    }
+}
+
+
+void
+rfs_usart_getstats(struct rfs_usart_t *usart, struct rfs_usart_counters_t *snapshot, uint8_t reset)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        *snapshot = usart->stats->counters;
+        if (reset) {
+            memset(&usart->stats->counters, 0, sizeof(usart->stats->counters));
+        }
+    }
+}
+
+
 void
 rfs_usart_close(struct rfs_usart_t *usart)
 {
     *(usart->ucsrb) = 0;
+    usart->rx_buffer = 0;
+    usart->tx_buffer = 0;
 }
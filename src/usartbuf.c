@@ -0,0 +1,110 @@
+/*
+usartbuf.c - Interrupt driven (buffered) mode of the USART module.
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+/*
+The interrupt handlers live in their own translation unit, so they are only linked in the programs that use the
+buffered mode. The programs that use the USART in polled mode don't get any interrupt handler.
+*/
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+
+#include <rfsavr/usart.h>
+#include <rfsavr/errno.h>
+
+
+///////////////////////////////////////////////// PRIVATE VARIABLES //////////////////////////////////////////////////
+
+
+/**
+ * The USART in buffered mode. Used by the interrupt handlers.
+ */
+static struct rfs_usart_t *rfs_usart0_buffered;
+
+
+///////////////////////////////////////////////// INTERRUPT HANDLERS /////////////////////////////////////////////////
+
+
+ISR(USART_RX_vect)
+{
+    // Read the reception status before the byte itself
+    const uint8_t status = UCSR0A;
+    const char data = UDR0;
+    struct rfs_usart_t *usart = rfs_usart0_buffered;
+
+    if (usart->stats) {
+        rfs_usart_countrx(usart->stats, status);
+    }
+    if (status & _BV(FE0)) {
+        usart->rx_error = RFS_EFRAME;
+    } else if (status & _BV(DOR0)) {
+        usart->rx_error = RFS_EOVERRUN;
+    } else if (status & _BV(UPE0)) {
+        usart->rx_error = RFS_EPARITY;
+    } else if (!rfs_ringbuf_put(usart->rx_buffer, data)) {
+        // The ring buffer is full, the byte is lost
+        usart->rx_error = RFS_EOVERRUN;
+        if (usart->stats) {
+            // The byte was already counted as received
+            usart->stats->counters.rx_bytes--;
+            usart->stats->counters.rx_dropped++;
+        }
+    }
+}
+
+
+ISR(USART_UDRE_vect)
+{
+    char data;
+    struct rfs_usart_t *usart = rfs_usart0_buffered;
+
+    if (rfs_ringbuf_get(usart->tx_buffer, &data)) {
+        UDR0 = data;
+        if (usart->stats) {
+            usart->stats->counters.tx_bytes++;
+        }
+    } else {
+        // Nothing else to send, disable this interrupt until a new byte is queued
+        UCSR0B &= ~_BV(UDRIE0);
+    }
+}
+
+
+///////////////////////////////////////////////// PUBLIC FUNCTIONS ///////////////////////////////////////////////////
+
+
+void
+rfs_usart_setbuffers(struct rfs_usart_t *usart, struct rfs_ringbuf_t *rx_buffer, struct rfs_ringbuf_t *tx_buffer)
+{
+    // The interrupts are disabled while the buffers change, so the handlers never see them half set
+    *(usart->ucsrb) &= ~(_BV(RXCIE0) | _BV(UDRIE0));
+    usart->rx_error = 0;
+    usart->rx_buffer = rx_buffer;
+    usart->tx_buffer = tx_buffer;
+    rfs_usart0_buffered = usart;
+    if (rx_buffer) {
+        *(usart->ucsrb) |= _BV(RXCIE0);
+    }
+    if (tx_buffer && !rfs_ringbuf_empty(tx_buffer)) {
+        *(usart->ucsrb) |= _BV(UDRIE0);
+    }
+}
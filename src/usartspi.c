@@ -0,0 +1,114 @@
+/*
+usartspi.c - Master SPI mode of the USART
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+#include <avr/io.h>
+
+#include <rfsavr/usart.h>
+
+/**
+ * Maximum number of bytes written and not yet read. With more, the two level reception buffer could overrun.
+ */
+#define RFS_USART_SPI_IN_FLIGHT 2
+
+/**
+ * Byte sent when the transfer has no data to send.
+ */
+#define RFS_USART_SPI_FILLER    0xff
+
+
+///////////////////////////////////////////////// PUBLIC FUNCTIONS ///////////////////////////////////////////////////
+
+
+uint32_t
+rfs_usart_spi_setspeed(struct rfs_usart_t *usart, uint32_t frequency, uint32_t cpu_frequency)
+{
+    uint32_t quotient = RFS_USART_UBRR_MAX + 1;
+
+    if (frequency) {
+        // Round up both divisions, so the obtained frequency is never faster than the desired one. Dividing twice
+        // instead of by 2 * frequency doesn't overflow with any frequency.
+        quotient = cpu_frequency / frequency + (cpu_frequency % frequency != 0);
+        quotient = quotient / 2 + (quotient & 1);
+    }
+    if (quotient == 0) {
+        quotient = 1;
+    } else if (quotient > RFS_USART_UBRR_MAX + 1) {
+        quotient = RFS_USART_UBRR_MAX + 1;
+    }
+    *(usart->ubrr) = quotient - 1;
+    return cpu_frequency / (2 * quotient);
+}
+
+
+void
+rfs_usart_spi_transfer_init(struct rfs_usart_spi_transfer_t *transfer, struct rfs_usart_t *usart,
+    const uint8_t *tx_data, uint8_t *rx_data, uint16_t size)
+{
+    transfer->usart = usart;
+    transfer->tx_data = tx_data;
+    transfer->rx_data = rx_data;
+    transfer->size = size;
+    transfer->written = 0;
+    transfer->read = 0;
+
+    // Drop the bytes left by a previous transfer, so they are not taken as the first ones of this one
+    while (*(usart->ucsra) & _BV(RXC0)) {
+        (void)*(usart->udr);
+    }
+}
+
+
+int8_t
+rfs_usart_spi_transfer(struct rfs_usart_spi_transfer_t *transfer)
+{
+    // Keep the registers addresses and the counters in local variables, so they are loaded only once
+    volatile uint8_t *const ucsra = transfer->usart->ucsra;
+    volatile uint8_t *const udr = transfer->usart->udr;
+    uint16_t written = transfer->written;
+    uint16_t read = transfer->read;
+    const uint16_t size = transfer->size;
+
+    while (read < size) {
+        uint8_t progress = 0;
+        if (*ucsra & _BV(RXC0)) {
+            // Read first, so there's always room in the reception buffer for the bytes in flight
+            const uint8_t data = *udr;
+            if (transfer->rx_data) {
+                transfer->rx_data[read] = data;
+            }
+            read++;
+            progress = 1;
+        }
+        // Refill the transmit buffer right after the read, so the shift register doesn't get idle
+        if ((written < size) && (written - read < RFS_USART_SPI_IN_FLIGHT) && (*ucsra & _BV(UDRE0))) {
+            *udr = transfer->tx_data ? transfer->tx_data[written] : RFS_USART_SPI_FILLER;
+            written++;
+            progress = 1;
+        }
+        if (!progress) {
+            break;
+        }
+    }
+    transfer->written = written;
+    transfer->read = read;
+    return read < size;
+}
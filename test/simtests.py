@@ -0,0 +1,119 @@
+import os
+import re
+import subprocess
+
+from autotests import skip
+
+SIMULATOR_VARIABLE = "RUN_AVR"
+SIMULATION_TIMEOUT = 60
+RESET_TIME_NS = 5000
+
+# Datasheet windows of the LED chips, in ns: (T0H min, T0H max), (T1H min, T1H max), (T0L min, T1L min). The low times
+# can be longer than nominal, as long as they are shorter than the reset time
+LEDS_TIMING = {
+    "WS2812": ((250, 550), (650, 950), (700, 300)),
+    "SK6812": ((150, 450), (450, 750), (750, 450)),
+    "WS2811": ((350, 650), (1050, 1350), (1850, 1150)),
+}
+
+# simavr colors the lines that the program writes to the console and to the UART
+ESCAPE_SEQUENCE = re.compile(r"\x1b\[[0-9;]*m")
+
+def run_program(program_file: str) -> None:
+    simulator = os.environ.get(SIMULATOR_VARIABLE, "")
+    if not simulator:
+        skip()
+    subprocess.run([simulator, program_file], check=True, timeout=SIMULATION_TIMEOUT,
+        stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+def run_program_output(program_file: str) -> list[str]:
+    """Run a program in the simulator and return the lines written to the console and to the UART.
+
+    The UART is virtual: simavr prints every line transmitted by the program, replacing the control characters, like
+    the line feed, with dots."""
+    simulator = os.environ.get(SIMULATOR_VARIABLE, "")
+    if not simulator:
+        skip()
+    result = subprocess.run([simulator, program_file], check=True, timeout=SIMULATION_TIMEOUT,
+        capture_output=True, text=True, errors="replace")
+    lines = ESCAPE_SEQUENCE.sub("", result.stdout + result.stderr).splitlines()
+    return [line.strip().rstrip(".") for line in lines]
+
+def read_vcd(vcd_file: str) -> dict[str, list[tuple[float, int]]]:
+    """Read the changes of the signals of a VCD file, as lists of (time in ns, value) for each signal name."""
+    scale = {"s": 1e9, "ms": 1e6, "us": 1e3, "ns": 1.0, "ps": 1e-3}
+    time_unit = 1.0
+    names = {}
+    changes = {}
+    time = 0.0
+    with open(vcd_file) as f:
+        tokens = f.read().split()
+    i = 0
+    while i < len(tokens):
+        token = tokens[i]
+        if token.startswith("$"):
+            # Declaration, up to the next $end
+            end = tokens.index("$end", i)
+            if token == "$timescale":
+                value = "".join(tokens[i + 1:end])
+                number = value.rstrip("munps")
+                time_unit = float(number or 1) * scale[value[len(number):]]
+            elif token == "$var":
+                # $var <type> <size> <id> <name> $end
+                names[tokens[i + 3]] = tokens[i + 4]
+                changes[tokens[i + 4]] = []
+            i = end
+        elif token.startswith("#"):
+            time = int(token[1:]) * time_unit
+        elif token[0] == "b":
+            value = token[1:].replace("x", "0").replace("z", "0")
+            changes[names[tokens[i + 1]]].append((time, int(int(value, 2) != 0)))
+            i += 1
+        elif token[0] in "01xz":
+            changes[names[token[1:]]].append((time, int(token[0] == "1")))
+        i += 1
+    return changes
+
+def pulses(changes: list[tuple[float, int]]) -> list[tuple[float, float]]:
+    """Convert the changes of a signal into a list of (high time, low time). The last low time is infinite."""
+    result = []
+    rise = None
+    fall = None
+    level = 0
+    for time, value in changes:
+        if value and not level:
+            if rise is not None:
+                result.append((fall - rise, time - fall))
+            rise = time
+        elif not value and level:
+            fall = time
+        level = value
+    if rise is not None:
+        result.append((fall - rise, float("inf")))
+    return result
+
+def check_bits(changes: list[tuple[float, int]], expected_bytes: list[int], t0h: tuple[int, int],
+        t1h: tuple[int, int], tl_min: tuple[int, int]) -> bool:
+    """Check the bits sent to a chain of LEDs against the expected bytes and the timing windows of the chip, as given
+    in LEDS_TIMING."""
+    expected_bits = [(byte >> (7 - i)) & 1 for byte in expected_bytes for i in range(8)]
+    bits = pulses(changes)
+    if len(bits) != len(expected_bits):
+        return False
+    for (high, low), bit in zip(bits, expected_bits):
+        high_min, high_max = t1h if bit else t0h
+        if not (high_min <= high <= high_max):
+            return False
+        if low != float("inf") and not (tl_min[bit] <= low < RESET_TIME_NS):
+            return False
+    return True
+
+def frequency_and_duty(changes: list[tuple[float, int]]) -> tuple[float, float]:
+    """Return the mean frequency (Hz) and duty cycle (0 to 1) of a periodic signal. The first period, that can be
+    partial when the trace starts, and the last one are discarded."""
+    periods = pulses(changes)[1:-1]
+    if not periods:
+        return 0.0, 0.0
+    high = sum(high for high, _ in periods)
+    total = sum(high + low for high, low in periods)
+    return len(periods) * 1e9 / total, high / total
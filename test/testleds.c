@@ -28,6 +28,20 @@ along with RobotsFromScratch; see the file COPYING.  If not, see
 #define LEDS_PORT   PORTB
 #define LEDS_PIN    3
 
+#ifdef SIMAVR
+// In the simulator, the LEDs pin is recorded in a VCD file, checked by testledssim.py
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <avr_mcu_section.h>
+
+AVR_MCU(F_CPU, "atmega328p");
+AVR_MCU_VCD_FILE("testledssim.vcd", 1000);
+
+const struct avr_mmcu_vcd_trace_t traces[] _MMCU_ = {
+    {AVR_MCU_VCD_SYMBOL("LEDS"), .mask = _BV(LEDS_PIN), .what = (void *)&LEDS_PORT},
+};
+#endif
+
 int main()
 {
     struct rfs_grb_t led_values[LEDS_COUNT];
@@ -40,4 +54,10 @@ int main()
         led_values[i].blue = 255;
     }
     rfs_leds_write(led_values, LEDS_COUNT, &leds_pin);
+
+#ifdef SIMAVR
+    // Sleeping with the interrupts disabled stops the simulator
+    cli();
+    sleep_cpu();
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,422 @@
+#!/usr/bin/env python
+
+"""Count the cycles of the LED writers, running their assembler on a model of the ATmega328P core.
+
+The inline assembler of each writer is read from the sources, the operands are given registers like gcc would (the
+timing doesn't depend on which ones) and the instructions are executed with their datasheet cycles. The stores to the
+port make the same traces that simavr records, so they are checked with the same windows as testledstiming.py. Only
+the assembler is run: the C code before and after it, and the interrupts, are not modeled. This runs without the
+simulator, which remains the reference for the whole programs."""
+
+import os
+import re
+
+from autotests import pass_, fail
+from simtests import check_bits, pulses, LEDS_TIMING
+from testledstiming import CHIPS, FREQUENCIES_MHZ, GRB_BYTES, GAMMA, scale, parallel_bytes
+
+SOURCE_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src")
+
+# The writers that are not timed at compile time are tuned for 16 MHz
+TUNED_MHZ = 16
+
+PORT_ADDRESS = 0x25
+LEDS_PIN = 3
+DATA_ADDRESS = 0x100
+PALETTE_ADDRESS = 0x200
+INDEXES_ADDRESS = 0x300
+GAMMA_ADDRESS = 0x1000
+IDENTITY_ADDRESS = 0x1100
+
+# Palette writers input: the palette, the index of each LED, and the spans of the same LEDs
+PALETTE = [0x00, 0xff, 0xa5, 0x3c, 0x81, 0x5a, 0x01, 0x80, 0x7e, 0xc3, 0x18, 0xe7]
+PALETTE_INDEXES = [1, 0, 3, 3, 2, 1, 1, 1, 0]
+RLE_SPANS = [(1, 1), (1, 0), (2, 3), (1, 2), (3, 1), (1, 0)]
+
+CYCLES = {"ld": 2, "st": 2, "lpm": 3, "mul": 2, "adiw": 2, "sbiw": 2, "movw": 1, "rjmp": 2}
+BRANCHES = {
+    "breq": lambda flags: flags["Z"], "brne": lambda flags: not flags["Z"],
+    "brcs": lambda flags: flags["C"], "brlo": lambda flags: flags["C"],
+    "brcc": lambda flags: not flags["C"], "brsh": lambda flags: not flags["C"],
+    "brmi": lambda flags: flags["N"], "brpl": lambda flags: not flags["N"],
+}
+TWO_WORDS = {"lds", "sts", "jmp", "call"}
+POINTERS = {"X": 26, "Y": 28, "Z": 30}
+CONSTRAINT_REGISTERS = {
+    "x": [26], "y": [28], "z": [30], "e": [26, 28, 30], "w": [24, 26, 28, 30],
+    "d": list(range(16, 32)), "r": list(range(2, 32)),
+}
+# Fixed registers first, then the classes from the smallest
+CONSTRAINT_ORDER = "xyzewdr"
+
+
+def read_asm(file_name: str) -> list[tuple[str, dict[str, str]]]:
+    """Return the instructions and the operand constraints of each asm statement of a source file."""
+    with open(os.path.join(SOURCE_DIR, file_name)) as f:
+        source = f.read().replace("\\\n", "\n")
+    statements = []
+    for match in re.finditer(r"asm volatile \(", source):
+        depth = 1
+        i = match.end()
+        strings = []
+        operands_start = None
+        while depth:
+            c = source[i]
+            if c == '"':
+                end = i + 1
+                while source[end] != '"':
+                    end += 2 if source[end] == "\\" else 1
+                if operands_start is None:
+                    strings.append(source[i + 1:end])
+                i = end
+            elif c == "(":
+                depth += 1
+            elif c == ")":
+                depth -= 1
+            elif c == ":" and depth == 1 and operands_start is None:
+                operands_start = i
+            i += 1
+        text = "".join(strings)
+        text = text.replace("\\\\", "\0").replace("\\n", "\n").replace("\\t", "\t").replace("\0", "\\")
+        operands = source[operands_start:i]
+        constraints = {name: constraint.strip("=+&") for name, constraint in
+            re.findall(r'\[(\w+)\]\s*"([^"]*)"', operands)}
+        statements.append((text, constraints))
+    return statements
+
+
+def expand(lines: list[str]) -> list[str]:
+    """Expand the .rept and .irp directives of the assembler."""
+    result = []
+    i = 0
+    while i < len(lines):
+        line = lines[i]
+        directive = line.split()[0] if line else ""
+        if directive not in (".rept", ".irp"):
+            result.append(line)
+            i += 1
+            continue
+        depth = 1
+        end = i
+        while depth:
+            end += 1
+            word = lines[end].split()[0] if lines[end] else ""
+            depth += word in (".rept", ".irp")
+            depth -= word == ".endr"
+        body = lines[i + 1:end]
+        if directive == ".rept":
+            result += expand(body) * int(line.split()[1], 0)
+        else:
+            symbol, *values = [word.strip() for word in line.split(None, 1)[1].split(",")]
+            for value in values:
+                result += expand([body_line.replace("\\" + symbol, value) for body_line in body])
+        i = end + 1
+    return result
+
+
+class Core:
+    """The registers, memories and cycle counter of the CPU, and the port changes."""
+
+    def __init__(self) -> None:
+        self.registers = [0] * 32
+        self.ram = bytearray(0x900)
+        self.flash = bytearray(0x8000)
+        self.flags = {"Z": False, "C": False, "N": False}
+        self.cycles = 0
+        self.stores = []
+
+    def word(self, register: int) -> int:
+        return self.registers[register] | self.registers[register + 1] << 8
+
+    def set_word(self, register: int, value: int) -> None:
+        self.registers[register] = value & 0xff
+        self.registers[register + 1] = value >> 8 & 0xff
+
+    def result(self, value: int, carry: bool | None = None, keep_zero: bool = False) -> int:
+        value &= 0xff
+        self.flags["Z"] = (value == 0) and (self.flags["Z"] or not keep_zero)
+        self.flags["N"] = bool(value & 0x80)
+        if carry is not None:
+            self.flags["C"] = carry
+        return value
+
+
+def register(operand: str) -> int:
+    return int(operand[1:])
+
+
+def pointer(operand: str) -> tuple[int, bool]:
+    return POINTERS[operand.rstrip("+")], operand.endswith("+")
+
+
+def run(text: str, constraints: dict[str, str], inputs: dict[str, int], core: Core) -> None:
+    """Run an asm statement, with the given values of its operands, until it ends."""
+    wide = {name for name, constraint in constraints.items() if constraint in "wexyz"}
+    wide.update(re.findall(r"%[aAB]\[(\w+)\]", text))
+    for names in re.findall(r"(?:movw|adiw|sbiw)\s+%\[(\w+)\](?:\s*,\s*%\[(\w+)\])?", text):
+        wide.update(name for name in names if name)
+    # Registers, like gcc would allocate them
+    used = {0, 1}
+    registers = {}
+    for name, constraint in sorted(constraints.items(), key=lambda item: CONSTRAINT_ORDER.find(item[1])):
+        if constraint == "n":
+            continue
+        size = 2 if name in wide else 1
+        candidates = [r for r in CONSTRAINT_REGISTERS[constraint] if size == 1 or r % 2 == 0]
+        first = next(r for r in candidates if r not in used and r + size - 1 not in used)
+        used.update(range(first, first + size))
+        registers[name] = first
+        if name in inputs:
+            if size == 2:
+                core.set_word(first, inputs[name])
+            else:
+                core.registers[first] = inputs[name]
+
+    def operand(match: re.Match) -> str:
+        modifier, name = match.groups()
+        if name not in registers:
+            return str(inputs[name])
+        if modifier == "a":
+            return next(letter for letter, r in POINTERS.items() if r == registers[name])
+        return f"r{registers[name] + (modifier == 'B')}"
+
+    text = re.sub(r"%([aAB]?)\[(\w+)\]", operand, text).replace("%=", "")
+    text = text.replace("__tmp_reg__", "r0").replace("__zero_reg__", "r1")
+    program = []
+    labels = {}
+    for line in expand([line.strip() for line in text.splitlines()]):
+        if line.endswith(":"):
+            labels[line[:-1]] = len(program)
+        elif line:
+            mnemonic, _, arguments = line.partition(" ")
+            program.append((mnemonic, [argument.strip() for argument in arguments.split(",") if argument.strip()]))
+
+    r = core.registers
+    pc = 0
+    while pc < len(program):
+        mnemonic, args = program[pc]
+        pc += 1
+        core.cycles += CYCLES.get(mnemonic, 1)
+        a = register(args[0]) if args and re.fullmatch(r"r\d+", args[0]) else None
+        b = args[1] if len(args) > 1 else None
+        if mnemonic == "nop":
+            pass
+        elif mnemonic == "rjmp":
+            pc = pc if args[0] == ".+0" else labels[args[0]]
+        elif mnemonic in BRANCHES:
+            if BRANCHES[mnemonic](core.flags):
+                core.cycles += 1
+                pc = labels[args[0]]
+        elif mnemonic in ("sbrc", "sbrs", "cpse"):
+            if mnemonic == "cpse":
+                skip = r[a] == r[register(b)]
+            else:
+                skip = bool(r[a] >> int(b, 0) & 1) == (mnemonic == "sbrs")
+            if skip:
+                core.cycles += 2 if program[pc][0] in TWO_WORDS else 1
+                pc += 1
+        elif mnemonic == "st":
+            address, increment = pointer(args[0])
+            core.ram[core.word(address)] = r[register(b)]
+            if core.word(address) == PORT_ADDRESS:
+                core.stores.append((core.cycles, r[register(b)]))
+            if increment:
+                core.set_word(address, core.word(address) + 1)
+        elif mnemonic in ("ld", "lpm"):
+            address, increment = pointer(b)
+            r[a] = (core.ram if mnemonic == "ld" else core.flash)[core.word(address)]
+            if increment:
+                core.set_word(address, core.word(address) + 1)
+        elif mnemonic == "mov":
+            r[a] = r[register(b)]
+        elif mnemonic == "movw":
+            core.set_word(a, core.word(register(b)))
+        elif mnemonic == "ldi":
+            r[a] = int(b, 0) & 0xff
+        elif mnemonic in ("adiw", "sbiw"):
+            value = core.word(a) + (int(b, 0) if mnemonic == "adiw" else -int(b, 0))
+            core.set_word(a, value)
+            core.flags["Z"] = value & 0xffff == 0
+            core.flags["C"] = not 0 <= value <= 0xffff
+        elif mnemonic == "mul":
+            value = r[a] * r[register(b)]
+            core.set_word(0, value)
+            core.flags["Z"] = value == 0
+            core.flags["C"] = bool(value & 0x8000)
+        elif mnemonic in ("add", "adc", "lsl", "rol"):
+            other = r[a] if mnemonic in ("lsl", "rol") else r[register(b)]
+            value = r[a] + other + (core.flags["C"] if mnemonic in ("adc", "rol") else 0)
+            r[a] = core.result(value, value > 0xff)
+        elif mnemonic in ("sub", "sbc", "subi", "sbci", "cp", "cpc", "cpi"):
+            other = int(b, 0) if mnemonic in ("subi", "sbci", "cpi") else r[register(b)]
+            borrow = core.flags["C"] if mnemonic in ("sbc", "sbci", "cpc") else 0
+            value = r[a] - (other & 0xff) - borrow
+            value = core.result(value, value < 0, keep_zero=bool(mnemonic in ("sbc", "sbci", "cpc")))
+            if not mnemonic.startswith("cp"):
+                r[a] = value
+        elif mnemonic in ("and", "andi", "or", "ori", "eor"):
+            other = int(b, 0) if mnemonic.endswith("i") else r[register(b)]
+            operation = mnemonic.rstrip("i")
+            value = r[a] & other if operation == "and" else r[a] | other if operation == "or" else r[a] ^ other
+            r[a] = core.result(value)
+        elif mnemonic == "clr":
+            r[a] = core.result(0)
+        elif mnemonic in ("lsr", "ror"):
+            value = r[a] >> 1 | (core.flags["C"] << 7 if mnemonic == "ror" else 0)
+            r[a] = core.result(value, bool(r[a] & 1))
+        elif mnemonic in ("inc", "dec"):
+            r[a] = core.result(r[a] + (1 if mnemonic == "inc" else -1))
+        elif mnemonic == "com":
+            r[a] = core.result(~r[a], True)
+        elif mnemonic == "tst":
+            core.result(r[a])
+        elif mnemonic == "swap":
+            r[a] = (r[a] << 4 | r[a] >> 4) & 0xff
+        else:
+            raise ValueError(f"instruction not modeled: {mnemonic}")
+
+
+def changes(core: Core, pin: int, frequency: int) -> list[tuple[float, int]]:
+    """Return the changes of a pin, as lists of (time in ns, value), from the stores to the port."""
+    result = []
+    level = 0
+    for cycles, value in core.stores:
+        if (value >> pin & 1) != level:
+            level ^= 1
+            result.append((cycles * 1000 / frequency, level))
+    return result
+
+
+def bit_times(pin_changes: list[tuple[float, int]], expected_bytes: list[int]) -> str:
+    """Describe the range of the high and low times of the 0 and the 1 bits."""
+    expected_bits = [(byte >> (7 - i)) & 1 for byte in expected_bytes for i in range(8)]
+    times = {key: [] for key in ("T0H", "T1H", "T0L", "T1L")}
+    for (high, low), bit in zip(pulses(pin_changes), expected_bits):
+        times[f"T{bit}H"].append(high)
+        if low != float("inf"):
+            times[f"T{bit}L"].append(low)
+    return " ".join(f"{key} {min(values):.0f}-{max(values):.0f}" for key, values in times.items() if values)
+
+
+def check(name: str, core: Core, frequency: int, chip: str, pins: dict[int, list[int]]) -> bool:
+    success = True
+    for pin, expected_bytes in pins.items():
+        pin_changes = changes(core, pin, frequency)
+        result = check_bits(pin_changes, expected_bytes, *LEDS_TIMING[chip])
+        success = success and result
+        print(f"{name} {chip} {frequency} MHz pin {pin}: {bit_times(pin_changes, expected_bytes)} ns: "
+            f"{'ok' if result else 'FAIL'}")
+    return success
+
+
+def load(core: Core, address: int, values: list[int]) -> None:
+    core.ram[address:address + len(values)] = bytes(values)
+
+
+def port_inputs(mask: int) -> dict[str, int]:
+    return {"port": PORT_ADDRESS, "high": mask, "low": 0}
+
+
+def timed_nops(frequency: int, t0h_ns: int, t1h_ns: int, period_ns: int) -> dict[str, int]:
+    """Compute the nops of RFS_LEDS_WRITE_TIMED, like the RFS_LEDS_*_NOPS macros."""
+    def cycles(ns: int) -> int:
+        return (frequency * 1000 * ns + 500000) // 1000000
+
+    t0h = max(cycles(t0h_ns) - 2, 0)
+    t1h = max(cycles(t1h_ns) - cycles(t0h_ns) - 2, 0)
+    low = max(cycles(period_ns) - t0h - t1h - 9, 0)
+    return {"t0h_nops": t0h, "t1h_nops": t1h, "low_nops": low, "last_nops": max(low - 7, 0)}
+
+
+def read_timing(chip: str) -> tuple[int, int, int]:
+    with open(os.path.join(SOURCE_DIR, "rfsavr", "leds.h")) as f:
+        header = f.read()
+    return tuple(int(re.search(rf"#define RFS_LEDS_{chip}_{part}_NS\s+(\d+)", header).group(1))
+        for part in ("T0H", "T1H", "PERIOD"))
+
+
+def read_gamma() -> list[int]:
+    with open(os.path.join(SOURCE_DIR, "ledsgamma.c")) as f:
+        source = f.read()
+    table = source[source.index("RFS_LEDS_GAMMA[256]"):]
+    return [int(value) for value in re.findall(r"\d+", table[table.index("{"):table.index("}")])]
+
+
+def main() -> None:
+    success = True
+    write, write_parallel = read_asm("leds.c")
+    (write_scaled,) = read_asm("ledsgamma.c")
+    write_palette, write_palette4, write_rle = read_asm("ledspalette.c")
+    (write_timed,) = read_asm(os.path.join("rfsavr", "leds.h"))
+
+    core = Core()
+    load(core, DATA_ADDRESS, GRB_BYTES)
+    run(*write, {"color": GRB_BYTES[0], "mask": 0x80, "count": len(GRB_BYTES), "ptr": DATA_ADDRESS + 1,
+        **port_inputs(1 << LEDS_PIN)}, core)
+    success &= check("rfs_leds_write", core, TUNED_MHZ, "WS2812", {LEDS_PIN: GRB_BYTES})
+
+    for pins in ([0, 1, 2, 3, 4, 5, 6, 7], [1, 4, 6]):
+        core = Core()
+        strip_size = len(parallel_bytes(0))
+        for strip in range(len(pins)):
+            load(core, DATA_ADDRESS + strip * strip_size, parallel_bytes(strip))
+        mask = sum(1 << pin for pin in pins)
+        run(*write_parallel, {"count": strip_size, "ptr": DATA_ADDRESS, "mask": mask, "stride": strip_size,
+            "back": len(pins) * strip_size - 1, **port_inputs(mask)}, core)
+        success &= check("rfs_leds_write_parallel", core, TUNED_MHZ, "WS2812",
+            {pin: parallel_bytes(strip) for strip, pin in enumerate(pins)})
+
+    gamma = read_gamma()
+    for brightness, table, values in ((100, IDENTITY_ADDRESS, list(range(256))), (200, GAMMA_ADDRESS, GAMMA),
+            (0, IDENTITY_ADDRESS, list(range(256)))):
+        core = Core()
+        load(core, DATA_ADDRESS, GRB_BYTES)
+        core.flash[GAMMA_ADDRESS:GAMMA_ADDRESS + 256] = bytes(gamma)
+        core.flash[IDENTITY_ADDRESS:IDENTITY_ADDRESS + 256] = bytes(range(256))
+        run(*write_scaled, {"count": len(GRB_BYTES), "ptr": DATA_ADDRESS, "bright": brightness, "table": table,
+            **port_inputs(1 << LEDS_PIN)}, core)
+        success &= check(f"rfs_leds_write_scaled {brightness}", core, TUNED_MHZ, "WS2812",
+            {LEDS_PIN: [values[scale(byte, brightness)] for byte in GRB_BYTES]})
+
+    palette_bytes = [byte for index in PALETTE_INDEXES for byte in PALETTE[index * 3:index * 3 + 3]]
+    core = Core()
+    load(core, PALETTE_ADDRESS, PALETTE)
+    load(core, INDEXES_ADDRESS, PALETTE_INDEXES)
+    run(*write_palette, {"position": 4, "count": len(palette_bytes), "palette": PALETTE_ADDRESS,
+        "entry": PALETTE_ADDRESS + PALETTE_INDEXES[0] * 3, "index": INDEXES_ADDRESS + 1,
+        **port_inputs(1 << LEDS_PIN)}, core)
+    success &= check("rfs_leds_write_palette", core, TUNED_MHZ, "WS2812", {LEDS_PIN: palette_bytes})
+
+    core = Core()
+    load(core, PALETTE_ADDRESS, PALETTE)
+    nibbles = PALETTE_INDEXES + [0] * (len(PALETTE_INDEXES) % 2)
+    load(core, INDEXES_ADDRESS, [high << 4 | low for high, low in zip(nibbles[::2], nibbles[1::2])])
+    run(*write_palette4, {"position": 4, "nibble": 1, "count": len(palette_bytes), "palette": PALETTE_ADDRESS,
+        "entry": PALETTE_ADDRESS + PALETTE_INDEXES[0] * 3, "index": INDEXES_ADDRESS,
+        **port_inputs(1 << LEDS_PIN)}, core)
+    success &= check("rfs_leds_write_palette4", core, TUNED_MHZ, "WS2812", {LEDS_PIN: palette_bytes})
+
+    rle_bytes = [byte for count, index in RLE_SPANS for _ in range(count) for byte in PALETTE[index * 3:index * 3 + 3]]
+    core = Core()
+    load(core, PALETTE_ADDRESS, PALETTE)
+    load(core, INDEXES_ADDRESS, [value for span in RLE_SPANS for value in span])
+    run(*write_rle, {"position": 4, "run": RLE_SPANS[0][0] - 1, "count": len(rle_bytes), "palette": PALETTE_ADDRESS,
+        "entry": PALETTE_ADDRESS + RLE_SPANS[0][1] * 3, "index": INDEXES_ADDRESS,
+        **port_inputs(1 << LEDS_PIN)}, core)
+    success &= check("rfs_leds_write_rle", core, TUNED_MHZ, "WS2812", {LEDS_PIN: rle_bytes})
+
+    for frequency in FREQUENCIES_MHZ:
+        for chip, expected_bytes in CHIPS.items():
+            core = Core()
+            load(core, DATA_ADDRESS, expected_bytes)
+            run(*write_timed, {"count": len(expected_bytes), "ptr": DATA_ADDRESS, **port_inputs(1 << LEDS_PIN),
+                **timed_nops(frequency, *read_timing(chip))}, core)
+            success &= check("RFS_LEDS_WRITE_TIMED", core, frequency, chip, {LEDS_PIN: expected_bytes})
+
+    if not success:
+        fail()
+    pass_()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,77 @@
+/*
+testledsgamma.c - Test the timing and the scaling of the LEDs written with brightness in the simulator
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+/*
+This program is run in simavr, that records the LED pins in a VCD file. rfs_leds_write_scaled is tuned for 16 MHz, so
+the program is always built for that frequency.
+*/
+
+#include "rfsavr/leds.h"
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
+#include <avr_mcu_section.h>
+
+#define LEDS_COUNT  2
+#define LEDS_PORT   PORTB
+#define LEDS_DDR    DDRB
+#define SCALED_PIN  0
+#define GAMMA_PIN   1
+#define DARK_PIN    2
+
+#define ROW(x)      x, x + 1, x + 2, x + 3, x + 4, x + 5, x + 6, x + 7, \
+                    x + 8, x + 9, x + 10, x + 11, x + 12, x + 13, x + 14, x + 15
+
+AVR_MCU(F_CPU, "atmega328p");
+AVR_MCU_VCD_FILE("testledsgamma.vcd", 1000);
+
+const struct avr_mmcu_vcd_trace_t traces[] _MMCU_ = {
+    {AVR_MCU_VCD_SYMBOL("SCALED"), .mask = _BV(SCALED_PIN), .what = (void *)&LEDS_PORT},
+    {AVR_MCU_VCD_SYMBOL("GAMMA"), .mask = _BV(GAMMA_PIN), .what = (void *)&LEDS_PORT},
+    {AVR_MCU_VCD_SYMBOL("DARK"), .mask = _BV(DARK_PIN), .what = (void *)&LEDS_PORT},
+};
+
+// With this table only the brightness is applied
+const uint8_t IDENTITY[256] PROGMEM = {
+    ROW(0x00), ROW(0x10), ROW(0x20), ROW(0x30), ROW(0x40), ROW(0x50), ROW(0x60), ROW(0x70),
+    ROW(0x80), ROW(0x90), ROW(0xa0), ROW(0xb0), ROW(0xc0), ROW(0xd0), ROW(0xe0), ROW(0xf0),
+};
+
+int main()
+{
+    // The bytes and the brightness of each pin are checked by testledstiming.py
+    struct rfs_grb_t grb_values[LEDS_COUNT] = {{0x00, 0xff, 0xa5}, {0x3c, 0x81, 0x5a}};
+    struct rfs_pin_t scaled_pin = {.port = &LEDS_PORT, .pin = SCALED_PIN};
+    struct rfs_pin_t gamma_pin = {.port = &LEDS_PORT, .pin = GAMMA_PIN};
+    struct rfs_pin_t dark_pin = {.port = &LEDS_PORT, .pin = DARK_PIN};
+
+    LEDS_DDR |= _BV(SCALED_PIN) | _BV(GAMMA_PIN) | _BV(DARK_PIN);
+    cli();
+    rfs_leds_write_scaled(grb_values, LEDS_COUNT, &scaled_pin, 100, IDENTITY);
+    rfs_leds_write_scaled(grb_values, LEDS_COUNT, &gamma_pin, 200, RFS_LEDS_GAMMA);
+    rfs_leds_write_scaled(grb_values, LEDS_COUNT, &dark_pin, 0, IDENTITY);
+
+    // Sleeping with the interrupts disabled stops the simulator
+    sleep_cpu();
+}
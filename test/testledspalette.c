@@ -0,0 +1,44 @@
+/*
+testledspalette.c - Test the WS2812B LEDs written from palette indexes
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+#include "rfsavr/leds.h"
+
+#include <avr/io.h>
+#include <util/delay.h>
+
+#define LEDS_COUNT  12
+#define LEDS_PORT   PORTB
+#define LEDS_PIN    3
+
+int main()
+{
+    const struct rfs_grb_t palette[] = {{.green = 255}, {.red = 255}, {.blue = 255}};
+    // Two LEDs per byte, alternating the three colors
+    const uint8_t led_indexes[LEDS_COUNT / 2] = {0x01, 0x20, 0x12, 0x01, 0x20, 0x12};
+    const struct rfs_leds_span_t led_spans[] = {{.count = 4, .index = 0}, {.count = 8, .index = 2}};
+    struct rfs_pin_t leds_pin = {.port = &LEDS_PORT, .pin = LEDS_PIN};
+    rfs_pin_set_output(&leds_pin);
+
+    rfs_leds_write_palette4(led_indexes, LEDS_COUNT, palette, &leds_pin);
+    _delay_ms(1000);
+    rfs_leds_write_rle(led_spans, LEDS_COUNT, palette, &leds_pin);
+}
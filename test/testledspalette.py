@@ -0,0 +1,14 @@
+#!/usr/bin/env python
+
+from autotests import pass_
+from avrtests import load_program
+
+LEDS_PROGRAM = "testledspalette.hex"
+SLEEP_TIME = 2
+
+def main():
+    load_program(LEDS_PROGRAM)
+    pass_()
+
+if __name__ == "__main__":
+    main()
\ No newline at end of file
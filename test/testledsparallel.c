@@ -0,0 +1,48 @@
+/*
+testledsparallel.c - Test the WS2812B LEDs written to several strips in parallel
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+#include "rfsavr/leds.h"
+
+#include <avr/io.h>
+
+#define LEDS_COUNT  12
+#define LEDS_PORT   PORTB
+#define LEDS_DDR    DDRB
+#define LEDS_PINS   0x0f
+#define LEDS_STRIPS 4
+
+int main()
+{
+    struct rfs_grb_t led_values[LEDS_STRIPS * LEDS_COUNT];
+
+    LEDS_DDR |= LEDS_PINS;
+    // Each strip gets a different color
+    for (uint8_t strip = 0; strip < LEDS_STRIPS; strip++) {
+        for (uint8_t i = 0; i < LEDS_COUNT; i++) {
+            struct rfs_grb_t *led = led_values + strip * LEDS_COUNT + i;
+            led->green = (strip & 1) ? 255 : 0;
+            led->red = (strip & 2) ? 255 : 0;
+            led->blue = (strip & 4) ? 255 : 0;
+        }
+    }
+    rfs_leds_write_parallel(led_values, LEDS_COUNT, &LEDS_PORT, LEDS_PINS);
+}
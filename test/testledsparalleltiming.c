@@ -0,0 +1,80 @@
+/*
+testledsparalleltiming.c - Test the timing of the LEDs written to several strips at the same time in the simulator
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+/*
+This program is run in simavr, that records the LED pins in a VCD file. rfs_leds_write_parallel is tuned for 16 MHz, so
+the program is always built for that frequency. The last bit of each byte is longer at low level, while the next bytes
+are loaded, and more with more strips, so 8 strips are written to PORTB, and 3 strips to some pins of PORTD.
+*/
+
+#include "rfsavr/leds.h"
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/sleep.h>
+#include <avr_mcu_section.h>
+
+#define LEDS_COUNT      2
+#define STRIPS_COUNT    8
+#define SPARSE_PINS     (_BV(1) | _BV(4) | _BV(6))
+#define SPARSE_STRIPS   3
+
+#define STRIP_TRACE(name, port, pin) {AVR_MCU_VCD_SYMBOL(name), .mask = _BV(pin), .what = (void *)&port}
+
+AVR_MCU(F_CPU, "atmega328p");
+AVR_MCU_VCD_FILE("testledsparalleltiming.vcd", 1000);
+
+const struct avr_mmcu_vcd_trace_t traces[] _MMCU_ = {
+    STRIP_TRACE("STRIP0", PORTB, 0),
+    STRIP_TRACE("STRIP1", PORTB, 1),
+    STRIP_TRACE("STRIP2", PORTB, 2),
+    STRIP_TRACE("STRIP3", PORTB, 3),
+    STRIP_TRACE("STRIP4", PORTB, 4),
+    STRIP_TRACE("STRIP5", PORTB, 5),
+    STRIP_TRACE("STRIP6", PORTB, 6),
+    STRIP_TRACE("STRIP7", PORTB, 7),
+    STRIP_TRACE("SPARSE1", PORTD, 1),
+    STRIP_TRACE("SPARSE4", PORTD, 4),
+    STRIP_TRACE("SPARSE6", PORTD, 6),
+};
+
+uint8_t leds_bytes[STRIPS_COUNT][LEDS_COUNT * 3];
+
+int main()
+{
+    // Every strip gets different bytes, checked by testledstiming.py
+    for (uint8_t strip = 0; strip < STRIPS_COUNT; strip++) {
+        for (uint8_t i = 0; i < LEDS_COUNT * 3; i++) {
+            leds_bytes[strip][i] = strip * 37 + i * 101;
+        }
+    }
+
+    DDRB = 0xff;
+    DDRD |= SPARSE_PINS;
+    cli();
+    rfs_leds_write_parallel((const struct rfs_grb_t *)leds_bytes, LEDS_COUNT, &PORTB, 0xff);
+    // The first strips of the buffer go to the pins of the mask, from the lowest one
+    rfs_leds_write_parallel((const struct rfs_grb_t *)leds_bytes, LEDS_COUNT, &PORTD, SPARSE_PINS);
+
+    // Sleeping with the interrupts disabled stops the simulator
+    sleep_cpu();
+}
@@ -0,0 +1,21 @@
+#!/usr/bin/env python
+
+from autotests import pass_, fail
+from simtests import run_program, read_vcd, check_bits, LEDS_TIMING
+
+LEDS_PROGRAM = "testledssim.bin"
+VCD_FILE = "testledssim.vcd"
+LEDS_COUNT = 12
+
+# testleds.c sets all the LEDs blue
+GRB_BYTES = [0x00, 0x00, 0xff] * LEDS_COUNT
+
+def main() -> None:
+    run_program(LEDS_PROGRAM)
+    traces = read_vcd(VCD_FILE)
+    if not check_bits(traces["LEDS"], GRB_BYTES, *LEDS_TIMING["WS2812"]):
+        fail()
+    pass_()
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,45 @@
+/*
+testledsspi.c - Test the WS2812B LEDs driven by the USART in Master SPI mode
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+#include "rfsavr/leds.h"
+
+#include <avr/io.h>
+
+#define LEDS_COUNT  12
+
+int main()
+{
+    struct rfs_grb_t led_values[LEDS_COUNT];
+    struct rfs_usart_t usart;
+    struct rfs_leds_spi_t leds;
+
+    if (rfs_leds_spi_open(&usart, F_CPU) < 0) {
+        return 1;
+    }
+    for (uint8_t i = 0; i < LEDS_COUNT; i++) {
+        led_values[i].green = 0;
+        led_values[i].red = 255;
+        led_values[i].blue = 0;
+    }
+    rfs_leds_spi_write_init(&leds, &usart, led_values, LEDS_COUNT);
+    while (rfs_leds_spi_write(&leds));
+}
@@ -0,0 +1,71 @@
+/*
+testledstiming.c - Test the timing of the LED writers in the simulator
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+/*
+This program is run in simavr, that records the LED pins in a VCD file. The file name, the CPU frequency and the traced
+pins are given to the simulator in the .mmcu section of the program.
+*/
+
+#include "rfsavr/leds.h"
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/sleep.h>
+#include <avr_mcu_section.h>
+
+#define STR(x)      #x
+#define XSTR(x)     STR(x)
+
+#define LEDS_COUNT  2
+#define LEDS_PORT   PORTB
+#define LEDS_DDR    DDRB
+#define WS2812_PIN  0
+#define SK6812_PIN  1
+#define WS2811_PIN  2
+
+AVR_MCU(F_CPU, "atmega328p");
+AVR_MCU_VCD_FILE("testledstiming" XSTR(TIMING_MHZ) ".vcd", 1000);
+
+const struct avr_mmcu_vcd_trace_t traces[] _MMCU_ = {
+    {AVR_MCU_VCD_SYMBOL("WS2812"), .mask = _BV(WS2812_PIN), .what = (void *)&LEDS_PORT},
+    {AVR_MCU_VCD_SYMBOL("SK6812"), .mask = _BV(SK6812_PIN), .what = (void *)&LEDS_PORT},
+    {AVR_MCU_VCD_SYMBOL("WS2811"), .mask = _BV(WS2811_PIN), .what = (void *)&LEDS_PORT},
+};
+
+int main()
+{
+    // The same bytes are sent to all the LEDs, and checked by testledstiming.py
+    struct rfs_grb_t grb_values[LEDS_COUNT] = {{0x00, 0xff, 0xa5}, {0x3c, 0x81, 0x5a}};
+    struct rfs_grbw_t grbw_values[LEDS_COUNT] = {{0x00, 0xff, 0xa5, 0x3c}, {0x81, 0x5a, 0x00, 0xff}};
+    struct rfs_pin_t ws2812_pin = {.port = &LEDS_PORT, .pin = WS2812_PIN};
+    struct rfs_pin_t sk6812_pin = {.port = &LEDS_PORT, .pin = SK6812_PIN};
+    struct rfs_pin_t ws2811_pin = {.port = &LEDS_PORT, .pin = WS2811_PIN};
+
+    LEDS_DDR |= _BV(WS2812_PIN) | _BV(SK6812_PIN) | _BV(WS2811_PIN);
+    cli();
+    rfs_leds_write_ws2812(grb_values, LEDS_COUNT, &ws2812_pin);
+    rfs_leds_write_sk6812(grbw_values, LEDS_COUNT, &sk6812_pin);
+    rfs_leds_write_ws2811(grb_values, LEDS_COUNT, &ws2811_pin);
+
+    // Sleeping with the interrupts disabled stops the simulator
+    sleep_cpu();
+}
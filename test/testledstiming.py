@@ -0,0 +1,61 @@
+#!/usr/bin/env python
+
+from autotests import pass_, fail
+from simtests import run_program, read_vcd, check_bits, LEDS_TIMING
+
+FREQUENCIES_MHZ = [8, 12, 16, 20]
+
+# Bytes sent by testledstiming.c to each chip
+GRB_BYTES = [0x00, 0xff, 0xa5, 0x3c, 0x81, 0x5a]
+GRBW_BYTES = [0x00, 0xff, 0xa5, 0x3c, 0x81, 0x5a, 0x00, 0xff]
+
+CHIPS = {
+    "WS2812": GRB_BYTES,
+    "SK6812": GRBW_BYTES,
+    "WS2811": GRB_BYTES,
+}
+
+# Gamma 2.8, like RFS_LEDS_GAMMA
+GAMMA = [int((i / 255) ** 2.8 * 255 + 0.5) for i in range(256)]
+
+def scale(value: int, brightness: int) -> int:
+    return value * (brightness + 1) >> 8
+
+# Bytes sent by testledsgamma.c to each pin, at 16 MHz with the WS2812 timing
+SCALED_BYTES = {
+    "SCALED": [scale(byte, 100) for byte in GRB_BYTES],
+    "GAMMA": [GAMMA[scale(byte, 200)] for byte in GRB_BYTES],
+    "DARK": [0] * len(GRB_BYTES),
+}
+
+# Bytes sent by testledsparalleltiming.c to each strip, at 16 MHz with the WS2812 timing. The last bit of each byte
+# is longer at low level, and has to stay below the reset time
+PARALLEL_LEDS_COUNT = 2
+
+def parallel_bytes(strip: int) -> list[int]:
+    return [(strip * 37 + i * 101) & 0xff for i in range(PARALLEL_LEDS_COUNT * 3)]
+
+PARALLEL_BYTES = {f"STRIP{strip}": parallel_bytes(strip) for strip in range(8)}
+PARALLEL_BYTES.update({f"SPARSE{pin}": parallel_bytes(strip) for strip, pin in enumerate([1, 4, 6])})
+
+def main() -> None:
+    for frequency in FREQUENCIES_MHZ:
+        run_program(f"testledstiming{frequency}.bin")
+        traces = read_vcd(f"testledstiming{frequency}.vcd")
+        for chip, expected_bytes in CHIPS.items():
+            if not check_bits(traces[chip], expected_bytes, *LEDS_TIMING[chip]):
+                fail()
+    run_program("testledsgamma.bin")
+    traces = read_vcd("testledsgamma.vcd")
+    for pin, expected_bytes in SCALED_BYTES.items():
+        if not check_bits(traces[pin], expected_bytes, *LEDS_TIMING["WS2812"]):
+            fail()
+    run_program("testledsparalleltiming.bin")
+    traces = read_vcd("testledsparalleltiming.vcd")
+    for pin, expected_bytes in PARALLEL_BYTES.items():
+        if not check_bits(traces[pin], expected_bytes, *LEDS_TIMING["WS2812"]):
+            fail()
+    pass_()
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,47 @@
+/*
+testmessage.c - Test program for the message subsystem.
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+#include "rfsavr/message.h"
+#include "rfsavr/usart.h"
+
+#define BUFFER_SIZE 64
+
+int
+main()
+{
+    struct rfs_usart_t usart;
+    struct rfs_message_rx_t rx;
+    struct rfs_message_t tx;
+    char buffer[BUFFER_SIZE];
+
+    rfs_usart_open(&usart, RFS_USART_0, RFS_USART_ASYNC, RFS_USART_RXTX | RFS_USART_8BITS);
+    rfs_usart_setspeed(&usart, RFS_USART_B19200, F_CPU);
+    rfs_message_recv_init(&rx, &usart, buffer, BUFFER_SIZE);
+
+    // Send back every valid message received
+    while (1) {
+        if (rfs_message_recv(&rx)) {
+            rfs_message_init(&tx, &usart, buffer, rx.size);
+            while (rfs_message_send(&tx));
+        }
+    }
+}
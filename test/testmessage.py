@@ -0,0 +1,34 @@
+#!/usr/bin/env python
+
+from autotests import pass_, fail
+from avrtests import load_program, DEVICE
+from serial import Serial
+from time import sleep
+
+MESSAGE_PROGRAM = "testmessage.hex"
+COMM_BAUDS = 19200
+SLEEP_TIME = 2
+
+def make_message(payload: bytes) -> bytes:
+    checksum = (-sum(payload)) & 0xff
+    return b":" + payload + f"{checksum:02x}".encode("ascii") + b"\n"
+
+def test_message() -> None:
+    s = Serial(DEVICE, COMM_BAUDS, timeout=1)
+    # This sleep is important because the Arduino gets reset when the Serial connection is made
+    sleep(SLEEP_TIME)
+    # A message with a wrong checksum must be discarded, and the next one received
+    message = make_message(b"hello, world!")
+    s.write(b":hello00\n" + message)
+    received_message = s.readline()
+    if (received_message == message):
+        pass_()
+    else:
+        fail()
+
+def main() -> None:
+    load_program(MESSAGE_PROGRAM)
+    test_message()
+
+if __name__ == "__main__":
+    main()
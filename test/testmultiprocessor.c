@@ -0,0 +1,43 @@
+/*
+testmultiprocessor.c - Test the USART multi-processor communication mode
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+#include "rfsavr/usart.h"
+
+#define NODE_ADDRESS    0x05
+
+int
+main()
+{
+    struct rfs_usart_t usart;
+    char c;
+
+    rfs_usart_open(&usart, RFS_USART_0, RFS_USART_ASYNC,
+        RFS_USART_RXTX | RFS_USART_9BITS | RFS_USART_MULTIPROCESSOR);
+    rfs_usart_setspeed(&usart, RFS_USART_B19200, F_CPU);
+
+    // Echo the data bytes addressed to this node, as 8-bit data frames
+    while (1) {
+        if (rfs_usart_read_addressed(&usart, NODE_ADDRESS, &c) == 1) {
+            while (!rfs_usart_write(&usart, c));
+        }
+    }
+}
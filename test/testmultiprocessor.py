@@ -0,0 +1,48 @@
+#!/usr/bin/env python
+
+from autotests import pass_, fail
+from avrtests import load_program, DEVICE
+from serial import Serial, PARITY_MARK, PARITY_SPACE
+from time import sleep
+
+MULTIPROCESSOR_PROGRAM = "testmultiprocessor.hex"
+COMM_BAUDS = 19200
+SLEEP_TIME = 2
+NODE_ADDRESS = 0x05
+OTHER_ADDRESS = 0x07
+
+# The ninth bit is emulated with the parity bit: mark parity sends address frames and space parity sends
+# data frames
+def send_address(s: Serial, address: int) -> None:
+    s.parity = PARITY_MARK
+    s.write(bytes([address]))
+    s.flush()
+
+def send_data(s: Serial, data: bytes) -> None:
+    s.parity = PARITY_SPACE
+    s.write(data)
+    s.flush()
+
+def test_multiprocessor() -> None:
+    s = Serial(DEVICE, COMM_BAUDS, parity=PARITY_SPACE, timeout=1)
+    # This sleep is important because the Arduino gets reset when the Serial connection is made
+    sleep(SLEEP_TIME)
+    # The data sent to another node must be ignored
+    send_address(s, OTHER_ADDRESS)
+    send_data(s, b"ignored")
+    send_address(s, NODE_ADDRESS)
+    send_data(s, b"hello")
+    send_address(s, OTHER_ADDRESS)
+    send_data(s, b"ignored")
+    received_data = s.read(16)
+    if (received_data == b"hello"):
+        pass_()
+    else:
+        fail()
+
+def main() -> None:
+    load_program(MULTIPROCESSOR_PROGRAM)
+    test_multiprocessor()
+
+if __name__ == "__main__":
+    main()
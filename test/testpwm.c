@@ -25,6 +25,15 @@ along with RobotsFromScratch; see the file COPYING.  If not, see
 #include <avr/io.h>
 #include <stdio.h>
 
+#ifdef SIMAVR
+// In the simulator, the results are read from the virtual UART
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <avr_mcu_section.h>
+
+AVR_MCU(F_CPU, "atmega328p");
+#endif
+
 struct rfs_usart_t usart;
 char buffer[64];
 
@@ -441,6 +450,12 @@ int main()
     // Set the duty cycle to 1.5 ms
     rfs_pwm_set_duty_cycle_16(&pwm, 1.5 * 65536 / 20);
 
+#ifdef SIMAVR
+    // Sleeping with the interrupts disabled stops the simulator
+    cli();
+    sleep_cpu();
+#else
     // Loop forever
     while (1);
+#endif
 }
\ No newline at end of file
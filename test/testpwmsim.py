@@ -0,0 +1,30 @@
+#!/usr/bin/env python
+
+import re
+
+from autotests import pass_, fail
+from pwmchecks import ALL_TESTS_SIZE, check_message_result
+from simtests import run_program_output
+
+PWM_PROGRAM = "testpwmsim.bin"
+RESULT_LINE = re.compile(r"\d+:")
+
+def main() -> None:
+    executed_tests = 0
+    passed_tests = 0
+
+    # Same program as testpwm.py, but the results are read from the virtual UART of the simulator
+    for line in filter(RESULT_LINE.match, run_program_output(PWM_PROGRAM)):
+        test_id, passed = check_message_result(line)
+        if test_id is not None:
+            executed_tests += 1
+            if passed:
+                passed_tests += 1
+
+    if executed_tests == ALL_TESTS_SIZE and executed_tests == passed_tests:
+        pass_()
+    else:
+        fail()
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,72 @@
+/*
+testpwmwave.c - Test the PWM signals generated in the simulator
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+/*
+This program is run in simavr, that records the PWM output pins in a VCD file. The pins are driven by the timers, not
+by the program, so they are traced through the pin IRQs of the simulator. testpwmwave.py measures the frequency and the
+duty cycle of every signal.
+*/
+
+#include "rfsavr/pwm.h"
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/sleep.h>
+#include <avr_mcu_section.h>
+#include <util/delay.h>
+
+// Long enough for several periods of the slowest signal
+#define RUN_TIME_MS 120
+
+AVR_MCU(F_CPU, "atmega328p");
+AVR_MCU_VCD_FILE("testpwmwave.vcd", 1000);
+AVR_MCU_VCD_PORT_PIN('D', 6, "TIMER0A");
+AVR_MCU_VCD_PORT_PIN('B', 1, "TIMER1A");
+AVR_MCU_VCD_PORT_PIN('D', 3, "TIMER2B");
+
+int main()
+{
+    struct rfs_pwm_t timer0a;
+    struct rfs_pwm_t timer1a;
+    struct rfs_pwm_t timer2b;
+
+    // Closest frequency below 50 kHz, 50% duty cycle
+    rfs_pwm_init(&timer0a, RFS_TIMER0, RFS_PWM_CHANNEL_A);
+    rfs_pwm_set_frequency_hint(&timer0a, 50000, F_CPU);
+    rfs_pwm_set_duty_cycle_8(&timer0a, 128);
+
+    // Servo signal: exactly 50 Hz, 1.5 ms pulses. The timer counts up to ICR1
+    rfs_pwm_init(&timer1a, RFS_TIMER1, RFS_PWM_CHANNEL_A);
+    rfs_pwm_set_frequency(&timer1a, 50, F_CPU);
+    rfs_pwm_set_duty_cycle_16(&timer1a, (uint32_t)ICR1 * 3 / 40);
+
+    // Exactly 1 kHz, 25% duty cycle. The timer counts up to OCR2A
+    rfs_pwm_init(&timer2b, RFS_TIMER2, RFS_PWM_CHANNEL_B);
+    rfs_pwm_set_frequency(&timer2b, 1000, F_CPU);
+    rfs_pwm_set_duty_cycle_8(&timer2b, OCR2A / 4);
+
+    _delay_ms(RUN_TIME_MS);
+
+    // Sleeping with the interrupts disabled stops the simulator
+    cli();
+    sleep_cpu();
+}
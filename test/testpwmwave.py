@@ -0,0 +1,33 @@
+#!/usr/bin/env python
+
+from autotests import pass_, fail
+from simtests import run_program, read_vcd, frequency_and_duty
+
+PWM_PROGRAM = "testpwmwave.bin"
+VCD_FILE = "testpwmwave.vcd"
+FREQUENCY_TOLERANCE = 0.015
+DUTY_TOLERANCE = 0.01
+
+# Signal: (lowest frequency, highest frequency, duty cycle), as set by testpwmwave.c. The exact frequencies have a
+# small margin for the rounding of TOP; the hint gives the closest available frequency below the target
+SIGNALS = {
+    "TIMER0A": (50000 / 8, 50000, 0.5),
+    "TIMER1A": (50 * (1 - FREQUENCY_TOLERANCE), 50 * (1 + FREQUENCY_TOLERANCE), 0.075),
+    "TIMER2B": (1000 * (1 - FREQUENCY_TOLERANCE), 1000 * (1 + FREQUENCY_TOLERANCE), 0.25),
+}
+
+def main() -> None:
+    run_program(PWM_PROGRAM)
+    traces = read_vcd(VCD_FILE)
+    passed = True
+    for signal, (frequency_min, frequency_max, duty) in SIGNALS.items():
+        measured_frequency, measured_duty = frequency_and_duty(traces.get(signal, []))
+        print(f"{signal}: {measured_frequency:.1f} Hz, duty cycle {measured_duty:.3f}")
+        if not (frequency_min <= measured_frequency <= frequency_max) or abs(measured_duty - duty) > DUTY_TOLERANCE:
+            passed = False
+    if not passed:
+        fail()
+    pass_()
+
+if __name__ == "__main__":
+    main()
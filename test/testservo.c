@@ -0,0 +1,90 @@
+/*
+testservo.c - Test the servo bank in simavr
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+/*
+This program is run in simavr, that records the servo pins in a VCD file. Eight servos with different angles, two of
+them equal, are driven for some frames, while the main loop spends a variable time between the calls to
+rfs_servo_bank_poll, shorter than the guard time. testservo.py measures the pulse widths and their jitter.
+*/
+
+#include "rfsavr/servo.h"
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/sleep.h>
+#include <avr_mcu_section.h>
+#include <util/delay.h>
+
+#define FRAMES  8
+
+AVR_MCU(F_CPU, "atmega328p");
+AVR_MCU_VCD_FILE("testservo.vcd", 1000);
+AVR_MCU_VCD_PORT_PIN('B', 0, "SERVO0");
+AVR_MCU_VCD_PORT_PIN('B', 4, "SERVO1");
+AVR_MCU_VCD_PORT_PIN('B', 5, "SERVO2");
+AVR_MCU_VCD_PORT_PIN('C', 0, "SERVO3");
+AVR_MCU_VCD_PORT_PIN('C', 1, "SERVO4");
+AVR_MCU_VCD_PORT_PIN('C', 2, "SERVO5");
+AVR_MCU_VCD_PORT_PIN('D', 2, "SERVO6");
+AVR_MCU_VCD_PORT_PIN('D', 7, "SERVO7");
+
+static const struct rfs_pin_t PINS[] = {
+    {&PORTB, 0}, {&PORTB, 4}, {&PORTB, 5}, {&PORTC, 0}, {&PORTC, 1}, {&PORTC, 2}, {&PORTD, 2}, {&PORTD, 7}
+};
+
+// The angles of the servos, in degrees, also in testservo.py
+static const uint8_t ANGLES[] = {90, 0, 180, 45, 90, 135, 30, 150};
+
+#define SERVOS_COUNT    (sizeof(PINS) / sizeof(PINS[0]))
+
+int main()
+{
+    struct rfs_servo_bank_t bank;
+    struct rfs_servo_t servos[SERVOS_COUNT];
+    uint8_t frames = 0;
+    int8_t idle = 1;
+    uint8_t random = 1;
+
+    rfs_servo_bank_init(&bank, servos, SERVOS_COUNT, F_CPU);
+    for (uint8_t i = 0; i < SERVOS_COUNT; i++) {
+        rfs_servo_bank_add(&bank, &PINS[i]);
+        rfs_servo_bank_set_angle(&bank, i, RFS_SERVO_DEGREES(ANGLES[i]));
+    }
+
+    while (frames < FRAMES) {
+        const int8_t ended = rfs_servo_bank_poll(&bank);
+        if (ended && !idle) {
+            frames++;
+        }
+        idle = ended;
+
+        // Other work, from 0 to 31 us
+        random = (random >> 1) ^ (-(random & 1) & 0xb8);
+        for (uint8_t i = random & 0x1f; i; i--) {
+            _delay_us(1);
+        }
+    }
+
+    // Sleeping with the interrupts disabled stops the simulator
+    cli();
+    sleep_cpu();
+}
@@ -0,0 +1,47 @@
+#!/usr/bin/env python
+
+from autotests import pass_, fail
+from simtests import run_program, read_vcd, pulses
+
+SERVO_PROGRAM = "testservo.bin"
+VCD_FILE = "testservo.vcd"
+
+# The angles set by testservo.c, with the default pulse widths of 1 ms at 0 degrees and 2 ms at 180 degrees
+ANGLES = [90, 0, 180, 45, 90, 135, 30, 150]
+MIN_WIDTH_NS = 1000000
+MAX_WIDTH_NS = 2000000
+FRAME_NS = 20000000
+FRAMES = 8
+
+# The pulse widths are rounded to half a microsecond, the timer tick, and the edges are written some CPU cycles after
+# their ticks
+WIDTH_TOLERANCE_NS = 1000
+MAX_JITTER_NS = 1000
+FRAME_TOLERANCE = 0.001
+
+def main() -> None:
+    run_program(SERVO_PROGRAM)
+    traces = read_vcd(VCD_FILE)
+    passed = True
+    for i, angle in enumerate(ANGLES):
+        changes = traces.get(f"SERVO{i}", [])
+        widths = [high for high, _ in pulses(changes)]
+        frames = [low + high for high, low in pulses(changes)[:-1]]
+        width = MIN_WIDTH_NS + (MAX_WIDTH_NS - MIN_WIDTH_NS) * angle / 180
+        if len(widths) < FRAMES:
+            print(f"SERVO{i}: {len(widths)} pulses")
+            passed = False
+            continue
+        jitter = max(widths) - min(widths)
+        print(f"SERVO{i}: {min(widths):.0f} to {max(widths):.0f} ns, expected {width:.0f} ns")
+        if any(abs(w - width) > WIDTH_TOLERANCE_NS for w in widths) or jitter >= MAX_JITTER_NS:
+            passed = False
+        if any(abs(frame - FRAME_NS) > FRAME_NS * FRAME_TOLERANCE for frame in frames):
+            print(f"SERVO{i}: frames of {min(frames):.0f} to {max(frames):.0f} ns")
+            passed = False
+    if not passed:
+        fail()
+    pass_()
+
+if __name__ == "__main__":
+    main()
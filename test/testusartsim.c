@@ -0,0 +1,83 @@
+/*
+testusartsim.c - Test the USART through the virtual UART of the simulator
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+/*
+This program is run in simavr, with the UART in loopback mode: every byte written is received back. The message is sent
+and read back one byte at a time, while timer 1 measures the time it takes. The result is written to the simulator
+console as "usart <bytes received correctly> <timer 1 ticks at clk/8> <CPU frequency in kHz>", and checked by
+testusartsim.py.
+*/
+
+#include "rfsavr/usart.h"
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/sleep.h>
+#include <avr_mcu_section.h>
+#include <stdio.h>
+
+AVR_MCU(F_CPU, "atmega328p");
+AVR_MCU_SIMAVR_CONSOLE(&GPIOR0);
+AVR_MCU_SIMAVR_COMMAND(&GPIOR1);
+
+static const char message[] = "hello, world!\n";
+
+static void console_write(const char *s)
+{
+    while (*s) {
+        GPIOR0 = *s++;
+    }
+}
+
+int main()
+{
+    struct rfs_usart_t usart;
+    char buffer[32];
+    char data;
+    uint8_t received = 0;
+    uint8_t i;
+
+    cli();
+    rfs_usart_open(&usart, RFS_USART_0, RFS_USART_ASYNC, RFS_USART_RXTX | RFS_USART_8BITS);
+    rfs_usart_setspeed(&usart, RFS_USART_B19200, F_CPU);
+    GPIOR1 = SIMAVR_CMD_UART_LOOPBACK;
+
+    // Timer 1 at clk/8, so that the whole message fits in 16 bits
+    TCCR1A = 0;
+    TCCR1B = _BV(CS11);
+    TCNT1 = 0;
+    for (i = 0; i < sizeof(message) - 1; i++) {
+        while (!rfs_usart_write(&usart, message[i]));
+        while (!rfs_usart_read(&usart, &data));
+        if (data == message[i]) {
+            received++;
+        }
+    }
+    const uint16_t ticks = TCNT1;
+
+    sprintf(buffer, "usart %hhu %u %lu\n", received, ticks, F_CPU / 1000);
+    console_write(buffer);
+    rfs_usart_close(&usart);
+
+    // Sleeping with the interrupts disabled stops the simulator
+    sleep_cpu();
+}
@@ -0,0 +1,32 @@
+#!/usr/bin/env python
+
+import re
+
+from autotests import pass_, fail
+from simtests import run_program_output
+
+USART_PROGRAM = "testusartsim.bin"
+MESSAGE = "hello, world!\n"
+TIMER_DIVISOR = 8
+COMM_BAUDS = 19200
+# Start, 8 data bits and stop
+BITS_PER_BYTE = 10
+TOLERANCE = 0.05
+
+def main() -> None:
+    output = run_program_output(USART_PROGRAM)
+    results = [re.search(r"usart (\d+) (\d+) (\d+)", line) for line in output]
+    results = [result for result in results if result]
+    if len(results) != 1:
+        fail()
+    received, ticks, cpu_frequency_khz = (int(x) for x in results[0].groups())
+    # Every byte is sent and received back before the next one, so it takes at least one byte time
+    byte_time = ticks * TIMER_DIVISOR / (cpu_frequency_khz * 1000) / len(MESSAGE)
+    expected_byte_time = BITS_PER_BYTE / COMM_BAUDS
+    print(f"received {received}/{len(MESSAGE)}, byte time {byte_time * 1e6:.1f} us")
+    if received != len(MESSAGE) or abs(byte_time - expected_byte_time) > expected_byte_time * TOLERANCE:
+        fail()
+    pass_()
+
+if __name__ == "__main__":
+    main()
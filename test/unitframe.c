@@ -0,0 +1,246 @@
+/*
+unitframe.c - Unit tests of the binary frames and the CRC-16, for the native build
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+/*
+The USART works in buffered mode, so the bytes are moved by calling the interrupt handlers: the sent bytes are
+collected from UDR0 and the received bytes are written to UDR0, one at a time.
+*/
+
+#include <string.h>
+
+#include "rfsavr/crc.h"
+#include "rfsavr/frame.h"
+#include "unittests.h"
+
+struct rfs_usart_t usart;
+struct rfs_ringbuf_t rx_buffer;
+struct rfs_ringbuf_t tx_buffer;
+char rx_data[16];
+char tx_data[16];
+
+struct rfs_frame_rx_t rx;
+uint8_t rx_payload[320];
+
+// The payloads of the frames received by receive, one after the other
+uint8_t received[1024];
+uint16_t received_size;
+
+void open_usart()
+{
+    rfs_usart_open(&usart, RFS_USART_0, RFS_USART_ASYNC, RFS_USART_RXTX | RFS_USART_8BITS);
+    rfs_ringbuf_init(&rx_buffer, rx_data, sizeof(rx_data));
+    rfs_ringbuf_init(&tx_buffer, tx_data, sizeof(tx_data));
+    rfs_usart_setbuffers(&usart, &rx_buffer, &tx_buffer);
+    rfs_frame_recv_init(&rx, &usart, rx_payload, sizeof(rx_payload));
+    received_size = 0;
+}
+
+uint16_t send(const uint8_t *payload, uint16_t payload_size, uint8_t *output)
+{
+    struct rfs_frame_t frame;
+    uint16_t size = 0;
+    int8_t pending;
+
+    rfs_frame_init(&frame, &usart, payload, payload_size);
+    do {
+        pending = rfs_frame_send(&frame);
+        // Transmit the queued bytes
+        while (UCSR0B & _BV(UDRIE0)) {
+            UDR0 = 0;
+            USART_UDRE_vect();
+            if (UCSR0B & _BV(UDRIE0)) {
+                output[size++] = UDR0;
+            }
+        }
+    } while (pending);
+    return size;
+}
+
+uint8_t receive(const uint8_t *input, uint16_t size)
+{
+    uint8_t frames = 0;
+
+    for (uint16_t i = 0; i < size; i++) {
+        UDR0 = input[i];
+        USART_RX_vect();
+        if (rfs_frame_recv(&rx)) {
+            memcpy(received + received_size, rx_payload, rx.size);
+            received_size += rx.size;
+            frames++;
+        }
+    }
+    return frames;
+}
+
+void fill(uint8_t *payload, uint16_t size, uint8_t seed)
+{
+    for (uint16_t i = 0; i < size; i++) {
+        payload[i] = (i * 7 + seed) % 251;
+    }
+}
+
+void test_crc()
+{
+    const char *check = "123456789";
+    uint16_t crc = RFS_CRC16_INIT;
+
+    for (uint8_t i = 0; i < 9; i++) {
+        crc = rfs_crc16_update(crc, check[i]);
+    }
+    CHECK_EQ(crc, 0x29b1);
+    // The CRC of the data followed by its CRC is 0
+    crc = rfs_crc16_update(crc, 0x29);
+    crc = rfs_crc16_update(crc, 0xb1);
+    CHECK_EQ(crc, 0);
+}
+
+void test_encode()
+{
+    static const uint8_t payload[] = {0x11, 0x00, 0x22};
+    static const uint8_t expected[] = {0x02, 0x11, 0x04, 0x22, 0xbc, 0xef, 0x00};
+    uint8_t output[16];
+
+    open_usart();
+    CHECK_EQ(send(payload, sizeof(payload), output), sizeof(expected));
+    CHECK(memcmp(output, expected, sizeof(expected)) == 0);
+}
+
+void check_round_trip(const uint8_t *payload, uint16_t size)
+{
+    static uint8_t output[1024];
+    const uint16_t encoded = send(payload, size, output);
+
+    // The delimiter only ends the frame
+    CHECK(memchr(output, RFS_FRAME_DELIMITER, encoded - 1) == NULL);
+    CHECK_EQ(output[encoded - 1], RFS_FRAME_DELIMITER);
+    received_size = 0;
+    CHECK_EQ(receive(output, encoded), 1);
+    CHECK_EQ(rx.size, size);
+    CHECK(memcmp(received, payload, size) == 0);
+}
+
+void test_round_trip()
+{
+    static uint8_t payload[300];
+
+    open_usart();
+    check_round_trip(payload, 0);
+    // Only zeros
+    check_round_trip(payload, 10);
+    fill(payload, sizeof(payload), 1);
+    check_round_trip(payload, 1);
+    // Full COBS blocks, without zeros, and blocks that end at a zero
+    check_round_trip(payload, 254);
+    check_round_trip(payload, 255);
+    check_round_trip(payload, 300);
+    CHECK_EQ(rx.frames, 6);
+    CHECK_EQ(rx.bad_frames, 0);
+}
+
+void test_back_to_back()
+{
+    static uint8_t payloads[4][20];
+    static uint8_t output[256];
+    uint16_t size = 0;
+
+    open_usart();
+    for (uint8_t i = 0; i < 4; i++) {
+        fill(payloads[i], sizeof(payloads[i]), i * 50);
+        size += send(payloads[i], sizeof(payloads[i]), output + size);
+    }
+    CHECK_EQ(receive(output, size), 4);
+    CHECK_EQ(received_size, sizeof(payloads));
+    CHECK(memcmp(received, payloads, sizeof(payloads)) == 0);
+    CHECK_EQ(rx.frames, 4);
+    CHECK_EQ(rx.bad_frames, 0);
+}
+
+void test_bad_crc()
+{
+    static const uint8_t payload[] = "hello";
+    uint8_t output[32];
+
+    open_usart();
+    const uint16_t size = send(payload, sizeof(payload), output);
+    output[2] ^= 0x01;
+    CHECK_EQ(receive(output, size), 0);
+    CHECK_EQ(rx.bad_frames, 1);
+
+    // The next frame is received
+    output[2] ^= 0x01;
+    CHECK_EQ(receive(output, size), 1);
+    CHECK_EQ(rx.frames, 1);
+}
+
+void test_too_big()
+{
+    static uint8_t payload[sizeof(rx_payload) + 1];
+    static uint8_t output[400];
+
+    open_usart();
+    fill(payload, sizeof(payload), 3);
+    uint16_t size = send(payload, sizeof(payload), output);
+    CHECK_EQ(receive(output, size), 0);
+    CHECK_EQ(rx.bad_frames, 1);
+
+    // The whole buffer can be used
+    size = send(payload, sizeof(rx_payload), output);
+    CHECK_EQ(receive(output, size), 1);
+    CHECK_EQ(rx.size, sizeof(rx_payload));
+}
+
+void test_resync()
+{
+    static const uint8_t noise[] = {0x13, 0xff, 0x02, 0x41, RFS_FRAME_DELIMITER};
+    static const uint8_t payload[] = {1, 2, 3};
+    uint8_t output[16];
+
+    open_usart();
+    const uint16_t size = send(payload, sizeof(payload), output);
+    CHECK_EQ(receive(noise, sizeof(noise)), 0);
+    CHECK_EQ(rx.bad_frames, 1);
+    CHECK_EQ(receive(output, size), 1);
+    CHECK(memcmp(received, payload, sizeof(payload)) == 0);
+
+    // A reception error drops the frame in progress, until the next delimiter
+    received_size = 0;
+    receive(output, 2);
+    UCSR0A |= _BV(FE0);
+    USART_RX_vect();
+    UCSR0A &= ~_BV(FE0);
+    CHECK_EQ(receive(output + 2, size - 2), 0);
+    CHECK_EQ(rx.bad_frames, 2);
+    CHECK_EQ(receive(output, size), 1);
+    CHECK_EQ(rx.frames, 2);
+}
+
+int main()
+{
+    RUN(test_crc);
+    RUN(test_encode);
+    RUN(test_round_trip);
+    RUN(test_back_to_back);
+    RUN(test_bad_crc);
+    RUN(test_too_big);
+    RUN(test_resync);
+    return unit_result();
+}
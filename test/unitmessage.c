@@ -0,0 +1,151 @@
+/*
+unitmessage.c - Unit tests of the messages, for the native build
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+/*
+The USART works in buffered mode, so the bytes are moved by calling the interrupt handlers: the sent bytes are
+collected from UDR0 and the received bytes are written to UDR0.
+*/
+
+#include <avr/pgmspace.h>
+#include <string.h>
+
+#include "rfsavr/message.h"
+#include "unittests.h"
+
+struct rfs_usart_t usart;
+struct rfs_ringbuf_t rx_buffer;
+struct rfs_ringbuf_t tx_buffer;
+char rx_data[16];
+char tx_data[16];
+
+void open_usart()
+{
+    rfs_usart_open(&usart, RFS_USART_0, RFS_USART_ASYNC, RFS_USART_RXTX | RFS_USART_8BITS);
+    rfs_ringbuf_init(&rx_buffer, rx_data, sizeof(rx_data));
+    rfs_ringbuf_init(&tx_buffer, tx_data, sizeof(tx_data));
+    rfs_usart_setbuffers(&usart, &rx_buffer, &tx_buffer);
+}
+
+uint16_t send(struct rfs_message_t *message, char *output)
+{
+    uint16_t size = 0;
+    int8_t pending;
+
+    do {
+        pending = rfs_message_send(message);
+        // Transmit the queued bytes
+        while (UCSR0B & _BV(UDRIE0)) {
+            UDR0 = 0;
+            USART_UDRE_vect();
+            if (UCSR0B & _BV(UDRIE0)) {
+                output[size++] = UDR0;
+            }
+        }
+    } while (pending);
+    output[size] = '\0';
+    return size;
+}
+
+int8_t receive(struct rfs_message_rx_t *message, const char *input)
+{
+    int8_t received = 0;
+
+    while (*input) {
+        UDR0 = *input++;
+        USART_RX_vect();
+        received += rfs_message_recv(message);
+    }
+    return received;
+}
+
+void test_send()
+{
+    struct rfs_message_t message;
+    char output[64];
+
+    open_usart();
+    // The payload is longer than the transmission buffer, so it is sent in several calls
+    rfs_message_init(&message, &usart, "Hello, world!!!!!!!!", 20);
+    CHECK_EQ(send(&message, output), 24);
+    CHECK(strcmp(output, ":Hello, world!!!!!!!!90\n") == 0);
+
+    // A copy of the message doesn't depend on the original
+    struct rfs_message_t copy;
+    rfs_message_init(&message, &usart, "Hi", 2);
+    copy = message;
+    rfs_message_init(&message, &usart, "XXXXX", 5);
+    send(&copy, output);
+    CHECK(strcmp(output, ":Hi4f\n") == 0);
+}
+
+void test_send_iov()
+{
+    static const char header[] PROGMEM = "AB";
+    const struct rfs_iovec_t iov[] = {
+        {header, 2, RFS_IOV_PROGMEM},
+        {"C", 1, RFS_IOV_RAM},
+        {"", 0, RFS_IOV_RAM},
+    };
+    struct rfs_message_t message;
+    char output[64];
+
+    open_usart();
+    rfs_message_init_iov(&message, &usart, iov, 3);
+    CHECK_EQ(message.size, 3);
+    send(&message, output);
+    // 'A' + 'B' + 'C' = 0xc6, whose two's complement is 0x3a
+    CHECK(strcmp(output, ":ABC3a\n") == 0);
+}
+
+void test_receive()
+{
+    struct rfs_message_rx_t message;
+    char data[8];
+
+    open_usart();
+    rfs_message_recv_init(&message, &usart, data, sizeof(data));
+    CHECK_EQ(receive(&message, "noise:ABC3A\n"), 1);
+    CHECK_EQ(message.size, 3);
+    CHECK(memcmp(data, "ABC", 3) == 0);
+    CHECK_EQ(message.frames, 1);
+
+    // Wrong checksum, and a payload that doesn't fit in the buffer
+    CHECK_EQ(receive(&message, ":ABC3B\n:ABCDEFGHI00\n"), 0);
+    CHECK_EQ(message.bad_frames, 2);
+
+    // A reception error drops the message in progress
+    CHECK_EQ(receive(&message, ":AB"), 0);
+    UCSR0A |= _BV(FE0);
+    USART_RX_vect();
+    UCSR0A &= ~_BV(FE0);
+    CHECK_EQ(receive(&message, "C3A\n"), 0);
+    CHECK_EQ(message.bad_frames, 3);
+    CHECK_EQ(message.frames, 1);
+}
+
+int main()
+{
+    RUN(test_send);
+    RUN(test_send_iov);
+    RUN(test_receive);
+    return unit_result();
+}
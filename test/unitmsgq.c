@@ -0,0 +1,219 @@
+/*
+unitmsgq.c - Unit tests of the message queue, for the native build
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+/*
+The USART works in buffered mode, so the bytes are moved by calling the interrupt handlers: the sent bytes are
+collected from UDR0.
+*/
+
+#include <avr/pgmspace.h>
+#include <string.h>
+
+#include "rfsavr/msgq.h"
+#include "unittests.h"
+
+struct rfs_usart_t usart;
+struct rfs_ringbuf_t rx_buffer;
+struct rfs_ringbuf_t tx_buffer;
+char rx_data[16];
+char tx_data[16];
+
+void open_usart()
+{
+    rfs_usart_open(&usart, RFS_USART_0, RFS_USART_ASYNC, RFS_USART_RXTX | RFS_USART_8BITS);
+    rfs_ringbuf_init(&rx_buffer, rx_data, sizeof(rx_data));
+    rfs_ringbuf_init(&tx_buffer, tx_data, sizeof(tx_data));
+    rfs_usart_setbuffers(&usart, &rx_buffer, &tx_buffer);
+}
+
+void transmit(char *output)
+{
+    char *end = output + strlen(output);
+
+    while (UCSR0B & _BV(UDRIE0)) {
+        UDR0 = 0;
+        USART_UDRE_vect();
+        if (UCSR0B & _BV(UDRIE0)) {
+            *end++ = UDR0;
+        }
+    }
+    *end = '\0';
+}
+
+uint8_t drain(struct rfs_msgq_t *queue, char *output)
+{
+    uint8_t polls = 0;
+    int8_t pending;
+
+    output[0] = '\0';
+    do {
+        pending = rfs_msgq_poll(queue);
+        transmit(output);
+        polls++;
+    } while (pending);
+    return polls;
+}
+
+void test_full()
+{
+    struct rfs_msgq_slot_t slots[3];
+    struct rfs_msgq_t queue;
+    struct rfs_message_t messages[4];
+    char output[64];
+
+    open_usart();
+    rfs_msgq_init(&queue, &usart, slots, 3);
+    for (uint8_t i = 0; i < 4; i++) {
+        rfs_message_init(messages + i, &usart, "A", 1);
+    }
+    // A priority out of range is rejected without taking a slot
+    CHECK_EQ(rfs_msgq_enqueue(&queue, messages + 0, RFS_MSGQ_PRIORITIES), 0);
+    CHECK_EQ(rfs_msgq_enqueue(&queue, messages + 0, (enum rfs_msgq_priority)0xff), 0);
+    CHECK_EQ(rfs_msgq_enqueue(&queue, messages + 0, RFS_MSGQ_NORMAL), 1);
+    CHECK_EQ(rfs_msgq_enqueue(&queue, messages + 1, RFS_MSGQ_URGENT), 1);
+    CHECK_EQ(rfs_msgq_enqueue(&queue, messages + 2, RFS_MSGQ_BULK), 1);
+    CHECK_EQ(rfs_msgq_enqueue(&queue, messages + 3, RFS_MSGQ_NORMAL), 0);
+    CHECK_EQ(queue.stats[RFS_MSGQ_NORMAL].depth, 1);
+    CHECK_EQ(queue.stats[RFS_MSGQ_NORMAL].max_depth, 1);
+
+    // The slots are free again once the messages are sent. Each message takes a poll for the header, the payload,
+    // the two checksum digits and the end
+    CHECK_EQ(drain(&queue, output), 15);
+    CHECK(strcmp(output, ":Abf\n:Abf\n:Abf\n") == 0);
+    for (uint8_t i = 0; i < 3; i++) {
+        rfs_message_init(messages + i, &usart, "A", 1);
+        CHECK_EQ(rfs_msgq_enqueue(&queue, messages + i, RFS_MSGQ_BULK), 1);
+    }
+    CHECK_EQ(rfs_msgq_enqueue(&queue, messages + 3, RFS_MSGQ_BULK), 0);
+    CHECK_EQ(queue.stats[RFS_MSGQ_BULK].max_depth, 3);
+
+    // A queue without slots is always full
+    rfs_msgq_init(&queue, &usart, slots, 0);
+    CHECK_EQ(rfs_msgq_enqueue(&queue, messages + 0, RFS_MSGQ_URGENT), 0);
+    CHECK_EQ(rfs_msgq_poll(&queue), 0);
+}
+
+void test_order()
+{
+    struct rfs_msgq_slot_t slots[8];
+    struct rfs_msgq_t queue;
+    struct rfs_message_t messages[6];
+    char output[128];
+
+    open_usart();
+    rfs_msgq_init(&queue, &usart, slots, 8);
+    // The queue owns the USART, so a message initialized without it is sent through it too
+    rfs_message_init(messages + 0, 0, "A", 1);
+    rfs_message_init(messages + 1, &usart, "B", 1);
+    rfs_message_init(messages + 2, &usart, "C", 1);
+    rfs_message_init(messages + 3, &usart, "D", 1);
+    rfs_message_init(messages + 4, &usart, "E", 1);
+    rfs_msgq_enqueue(&queue, messages + 0, RFS_MSGQ_BULK);
+    rfs_msgq_enqueue(&queue, messages + 1, RFS_MSGQ_NORMAL);
+    rfs_msgq_enqueue(&queue, messages + 2, RFS_MSGQ_BULK);
+    rfs_msgq_enqueue(&queue, messages + 3, RFS_MSGQ_URGENT);
+    rfs_msgq_enqueue(&queue, messages + 4, RFS_MSGQ_NORMAL);
+    drain(&queue, output);
+    CHECK(strcmp(output, ":Dbc\n:Bbe\n:Ebb\n:Abf\n:Cbd\n") == 0);
+
+    // A message longer than the transmission buffer takes several polls, and an urgent message enqueued in the
+    // meantime waits until it is complete
+    rfs_message_init(messages + 0, &usart, "ABCDEFGHIJKLMNOPQRST", 20);
+    rfs_message_init(messages + 1, &usart, "B", 1);
+    rfs_message_init(messages + 2, &usart, "D", 1);
+    rfs_msgq_enqueue(&queue, messages + 0, RFS_MSGQ_BULK);
+    rfs_msgq_enqueue(&queue, messages + 1, RFS_MSGQ_BULK);
+    output[0] = '\0';
+    CHECK_EQ(rfs_msgq_poll(&queue), 1);
+    transmit(output);
+    rfs_msgq_enqueue(&queue, messages + 2, RFS_MSGQ_URGENT);
+    drain(&queue, output + strlen(output));
+    CHECK(strcmp(output, ":ABCDEFGHIJKLMNOPQRST2e\n:Dbc\n:Bbe\n") == 0);
+}
+
+void test_last_poll()
+{
+    struct rfs_msgq_slot_t slots[2];
+    struct rfs_msgq_t queue;
+    struct rfs_message_t message;
+    char output[16] = "";
+
+    open_usart();
+    rfs_msgq_init(&queue, &usart, slots, 2);
+    CHECK_EQ(rfs_msgq_poll(&queue), 0);
+    rfs_message_init(&message, &usart, "A", 1);
+    rfs_msgq_enqueue(&queue, &message, RFS_MSGQ_NORMAL);
+
+    // The poll that completes the last message reports the queue as empty, and frees its slot
+    for (uint8_t i = 0; i < 4; i++) {
+        CHECK_EQ(rfs_msgq_poll(&queue), 1);
+        CHECK_EQ(queue.stats[RFS_MSGQ_NORMAL].depth, 1);
+    }
+    CHECK_EQ(rfs_msgq_poll(&queue), 0);
+    transmit(output);
+    CHECK(strcmp(output, ":Abf\n") == 0);
+    CHECK_EQ(queue.current, RFS_MSGQ_NONE);
+    CHECK_EQ(queue.stats[RFS_MSGQ_NORMAL].depth, 0);
+    CHECK_EQ(queue.stats[RFS_MSGQ_NORMAL].sent, 1);
+    CHECK_EQ(queue.stats[RFS_MSGQ_NORMAL].max_latency, 5);
+    CHECK_EQ(rfs_msgq_poll(&queue), 0);
+    CHECK_EQ(queue.stats[RFS_MSGQ_NORMAL].sent, 1);
+
+    // The statistics keep the depth
+    rfs_msgq_enqueue(&queue, &message, RFS_MSGQ_NORMAL);
+    rfs_msgq_reset_stats(&queue);
+    CHECK_EQ(queue.stats[RFS_MSGQ_NORMAL].depth, 1);
+    CHECK_EQ(queue.stats[RFS_MSGQ_NORMAL].max_depth, 1);
+    CHECK_EQ(queue.stats[RFS_MSGQ_NORMAL].sent, 0);
+}
+
+void test_progmem()
+{
+    static const char header[] PROGMEM = "AB";
+    const struct rfs_iovec_t iov[] = {
+        {header, 2, RFS_IOV_PROGMEM},
+        {"C", 1, RFS_IOV_RAM},
+    };
+    struct rfs_msgq_slot_t slots[2];
+    struct rfs_msgq_t queue;
+    struct rfs_message_t messages[2];
+    char output[32];
+
+    open_usart();
+    rfs_msgq_init(&queue, &usart, slots, 2);
+    rfs_message_init_iov(messages + 0, &usart, iov, 2);
+    rfs_message_init_iov(messages + 1, &usart, iov, 1);
+    rfs_msgq_enqueue(&queue, messages + 0, RFS_MSGQ_BULK);
+    rfs_msgq_enqueue(&queue, messages + 1, RFS_MSGQ_BULK);
+    drain(&queue, output);
+    // 'A' + 'B' = 0x83, whose two's complement is 0x7d
+    CHECK(strcmp(output, ":ABC3a\n:AB7d\n") == 0);
+}
+
+int main()
+{
+    RUN(test_full);
+    RUN(test_order);
+    RUN(test_last_poll);
+    RUN(test_progmem);
+    return unit_result();
+}
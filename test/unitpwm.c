@@ -0,0 +1,902 @@
+/*
+unitpwm.c - Unit tests of the PWM signals, for the native build
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+/*
+The same cases as testpwm, with a CPU clock of 16 MHz, checked on the simulated registers.
+*/
+
+#include "rfsavr/pwm.h"
+#include "unittests.h"
+
+#define CPU_FREQUENCY 16000000UL
+
+#define CRA_MODE_MASK   0b00000011
+#define CRB_MODE_MASK   0b00011000
+#define CLOCK_MASK      0b00000111
+
+#define PWM_MODE_PHASE_CORRECT      1
+#define PWM_MODE_FAST               3
+#define PWM_MODE_PHASE_CORRECT_8    0b001
+#define PWM_MODE_PHASE_CORRECT_9    0b010
+#define PWM_MODE_PHASE_CORRECT_10   0b011
+#define PWM_MODE_FAST_8             0b101
+#define PWM_MODE_FAST_9             0b110
+#define PWM_MODE_FAST_10            0b111
+
+RFS_PWM_DEFINE(pwm0a, 0, A)
+RFS_PWM_DEFINE(pwm0b, 0, B)
+RFS_PWM_DEFINE(pwm1a, 1, A)
+RFS_PWM_DEFINE(pwm1b, 1, B)
+RFS_PWM_DEFINE(pwm2a, 2, A)
+RFS_PWM_DEFINE(pwm2b, 2, B)
+
+struct frequency_case_t {
+    uint32_t frequency;
+    uint8_t clock;
+    uint8_t mode;
+    uint16_t top;
+};
+
+static const struct frequency_case_t HINT_TIMER0[] = {
+    {62501, 1, PWM_MODE_FAST, 0},
+    {62500, 1, PWM_MODE_PHASE_CORRECT, 0},
+    {31251, 1, PWM_MODE_PHASE_CORRECT, 0},
+    {31250, 2, PWM_MODE_FAST, 0},
+    {7813, 2, PWM_MODE_FAST, 0},
+    {7812, 2, PWM_MODE_PHASE_CORRECT, 0},
+    {3907, 2, PWM_MODE_PHASE_CORRECT, 0},
+    {3906, 3, PWM_MODE_FAST, 0},
+    {977, 3, PWM_MODE_FAST, 0},
+    {976, 3, PWM_MODE_PHASE_CORRECT, 0},
+    {489, 3, PWM_MODE_PHASE_CORRECT, 0},
+    {488, 4, PWM_MODE_FAST, 0},
+    {245, 4, PWM_MODE_FAST, 0},
+    {244, 4, PWM_MODE_PHASE_CORRECT, 0},
+    {123, 4, PWM_MODE_PHASE_CORRECT, 0},
+    {122, 5, PWM_MODE_FAST, 0},
+    {62, 5, PWM_MODE_FAST, 0},
+    {61, 5, PWM_MODE_PHASE_CORRECT, 0},
+    {31, 5, PWM_MODE_PHASE_CORRECT, 0},
+    {30, 5, PWM_MODE_PHASE_CORRECT, 0},
+};
+
+static const struct frequency_case_t HINT_TIMER2[] = {
+    {62501, 1, PWM_MODE_FAST, 0},
+    {62500, 1, PWM_MODE_PHASE_CORRECT, 0},
+    {31251, 1, PWM_MODE_PHASE_CORRECT, 0},
+    {31250, 2, PWM_MODE_FAST, 0},
+    {7813, 2, PWM_MODE_FAST, 0},
+    {7812, 2, PWM_MODE_PHASE_CORRECT, 0},
+    {3907, 2, PWM_MODE_PHASE_CORRECT, 0},
+    {3906, 3, PWM_MODE_FAST, 0},
+    {1954, 3, PWM_MODE_FAST, 0},
+    {1953, 3, PWM_MODE_PHASE_CORRECT, 0},
+    {977, 3, PWM_MODE_PHASE_CORRECT, 0},
+    {976, 4, PWM_MODE_PHASE_CORRECT, 0},
+    {489, 4, PWM_MODE_PHASE_CORRECT, 0},
+    {488, 5, PWM_MODE_PHASE_CORRECT, 0},
+    {245, 5, PWM_MODE_PHASE_CORRECT, 0},
+    {244, 6, PWM_MODE_PHASE_CORRECT, 0},
+    {123, 6, PWM_MODE_PHASE_CORRECT, 0},
+    {122, 7, PWM_MODE_FAST, 0},
+    {62, 7, PWM_MODE_FAST, 0},
+    {61, 7, PWM_MODE_PHASE_CORRECT, 0},
+    {31, 7, PWM_MODE_PHASE_CORRECT, 0},
+    {30, 7, PWM_MODE_PHASE_CORRECT, 0},
+};
+
+static const struct frequency_case_t HINT_TIMER1[] = {
+    {62501, 1, PWM_MODE_FAST_8, 0},
+    {62500, 1, PWM_MODE_PHASE_CORRECT_8, 0},
+    {31251, 1, PWM_MODE_PHASE_CORRECT_8, 0},
+    {31250, 1, PWM_MODE_PHASE_CORRECT_9, 0},
+    {15626, 1, PWM_MODE_PHASE_CORRECT_9, 0},
+    {15625, 1, PWM_MODE_PHASE_CORRECT_10, 0},
+    {7813, 1, PWM_MODE_PHASE_CORRECT_10, 0},
+    {7812, 2, PWM_MODE_FAST_10, 0},
+    {1954, 2, PWM_MODE_FAST_10, 0},
+    {1953, 2, PWM_MODE_PHASE_CORRECT_10, 0},
+    {977, 2, PWM_MODE_PHASE_CORRECT_10, 0},
+    {976, 3, PWM_MODE_FAST_10, 0},
+    {245, 3, PWM_MODE_FAST_10, 0},
+    {244, 3, PWM_MODE_PHASE_CORRECT_10, 0},
+    {123, 3, PWM_MODE_PHASE_CORRECT_10, 0},
+    {122, 4, PWM_MODE_FAST_10, 0},
+    {62, 4, PWM_MODE_FAST_10, 0},
+    {61, 4, PWM_MODE_PHASE_CORRECT_10, 0},
+    {31, 4, PWM_MODE_PHASE_CORRECT_10, 0},
+    {30, 5, PWM_MODE_FAST_10, 0},
+    {16, 5, PWM_MODE_FAST_10, 0},
+    {15, 5, PWM_MODE_PHASE_CORRECT_10, 0},
+    {8, 5, PWM_MODE_PHASE_CORRECT_10, 0},
+    {7, 5, PWM_MODE_PHASE_CORRECT_10, 0},
+};
+
+static const struct frequency_case_t EXACT_TIMER0[] = {
+    {70000, 1, PWM_MODE_FAST, 228},
+    {62501, 1, PWM_MODE_FAST, 255},
+    {62500, 1, PWM_MODE_PHASE_CORRECT, 128},
+    {31251, 1, PWM_MODE_PHASE_CORRECT, 255},
+    {31250, 2, PWM_MODE_FAST, 64},
+    {7813, 2, PWM_MODE_FAST, 255},
+    {7812, 2, PWM_MODE_PHASE_CORRECT, 128},
+    {3907, 2, PWM_MODE_PHASE_CORRECT, 255},
+    {3906, 3, PWM_MODE_FAST, 64},
+    {977, 3, PWM_MODE_FAST, 255},
+    {976, 3, PWM_MODE_PHASE_CORRECT, 128},
+    {489, 3, PWM_MODE_PHASE_CORRECT, 255},
+    {488, 4, PWM_MODE_FAST, 128},
+    {245, 4, PWM_MODE_FAST, 255},
+    {244, 4, PWM_MODE_PHASE_CORRECT, 128},
+    {123, 4, PWM_MODE_PHASE_CORRECT, 254},
+    {122, 5, PWM_MODE_FAST, 128},
+    {62, 5, PWM_MODE_FAST, 252},
+    {61, 5, PWM_MODE_PHASE_CORRECT, 128},
+    {31, 5, PWM_MODE_PHASE_CORRECT, 252},
+    {30, 5, PWM_MODE_PHASE_CORRECT, 255},
+};
+
+static const struct frequency_case_t EXACT_TIMER2[] = {
+    {70000, 1, PWM_MODE_FAST, 228},
+    {62501, 1, PWM_MODE_FAST, 255},
+    {62500, 1, PWM_MODE_PHASE_CORRECT, 128},
+    {31251, 1, PWM_MODE_PHASE_CORRECT, 255},
+    {31250, 2, PWM_MODE_FAST, 64},
+    {7813, 2, PWM_MODE_FAST, 255},
+    {7812, 2, PWM_MODE_PHASE_CORRECT, 128},
+    {3907, 2, PWM_MODE_PHASE_CORRECT, 255},
+    {3906, 3, PWM_MODE_FAST, 128},
+    {1954, 3, PWM_MODE_FAST, 255},
+    {1953, 3, PWM_MODE_PHASE_CORRECT, 128},
+    {977, 3, PWM_MODE_PHASE_CORRECT, 255},
+    {976, 4, PWM_MODE_PHASE_CORRECT, 128},
+    {489, 4, PWM_MODE_PHASE_CORRECT, 255},
+    {488, 5, PWM_MODE_PHASE_CORRECT, 128},
+    {245, 5, PWM_MODE_PHASE_CORRECT, 255},
+    {244, 6, PWM_MODE_PHASE_CORRECT, 128},
+    {123, 6, PWM_MODE_PHASE_CORRECT, 254},
+    {122, 7, PWM_MODE_FAST, 128},
+    {62, 7, PWM_MODE_FAST, 252},
+    {61, 7, PWM_MODE_PHASE_CORRECT, 128},
+    {31, 7, PWM_MODE_PHASE_CORRECT, 252},
+    {30, 7, PWM_MODE_PHASE_CORRECT, 255},
+};
+
+static const struct frequency_case_t EXACT_TIMER1[] = {
+    {300, 1, PWM_MODE_FAST, 53333},
+    {245, 1, PWM_MODE_FAST, 65306},
+    {244, 1, PWM_MODE_PHASE_CORRECT, 32786},
+    {123, 1, PWM_MODE_PHASE_CORRECT, 65040},
+    {122, 2, PWM_MODE_FAST, 16393},
+    {31, 2, PWM_MODE_FAST, 64516},
+    {30, 2, PWM_MODE_PHASE_CORRECT, 33333},
+    {16, 2, PWM_MODE_PHASE_CORRECT, 62500},
+    {15, 3, PWM_MODE_FAST, 16666},
+    {4, 3, PWM_MODE_FAST, 62500},
+    {3, 3, PWM_MODE_PHASE_CORRECT, 41666},
+    {2, 3, PWM_MODE_PHASE_CORRECT, 62500},
+    {1, 4, PWM_MODE_FAST, 62500},
+};
+
+#define CASES_COUNT(cases)  (sizeof(cases) / sizeof(cases[0]))
+
+void check_init(enum rfs_timer_enum which, enum rfs_pwm_channel channel, volatile uint8_t *cra,
+    volatile uint8_t *ocr, volatile uint8_t *port, int8_t pin)
+{
+    struct rfs_pwm_t pwm;
+
+    rfs_native_reset();
+    rfs_pwm_init(&pwm, which, channel);
+    CHECK(pwm.timer.cra == cra);
+    CHECK(pwm.ocr8 == ocr);
+    CHECK(pwm.pin->port == port);
+    CHECK_EQ(pwm.pin->pin, pin);
+    CHECK_EQ(pwm.channel, channel);
+    // The output pin is configured as output, and the compare output mode is non inverting
+    CHECK_EQ(*(port - 1), _BV(pin));
+    CHECK_EQ(*cra, (channel == RFS_PWM_CHANNEL_A) ? RFS_TIMER_COMA_NONINVERT : RFS_TIMER_COMB_NONINVERT);
+}
+
+void test_init()
+{
+    check_init(RFS_TIMER0, RFS_PWM_CHANNEL_A, &TCCR0A, &OCR0A, &PORTD, 6);
+    check_init(RFS_TIMER0, RFS_PWM_CHANNEL_B, &TCCR0A, &OCR0B, &PORTD, 5);
+    check_init(RFS_TIMER1, RFS_PWM_CHANNEL_A, &TCCR1A, &OCR1AL, &PORTB, 1);
+    check_init(RFS_TIMER1, RFS_PWM_CHANNEL_B, &TCCR1A, &OCR1BL, &PORTB, 2);
+    check_init(RFS_TIMER2, RFS_PWM_CHANNEL_A, &TCCR2A, &OCR2A, &PORTB, 3);
+    check_init(RFS_TIMER2, RFS_PWM_CHANNEL_B, &TCCR2A, &OCR2B, &PORTD, 3);
+}
+
+void test_close()
+{
+    struct rfs_pwm_t pwm;
+
+    for (enum rfs_timer_enum which = RFS_TIMER0; which <= RFS_TIMER2; which++) {
+        for (enum rfs_pwm_channel channel = RFS_PWM_CHANNEL_A; channel <= RFS_PWM_CHANNEL_B; channel++) {
+            rfs_pwm_init(&pwm, which, channel);
+            rfs_pwm_set_frequency_hint(&pwm, 1000, CPU_FREQUENCY);
+            rfs_pwm_close(&pwm);
+            CHECK_EQ(*pwm.timer.cra, 0);
+            CHECK_EQ(*rfs_timer_crb(&pwm.timer), 0);
+        }
+    }
+}
+
+void check_frequency_hint_8(enum rfs_timer_enum which, enum rfs_pwm_channel channel,
+    const struct frequency_case_t *cases, uint8_t count)
+{
+    struct rfs_pwm_t pwm;
+
+    rfs_pwm_init(&pwm, which, channel);
+    for (uint8_t i = 0; i < count; i++) {
+        rfs_pwm_set_frequency_hint(&pwm, cases[i].frequency, CPU_FREQUENCY);
+        CHECK_EQ(*pwm.timer.cra & CRA_MODE_MASK, cases[i].mode);
+        CHECK_EQ(*rfs_timer_crb(&pwm.timer) & CRB_MODE_MASK, 0);
+        CHECK_EQ(*rfs_timer_crb(&pwm.timer) & CLOCK_MASK, cases[i].clock);
+    }
+}
+
+void test_set_frequency_hint()
+{
+    struct rfs_pwm_t pwm;
+
+    check_frequency_hint_8(RFS_TIMER0, RFS_PWM_CHANNEL_A, HINT_TIMER0, CASES_COUNT(HINT_TIMER0));
+    check_frequency_hint_8(RFS_TIMER2, RFS_PWM_CHANNEL_B, HINT_TIMER2, CASES_COUNT(HINT_TIMER2));
+
+    rfs_pwm_init(&pwm, RFS_TIMER1, RFS_PWM_CHANNEL_A);
+    for (uint8_t i = 0; i < CASES_COUNT(HINT_TIMER1); i++) {
+        rfs_pwm_set_frequency_hint(&pwm, HINT_TIMER1[i].frequency, CPU_FREQUENCY);
+        CHECK_EQ((TCCR1A & CRA_MODE_MASK) | ((TCCR1B & CRB_MODE_MASK) >> 1), HINT_TIMER1[i].mode);
+        CHECK_EQ(TCCR1B & CLOCK_MASK, HINT_TIMER1[i].clock);
+    }
+}
+
+void check_frequency_8(enum rfs_timer_enum which, enum rfs_pwm_channel channel, const struct frequency_case_t *cases,
+    uint8_t count)
+{
+    struct rfs_pwm_t pwm;
+
+    rfs_pwm_init(&pwm, which, channel);
+    for (uint8_t i = 0; i < count; i++) {
+        rfs_pwm_set_frequency(&pwm, cases[i].frequency, CPU_FREQUENCY);
+        CHECK_EQ(*pwm.timer.cra & CRA_MODE_MASK, cases[i].mode);
+        CHECK_EQ(*rfs_timer_crb(&pwm.timer) & CRB_MODE_MASK, 0b00001000);
+        CHECK_EQ(*rfs_timer_crb(&pwm.timer) & CLOCK_MASK, cases[i].clock);
+        CHECK_EQ(*pwm.timer.ocra8, cases[i].top);
+    }
+}
+
+void test_set_frequency()
+{
+    struct rfs_pwm_t pwm;
+
+    check_frequency_8(RFS_TIMER0, RFS_PWM_CHANNEL_B, EXACT_TIMER0, CASES_COUNT(EXACT_TIMER0));
+    check_frequency_8(RFS_TIMER2, RFS_PWM_CHANNEL_A, EXACT_TIMER2, CASES_COUNT(EXACT_TIMER2));
+
+    rfs_pwm_init(&pwm, RFS_TIMER1, RFS_PWM_CHANNEL_A);
+    for (uint8_t i = 0; i < CASES_COUNT(EXACT_TIMER1); i++) {
+        rfs_pwm_set_frequency(&pwm, EXACT_TIMER1[i].frequency, CPU_FREQUENCY);
+        CHECK_EQ(TCCR1A & CRA_MODE_MASK, 2);
+        CHECK_EQ(TCCR1B & CRB_MODE_MASK, (EXACT_TIMER1[i].mode == PWM_MODE_FAST) ? 0b11000 : 0b10000);
+        CHECK_EQ(TCCR1B & CLOCK_MASK, EXACT_TIMER1[i].clock);
+        CHECK_EQ(ICR1, EXACT_TIMER1[i].top);
+    }
+}
+
+void test_set_duty_cycle()
+{
+    struct rfs_pwm_t pwm;
+
+    rfs_pwm_init(&pwm, RFS_TIMER0, RFS_PWM_CHANNEL_B);
+    rfs_pwm_set_duty_cycle_8(&pwm, 128);
+    CHECK_EQ(OCR0B, 128);
+    CHECK_EQ(OCR0A, 0);
+    rfs_pwm_init(&pwm, RFS_TIMER1, RFS_PWM_CHANNEL_A);
+    rfs_pwm_set_duty_cycle_16(&pwm, 32768);
+    CHECK_EQ(OCR1A, 32768);
+    CHECK_EQ(OCR1B, 0);
+}
+
+struct plan_case_t {
+    enum rfs_timer_enum timer;
+    uint32_t frequency;
+    uint32_t min_steps;
+    uint8_t clock;
+    uint8_t mode;
+    uint16_t top;
+    uint32_t obtained_frequency;
+};
+
+static const struct plan_case_t PLANS[] = {
+    // Fixed TOP, both channels available
+    {RFS_TIMER0, 62500, 2, 1, RFS_TIMER8_MODE_FAST_PWM, 255, 62500},
+    // Exact with a clock divisor of 8 and 100 steps
+    {RFS_TIMER0, 20000, 2, 2, RFS_TIMER8_MODE_FAST_PWM_OCRA, 99, 20000},
+    // Exact in both modes with 250 ticks, phase correct gives one step more
+    {RFS_TIMER2, 1000, 100, 3, RFS_TIMER8_MODE_PWM_PHASE_CORRECT_OCRA, 250, 1000},
+    // Servo frequency, exact in fast mode with 40000 steps
+    {RFS_TIMER1, 50, 1000, 2, RFS_TIMER16_MODE_FAST_PWM_ICR, 39999, 50},
+    // Not exact: 16 MHz / 70 kHz = 228.57 ticks, fast with 229 is closer than phase correct with 228
+    {RFS_TIMER1, 70000, 2, 1, RFS_TIMER16_MODE_FAST_PWM_ICR, 228, 69869},
+    // The minimum steps lower the frequency: 200 ticks instead of 160
+    {RFS_TIMER2, 100000, 200, 1, RFS_TIMER8_MODE_FAST_PWM_OCRA, 199, 80000},
+};
+
+void test_plan()
+{
+    struct rfs_pwm_plan_t plan;
+
+    for (uint8_t i = 0; i < CASES_COUNT(PLANS); i++) {
+        rfs_pwm_plan(&plan, PLANS[i].timer, PLANS[i].frequency, CPU_FREQUENCY, PLANS[i].min_steps);
+        CHECK_EQ(plan.timer, PLANS[i].timer);
+        CHECK_EQ(plan.clock, PLANS[i].clock);
+        CHECK_EQ(plan.mode, PLANS[i].mode);
+        CHECK_EQ(plan.top, PLANS[i].top);
+        CHECK_EQ(plan.steps, PLANS[i].top + 1);
+        CHECK_EQ(plan.frequency, PLANS[i].obtained_frequency);
+    }
+
+    // No configuration with enough steps
+    rfs_pwm_plan(&plan, RFS_TIMER0, 1000, CPU_FREQUENCY, 257);
+    CHECK_EQ(plan.steps, 0);
+    CHECK_EQ(plan.top, 0);
+    CHECK_EQ(plan.period, 0);
+    CHECK_EQ(plan.frequency, 0);
+    rfs_pwm_plan(&plan, RFS_TIMER1, 0, CPU_FREQUENCY, 2);
+    CHECK_EQ(plan.steps, 0);
+    CHECK_EQ(plan.clock, 0);
+    CHECK_EQ(plan.mode, 0);
+}
+
+void test_set_plan()
+{
+    struct rfs_pwm_t pwm;
+    struct rfs_pwm_plan_t plan;
+
+    rfs_pwm_init(&pwm, RFS_TIMER1, RFS_PWM_CHANNEL_A);
+    rfs_pwm_plan(&plan, RFS_TIMER1, 50, CPU_FREQUENCY, 1000);
+    rfs_pwm_set_plan(&pwm, &plan);
+    CHECK_EQ(TCCR1A, RFS_TIMER_COMA_NONINVERT | 0b10);
+    CHECK_EQ(TCCR1B, 0b11000 | 2);
+    CHECK_EQ(ICR1, 39999);
+
+    rfs_pwm_init(&pwm, RFS_TIMER2, RFS_PWM_CHANNEL_B);
+    rfs_pwm_plan(&plan, RFS_TIMER2, 1000, CPU_FREQUENCY, 100);
+    rfs_pwm_set_plan(&pwm, &plan);
+    CHECK_EQ(TCCR2A, RFS_TIMER_COMB_NONINVERT | 0b01);
+    CHECK_EQ(TCCR2B, 0b01000 | 3);
+    CHECK_EQ(OCR2A, 250);
+
+    // With TOP 255, OCR0A is left for channel A
+    rfs_pwm_init(&pwm, RFS_TIMER0, RFS_PWM_CHANNEL_A);
+    rfs_pwm_set_duty_cycle_8(&pwm, 10);
+    rfs_pwm_plan(&plan, RFS_TIMER0, 62500, CPU_FREQUENCY, 2);
+    rfs_pwm_set_plan(&pwm, &plan);
+    CHECK_EQ(TCCR0A, RFS_TIMER_COMA_NONINVERT | 0b11);
+    CHECK_EQ(TCCR0B, 1);
+    CHECK_EQ(OCR0A, 10);
+}
+
+void test_static_init()
+{
+    pwm0a_init();
+    CHECK_EQ(DDRD, _BV(6));
+    CHECK_EQ(TCCR0A, RFS_TIMER_COMA_NONINVERT);
+    pwm0b_init();
+    CHECK_EQ(DDRD, _BV(6) | _BV(5));
+    CHECK_EQ(TCCR0A, RFS_TIMER_COMA_NONINVERT | RFS_TIMER_COMB_NONINVERT);
+    pwm1a_init();
+    pwm1b_init();
+    CHECK_EQ(DDRB, _BV(1) | _BV(2));
+    CHECK_EQ(TCCR1A, RFS_TIMER_COMA_NONINVERT | RFS_TIMER_COMB_NONINVERT);
+    pwm2a_init();
+    CHECK_EQ(DDRB, _BV(1) | _BV(2) | _BV(3));
+    CHECK_EQ(TCCR2A, RFS_TIMER_COMA_NONINVERT);
+    pwm2b_init();
+    CHECK_EQ(DDRD, _BV(6) | _BV(5) | _BV(3));
+    CHECK_EQ(TCCR2A, RFS_TIMER_COMA_NONINVERT | RFS_TIMER_COMB_NONINVERT);
+}
+
+void test_static_set_frequency()
+{
+    // The same registers as rfs_pwm_set_plan in test_set_plan
+    pwm1a_init();
+    pwm1a_set_frequency(50, CPU_FREQUENCY, 1000);
+    CHECK_EQ(TCCR1A, RFS_TIMER_COMA_NONINVERT | 0b10);
+    CHECK_EQ(TCCR1B, 0b11000 | 2);
+    CHECK_EQ(ICR1, 39999);
+
+    pwm2b_init();
+    pwm2b_set_frequency(1000, CPU_FREQUENCY, 100);
+    CHECK_EQ(TCCR2A, RFS_TIMER_COMB_NONINVERT | 0b01);
+    CHECK_EQ(TCCR2B, 0b01000 | 3);
+    CHECK_EQ(OCR2A, 250);
+
+    pwm0a_init();
+    pwm0a_set_duty_cycle(10);
+    pwm0a_set_frequency(62500, CPU_FREQUENCY, 2);
+    CHECK_EQ(TCCR0A, RFS_TIMER_COMA_NONINVERT | 0b11);
+    CHECK_EQ(TCCR0B, 1);
+    CHECK_EQ(OCR0A, 10);
+
+    // Without enough steps, the registers are not changed
+    pwm0a_set_frequency(1000, CPU_FREQUENCY, 257);
+    CHECK_EQ(TCCR0A, RFS_TIMER_COMA_NONINVERT | 0b11);
+    CHECK_EQ(TCCR0B, 1);
+}
+
+void test_static_set_duty_cycle()
+{
+    pwm0b_set_duty_cycle(128);
+    CHECK_EQ(OCR0B, 128);
+    CHECK_EQ(OCR0A, 0);
+    pwm1a_set_duty_cycle(32768);
+    CHECK_EQ(OCR1A, 32768);
+    CHECK_EQ(OCR1B, 0);
+    pwm1b_set_duty_cycle(1000);
+    CHECK_EQ(OCR1B, 1000);
+    pwm2a_set_duty_cycle(200);
+    CHECK_EQ(OCR2A, 200);
+    CHECK_EQ(OCR2B, 0);
+}
+
+void test_static_close()
+{
+    pwm2a_init();
+    pwm2b_init();
+    pwm2b_set_frequency(1000, CPU_FREQUENCY, 100);
+    pwm2a_close();
+    // The other channel keeps its output
+    CHECK_EQ(TCCR2A, RFS_TIMER_COMB_NONINVERT);
+    CHECK_EQ(TCCR2B, 0);
+    pwm2b_close();
+    CHECK_EQ(TCCR2A, 0);
+}
+
+void test_group()
+{
+    struct rfs_pwm_t pwm0b, pwm1a, pwm2b;
+    struct rfs_pwm_group_t group;
+    struct rfs_pwm_group_slot_t slots[3];
+
+    rfs_pwm_init(&pwm0b, RFS_TIMER0, RFS_PWM_CHANNEL_B);
+    rfs_pwm_init(&pwm1a, RFS_TIMER1, RFS_PWM_CHANNEL_A);
+    rfs_pwm_init(&pwm2b, RFS_TIMER2, RFS_PWM_CHANNEL_B);
+    rfs_pwm_group_init(&group, slots, 2);
+    CHECK_EQ(rfs_pwm_group_add(&group, &pwm1a), 1);
+    CHECK_EQ(rfs_pwm_group_add(&group, &pwm0b), 1);
+    CHECK_EQ(rfs_pwm_group_add(&group, &pwm2b), 0);
+    group.capacity = 3;
+    CHECK_EQ(rfs_pwm_group_add(&group, &pwm2b), 1);
+
+    // Nothing to write
+    CHECK_EQ(rfs_pwm_group_poll(&group), 1);
+
+    rfs_pwm_group_set(&group, 0, 30000);
+    rfs_pwm_group_set(&group, 1, 100);
+    rfs_pwm_group_set(&group, 2, 200);
+    CHECK_EQ(OCR1A, 0);
+    rfs_pwm_group_commit(&group);
+    CHECK(group.pending);
+
+    // The registers are plain memory, so clear the overflow flag of timer 1 like the microcontroller would
+    TIFR1 = 0;
+    CHECK_EQ(rfs_pwm_group_poll(&group), 0);
+    CHECK_EQ(OCR1A, 0);
+    CHECK_EQ(OCR0B, 0);
+    CHECK_EQ(OCR2B, 0);
+
+    // The other timers' flags are not used
+    TIFR0 = _BV(TOV0);
+    CHECK_EQ(rfs_pwm_group_poll(&group), 0);
+
+    TIFR1 = _BV(TOV1);
+    CHECK_EQ(rfs_pwm_group_poll(&group), 1);
+    CHECK_EQ(OCR1A, 30000);
+    CHECK_EQ(OCR0B, 100);
+    CHECK_EQ(OCR2B, 200);
+    CHECK_EQ(OCR0A, 0);
+    CHECK_EQ(OCR2A, 0);
+    CHECK(!group.pending);
+}
+
+void test_group_empty()
+{
+    struct rfs_pwm_group_t group;
+    struct rfs_pwm_group_slot_t slots[1];
+
+    // Without signals there is no overflow flag, so the commit and the poll have nothing to do
+    rfs_pwm_group_init(&group, slots, 1);
+    rfs_pwm_group_commit(&group);
+    CHECK(!group.pending);
+    CHECK_EQ(rfs_pwm_group_poll(&group), 1);
+    group.pending = 1;
+    CHECK_EQ(rfs_pwm_group_poll(&group), 1);
+    CHECK(!group.pending);
+}
+
+void test_group_sync()
+{
+    struct rfs_pwm_t pwm0a, pwm1b;
+    struct rfs_pwm_group_t group;
+    struct rfs_pwm_group_slot_t slots[2];
+
+    rfs_pwm_init(&pwm0a, RFS_TIMER0, RFS_PWM_CHANNEL_A);
+    rfs_pwm_init(&pwm1b, RFS_TIMER1, RFS_PWM_CHANNEL_B);
+    rfs_pwm_group_init(&group, slots, 2);
+    rfs_pwm_group_add(&group, &pwm0a);
+    rfs_pwm_group_add(&group, &pwm1b);
+    TCNT0 = 10;
+    TCNT1 = 1000;
+    TCNT2 = 20;
+    rfs_pwm_group_sync(&group);
+    CHECK_EQ(TCNT0, 0);
+    CHECK_EQ(TCNT1, 0);
+    // Timer 2 is not in the group
+    CHECK_EQ(TCNT2, 20);
+    CHECK_EQ(GTCCR, 0);
+}
+
+void test_get_top()
+{
+    struct rfs_pwm_t pwm;
+
+    rfs_pwm_init(&pwm, RFS_TIMER0, RFS_PWM_CHANNEL_B);
+    CHECK_EQ(rfs_pwm_get_top(&pwm), 0xff);
+    rfs_pwm_set_frequency(&pwm, 20000, CPU_FREQUENCY);
+    CHECK_EQ(rfs_pwm_get_top(&pwm), OCR0A);
+
+    rfs_pwm_init(&pwm, RFS_TIMER1, RFS_PWM_CHANNEL_A);
+    CHECK_EQ(rfs_pwm_get_top(&pwm), 0xffff);
+    rfs_pwm_set_frequency_hint(&pwm, 15000, CPU_FREQUENCY);
+    CHECK_EQ(rfs_pwm_get_top(&pwm), 0x3ff);
+    rfs_pwm_set_frequency_hint(&pwm, 62500, CPU_FREQUENCY);
+    CHECK_EQ(rfs_pwm_get_top(&pwm), 0xff);
+    rfs_pwm_set_frequency(&pwm, 50, CPU_FREQUENCY);
+    CHECK_EQ(rfs_pwm_get_top(&pwm), ICR1);
+}
+
+void test_retune()
+{
+    struct rfs_pwm_t pwm;
+    struct rfs_pwm_plan_t plan;
+    struct rfs_pwm_retune_t retune = {0};
+
+    // Servo at 50 Hz with a pulse of 1.5 ms, changed to 100 Hz
+    rfs_pwm_init(&pwm, RFS_TIMER1, RFS_PWM_CHANNEL_A);
+    rfs_pwm_plan(&plan, RFS_TIMER1, 50, CPU_FREQUENCY, 1000);
+    rfs_pwm_set_plan(&pwm, &plan);
+    rfs_pwm_set_duty_cycle_16(&pwm, 3000);
+    rfs_pwm_plan(&plan, RFS_TIMER1, 100, CPU_FREQUENCY, 1000);
+    rfs_pwm_retune(&retune, &pwm, &plan);
+
+    // The registers are plain memory, so clear the overflow flag like the microcontroller would
+    TIFR1 = 0;
+    CHECK_EQ(rfs_pwm_retune_poll(&retune), 0);
+    CHECK_EQ(ICR1, 39999);
+    CHECK_EQ(OCR1A, 3000);
+
+    // First step: only the double buffered duty cycle
+    TIFR1 = _BV(TOV1);
+    CHECK_EQ(rfs_pwm_retune_poll(&retune), 0);
+    CHECK_EQ(ICR1, 39999);
+    CHECK_EQ(OCR1A, 1500);
+    TIFR1 = 0;
+    CHECK_EQ(rfs_pwm_retune_poll(&retune), 0);
+
+    // Second step: ICR1 is only written in the first half of both periods
+    TIFR1 = _BV(TOV1);
+    TCNT1 = 39999;
+    CHECK_EQ(rfs_pwm_retune_poll(&retune), 0);
+    TCNT1 = 10000;
+    CHECK_EQ(rfs_pwm_retune_poll(&retune), 0);
+    TCNT1 = 10;
+    CHECK_EQ(rfs_pwm_retune_poll(&retune), 1);
+    CHECK_EQ(ICR1, 19999);
+    CHECK_EQ(OCR1A, 1500);
+    CHECK_EQ(TCCR1B & CLOCK_MASK, 2);
+    CHECK_EQ(rfs_pwm_retune_poll(&retune), 1);
+
+    // 8-bit timer, from 250 to 100 steps, 40%
+    rfs_pwm_init(&pwm, RFS_TIMER2, RFS_PWM_CHANNEL_B);
+    rfs_pwm_plan(&plan, RFS_TIMER2, 1000, CPU_FREQUENCY, 100);
+    rfs_pwm_set_plan(&pwm, &plan);
+    rfs_pwm_set_duty_cycle_8(&pwm, 100);
+    rfs_pwm_plan(&plan, RFS_TIMER2, 20000, CPU_FREQUENCY, 100);
+    CHECK_EQ(plan.top, 99);
+    rfs_pwm_retune(&retune, &pwm, &plan);
+    TIFR2 = 0;
+    CHECK_EQ(rfs_pwm_retune_poll(&retune), 0);
+    TIFR2 = _BV(TOV2);
+    CHECK_EQ(rfs_pwm_retune_poll(&retune), 0);
+    CHECK_EQ(OCR2A, 99);
+    CHECK_EQ(OCR2B, 40);
+    CHECK((TCCR2B & CLOCK_MASK) != plan.clock);
+    CHECK_EQ(rfs_pwm_retune_poll(&retune), 1);
+    CHECK_EQ(TCCR2B & CLOCK_MASK, plan.clock);
+}
+
+/**
+ * Model of a running timer that generates the PWM signal of one channel, advanced one CPU cycle at a time. The
+ * duty cycle registers, and OCRA of the 8-bit timers, are double buffered: the model keeps their values from the last
+ * update. ICR1 and the mode and clock bits are read on every tick, like the microcontroller does. Every period, from
+ * BOTTOM to BOTTOM, is logged with its length and the cycles with a high output, both in CPU cycles.
+ */
+#define MODEL_PERIODS       16
+#define MODEL_POLL_INTERVAL 200
+
+struct timer_model_t {
+    const struct rfs_pwm_t *pwm;
+    uint16_t prescaler;
+    uint16_t ocra;
+    uint16_t duty;
+    uint8_t down;
+    uint32_t cycles;
+    uint32_t high;
+    uint8_t periods;
+    uint32_t period_cycles[MODEL_PERIODS];
+    uint32_t period_high[MODEL_PERIODS];
+};
+
+static uint8_t model_timer1(const struct timer_model_t *model)
+{
+    return model->pwm->timer.cra == &TCCR1A;
+}
+
+static uint8_t model_fast(const struct timer_model_t *model)
+{
+    return model_timer1(model) ? (TCCR1B & _BV(WGM12)) : (*model->pwm->timer.cra & _BV(WGM01));
+}
+
+static void model_update(struct timer_model_t *model)
+{
+    if (model_timer1(model)) {
+        model->duty = *model->pwm->ocr16;
+    } else {
+        model->ocra = *model->pwm->timer.ocra8;
+        model->duty = *model->pwm->ocr8;
+    }
+}
+
+static void model_init(struct timer_model_t *model, const struct rfs_pwm_t *pwm)
+{
+    model->pwm = pwm;
+    model->prescaler = 0;
+    model->down = 0;
+    model->cycles = 0;
+    model->high = 0;
+    model->periods = 0;
+    if (model_timer1(model)) {
+        TCNT1 = 0;
+    } else {
+        *rfs_timer_cnt_8(&pwm->timer) = 0;
+    }
+    model_update(model);
+}
+
+static void model_tick(struct timer_model_t *model)
+{
+    const uint8_t timer1 = model_timer1(model);
+    volatile uint8_t *tifr = &TIFR0 + (timer1 ? 1 : (model->pwm->timer.cra == &TCCR0A) ? 0 : 2);
+    const uint16_t max = timer1 ? 0xffff : 0xff;
+    uint16_t top = max;
+    uint16_t count = timer1 ? TCNT1 : *rfs_timer_cnt_8(&model->pwm->timer);
+    uint8_t bottom = 0;
+
+    if (timer1) {
+        top = ICR1;
+    } else if (*rfs_timer_crb(&model->pwm->timer) & _BV(WGM02)) {
+        top = model->ocra;
+    }
+    if (model_fast(model)) {
+        // The counter is only cleared when it matches TOP, or overflows
+        if (count == top || count == max) {
+            count = 0;
+            bottom = 1;
+        } else {
+            count++;
+        }
+        if (count == top) {
+            *tifr |= _BV(TOV0);
+        }
+    } else if (!model->down) {
+        if (count == top || count == max) {
+            model->down = 1;
+            count--;
+            if (!timer1) {
+                // The phase correct mode of the 8-bit timers updates the registers at TOP
+                model_update(model);
+            }
+        } else {
+            count++;
+        }
+    } else if (--count == 0) {
+        model->down = 0;
+        bottom = 1;
+        *tifr |= _BV(TOV0);
+    }
+    if (timer1) {
+        TCNT1 = count;
+    } else {
+        *rfs_timer_cnt_8(&model->pwm->timer) = count;
+    }
+
+    if (bottom) {
+        if (model->periods < MODEL_PERIODS) {
+            model->period_cycles[model->periods] = model->cycles;
+            model->period_high[model->periods] = model->high;
+            model->periods++;
+        }
+        model->cycles = 0;
+        model->high = 0;
+        if (timer1 || model_fast(model)) {
+            model_update(model);
+        }
+    }
+}
+
+static void model_run(struct timer_model_t *model, uint32_t cycles)
+{
+    for (uint32_t i = 0; i < cycles; i++) {
+        const uint16_t count = model_timer1(model) ? TCNT1 : *rfs_timer_cnt_8(&model->pwm->timer);
+        const uint8_t clock = *rfs_timer_crb(&model->pwm->timer) & CLOCK_MASK;
+
+        // Non inverting output: cleared at the match, and in phase correct mode, set again at the match down
+        if ((model_fast(model) || model->down) ? (count <= model->duty) : (count < model->duty)) {
+            model->high++;
+        }
+        model->cycles++;
+        if (clock && ++model->prescaler >= rfs_list_get(*model->pwm->divisor_table, clock - 1)) {
+            model->prescaler = 0;
+            model_tick(model);
+        }
+    }
+}
+
+static uint32_t model_high(const struct rfs_pwm_plan_t *plan, const struct rfs_pwm_t *pwm, uint16_t duty)
+{
+    const uint32_t divisor = rfs_list_get(*pwm->divisor_table, plan->clock - 1);
+    const uint8_t fast = (plan->timer == RFS_TIMER1) ? (plan->mode & 0b01000) : (plan->mode & 0b00010);
+
+    return fast ? (duty + 1UL) * divisor : 2UL * duty * divisor;
+}
+
+/**
+ * Retune a running signal, polling every MODEL_POLL_INTERVAL cycles, and check that every period has either the
+ * previous configuration or the new one. A change of clock divisor makes the first new period differ by up to
+ * tolerance cycles.
+ */
+static void check_retune(enum rfs_timer_enum timer, enum rfs_pwm_channel channel, uint32_t frequency,
+    uint32_t new_frequency, uint32_t min_steps, uint32_t tolerance)
+{
+    struct rfs_pwm_t pwm;
+    struct rfs_pwm_plan_t plan, new_plan;
+    struct rfs_pwm_retune_t retune = {0};
+    struct timer_model_t model;
+
+    rfs_native_reset();
+    rfs_pwm_init(&pwm, timer, channel);
+    rfs_pwm_plan(&plan, timer, frequency, CPU_FREQUENCY, min_steps);
+    rfs_pwm_plan(&new_plan, timer, new_frequency, CPU_FREQUENCY, min_steps);
+    rfs_pwm_set_plan(&pwm, &plan);
+    const uint16_t duty = plan.top / 4;
+    if (timer == RFS_TIMER1) {
+        rfs_pwm_set_duty_cycle_16(&pwm, duty);
+    } else {
+        rfs_pwm_set_duty_cycle_8(&pwm, duty);
+    }
+    model_init(&model, &pwm);
+    model_run(&model, 2 * plan.period + plan.period / 3);
+
+    // The registers are plain memory, so clear the overflow flag when it is written, like the microcontroller would
+    rfs_pwm_retune(&retune, &pwm, &new_plan);
+    *retune.tifr = 0;
+    for (;;) {
+        const uint8_t pending = retune.pending;
+        if (rfs_pwm_retune_poll(&retune)) {
+            break;
+        }
+        if (retune.pending != pending) {
+            *retune.tifr = 0;
+        }
+        model_run(&model, MODEL_POLL_INTERVAL);
+    }
+    const uint16_t new_duty = (timer == RFS_TIMER1) ? *pwm.ocr16 : *pwm.ocr8;
+    model_run(&model, 3 * new_plan.period);
+
+    const uint32_t high = model_high(&plan, &pwm, duty);
+    const uint32_t new_high = model_high(&new_plan, &pwm, new_duty);
+    uint8_t changed = 0;
+    CHECK(model.periods >= 6);
+    for (uint8_t i = 0; i < model.periods; i++) {
+        const uint32_t cycles = model.period_cycles[i];
+        const uint32_t period_high = model.period_high[i];
+        if (!changed && cycles == plan.period && period_high == high) {
+            continue;
+        }
+        const uint32_t slack = changed ? 0 : tolerance;
+        if (!(cycles + slack >= new_plan.period && cycles <= new_plan.period + slack
+            && period_high + slack >= new_high && period_high <= new_high + slack)) {
+            fprintf(stderr, "period %u: %lu cycles, %lu high, expected %lu and %lu, or %lu and %lu\n", i,
+                (unsigned long)cycles, (unsigned long)period_high, (unsigned long)plan.period, (unsigned long)high,
+                (unsigned long)new_plan.period, (unsigned long)new_high);
+            CHECK(0);
+        }
+        changed = 1;
+    }
+    CHECK(changed);
+}
+
+void test_retune_periods()
+{
+    // Timer 1, shorter and longer TOP, with both channels
+    check_retune(RFS_TIMER1, RFS_PWM_CHANNEL_A, 50, 100, 1000, 0);
+    check_retune(RFS_TIMER1, RFS_PWM_CHANNEL_B, 100, 50, 1000, 0);
+    // Timer 1 in phase and frequency correct mode
+    check_retune(RFS_TIMER1, RFS_PWM_CHANNEL_A, 200, 150, 1000, 0);
+    check_retune(RFS_TIMER1, RFS_PWM_CHANNEL_B, 150, 200, 1000, 0);
+    // A new clock divisor is written some ticks after the start of the first new period
+    check_retune(RFS_TIMER1, RFS_PWM_CHANNEL_A, 50, 500, 1000, MODEL_POLL_INTERVAL);
+    // 8-bit timer, TOP in OCR2A
+    check_retune(RFS_TIMER2, RFS_PWM_CHANNEL_B, 20000, 10000, 100, 0);
+    check_retune(RFS_TIMER2, RFS_PWM_CHANNEL_B, 10000, 20000, 100, 0);
+}
+
+void test_retune_stopped()
+{
+    struct rfs_pwm_t pwm;
+    struct rfs_pwm_plan_t plan;
+    struct rfs_pwm_retune_t retune = {0};
+
+    // The timer has no clock, so the configuration is written without waiting for an overflow
+    rfs_pwm_init(&pwm, RFS_TIMER0, RFS_PWM_CHANNEL_B);
+    rfs_pwm_set_duty_cycle_8(&pwm, 128);
+    rfs_pwm_plan(&plan, RFS_TIMER0, 62500, CPU_FREQUENCY, 2);
+    rfs_pwm_retune(&retune, &pwm, &plan);
+    TIFR0 = 0;
+    CHECK_EQ(rfs_pwm_retune_poll(&retune), 1);
+    CHECK_EQ(TCCR0B & CLOCK_MASK, 1);
+    CHECK_EQ(OCR0B, 128);
+}
+
+int main()
+{
+    RUN(test_init);
+    RUN(test_close);
+    RUN(test_set_frequency_hint);
+    RUN(test_set_frequency);
+    RUN(test_set_duty_cycle);
+    RUN(test_plan);
+    RUN(test_set_plan);
+    RUN(test_static_init);
+    RUN(test_static_set_frequency);
+    RUN(test_static_set_duty_cycle);
+    RUN(test_static_close);
+    RUN(test_group);
+    RUN(test_group_empty);
+    RUN(test_group_sync);
+    RUN(test_get_top);
+    RUN(test_retune);
+    RUN(test_retune_stopped);
+    RUN(test_retune_periods);
+    return unit_result();
+}
@@ -0,0 +1,198 @@
+/*
+unitservo.c - Unit tests of the servo bank, for the native build
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+/*
+The counter of timer 1 doesn't run on the simulated registers, so the tests set it to the times of the pulse edges.
+The wait for the start of the frame can't be tested here, it is tested in simavr by testservo.py.
+*/
+
+#include "rfsavr/servo.h"
+#include "unittests.h"
+
+#define CPU_FREQUENCY 16000000UL
+
+static const struct rfs_pin_t PINS[] = {
+    {&PORTB, 0},
+    {&PORTD, 7},
+    {&PORTB, 4},
+    {&PORTC, 2},
+};
+
+#define SERVOS_COUNT    (sizeof(PINS) / sizeof(PINS[0]))
+
+static struct rfs_servo_bank_t bank;
+static struct rfs_servo_t servos[SERVOS_COUNT];
+
+static void init_bank()
+{
+    rfs_servo_bank_init(&bank, servos, SERVOS_COUNT, CPU_FREQUENCY);
+    for (uint8_t i = 0; i < SERVOS_COUNT; i++) {
+        rfs_servo_bank_add(&bank, &PINS[i]);
+    }
+}
+
+void test_init()
+{
+    init_bank();
+    // CTC mode with TOP in ICR1 and a clock divisor of 8: 2 ticks per microsecond
+    CHECK_EQ(TCCR1A, 0);
+    CHECK_EQ(TCCR1B, _BV(WGM13) | _BV(WGM12) | _BV(CS11));
+    CHECK_EQ(ICR1, 39999);
+    CHECK_EQ(DDRB, _BV(0) | _BV(4));
+    CHECK_EQ(DDRC, _BV(2));
+    CHECK_EQ(DDRD, _BV(7));
+    CHECK_EQ(rfs_servo_bank_add(&bank, &PINS[0]), 0);
+
+    // No servo is enabled
+    CHECK_EQ(rfs_servo_bank_poll(&bank), 1);
+    CHECK_EQ(bank.first, RFS_SERVO_NONE);
+}
+
+void test_set_angle()
+{
+    init_bank();
+    rfs_servo_bank_set_angle(&bank, 0, 0);
+    CHECK_EQ(servos[0].ticks, 2000);
+    rfs_servo_bank_set_angle(&bank, 0, RFS_SERVO_DEGREES(90));
+    CHECK_EQ(servos[0].ticks, 3000);
+    rfs_servo_bank_set_angle(&bank, 0, RFS_SERVO_DEGREES(22.5));
+    CHECK_EQ(servos[0].ticks, 2250);
+    rfs_servo_bank_set_angle(&bank, 0, RFS_SERVO_DEGREES(200));
+    CHECK_EQ(servos[0].ticks, 4000);
+    CHECK_EQ(servos[0].angle, RFS_SERVO_ANGLE_MAX);
+
+    rfs_servo_bank_set_range(&bank, 500, 2500);
+    CHECK_EQ(servos[0].ticks, 5000);
+    CHECK_EQ(servos[1].ticks, 0);
+    rfs_servo_bank_set_angle(&bank, 1, RFS_SERVO_DEGREES(45));
+    CHECK_EQ(servos[1].ticks, 2000);
+
+    rfs_servo_bank_disable(&bank, 0);
+    CHECK_EQ(servos[0].ticks, 0);
+}
+
+void test_sort()
+{
+    init_bank();
+    rfs_servo_bank_set_angle(&bank, 0, RFS_SERVO_DEGREES(180));
+    rfs_servo_bank_set_angle(&bank, 1, RFS_SERVO_DEGREES(90));
+    rfs_servo_bank_set_angle(&bank, 2, 0);
+    rfs_servo_bank_set_angle(&bank, 3, RFS_SERVO_DEGREES(90));
+
+    // Far from the start of the frame, the list is built and nothing else happens
+    CHECK_EQ(rfs_servo_bank_poll(&bank), 1);
+    CHECK_EQ(bank.dirty, 0);
+    CHECK_EQ(bank.first, 2);
+    CHECK_EQ(servos[2].next, 1);
+    CHECK_EQ(servos[1].next, 3);
+    CHECK_EQ(servos[3].next, 0);
+    CHECK_EQ(servos[0].next, RFS_SERVO_NONE);
+    CHECK_EQ(servos[2].edge, 1999);
+    CHECK_EQ(servos[0].edge, 3999);
+    CHECK_EQ(bank.ports_count, 3);
+    CHECK(bank.ports[0].port == &PORTB);
+    CHECK_EQ(bank.ports[0].mask, _BV(0) | _BV(4));
+    CHECK(bank.ports[1].port == &PORTD);
+    CHECK_EQ(bank.ports[1].mask, _BV(7));
+    CHECK(bank.ports[2].port == &PORTC);
+    CHECK_EQ(bank.ports[2].mask, _BV(2));
+    CHECK_EQ(PORTB | PORTC | PORTD, 0);
+
+    // A disabled servo is left out
+    rfs_servo_bank_disable(&bank, 1);
+    rfs_servo_bank_poll(&bank);
+    CHECK_EQ(servos[2].next, 3);
+    CHECK_EQ(bank.ports[1].port == &PORTD, 0);
+}
+
+void test_late_frame()
+{
+    init_bank();
+    rfs_servo_bank_set_angle(&bank, 0, RFS_SERVO_DEGREES(90));
+
+    // The frame started before the call: no pulses in this frame
+    TCNT1 = 10;
+    TIFR1 = _BV(ICF1);
+    CHECK_EQ(rfs_servo_bank_poll(&bank), 1);
+    CHECK_EQ(bank.next, RFS_SERVO_NONE);
+    CHECK_EQ(PORTB, 0);
+}
+
+void test_pulses()
+{
+    init_bank();
+    rfs_servo_bank_set_angle(&bank, 0, RFS_SERVO_DEGREES(180));
+    rfs_servo_bank_set_angle(&bank, 1, RFS_SERVO_DEGREES(90));
+    rfs_servo_bank_set_angle(&bank, 2, 0);
+    rfs_servo_bank_set_angle(&bank, 3, RFS_SERVO_DEGREES(90));
+    rfs_servo_bank_poll(&bank);
+
+    // Start the pulses like rfs_servo_bank_poll does at the start of the frame
+    PORTB = _BV(0) | _BV(4);
+    PORTC = _BV(2);
+    PORTD = _BV(7);
+    bank.next = bank.first;
+
+    TCNT1 = 0;
+    CHECK_EQ(rfs_servo_bank_poll(&bank), 0);
+    CHECK_EQ(PORTB, _BV(0) | _BV(4));
+
+    // The pulses of 1 ms and the two of 1.5 ms end in the same call, the one of 2 ms is beyond the guard time
+    TCNT1 = 2999;
+    CHECK_EQ(rfs_servo_bank_poll(&bank), 0);
+    CHECK_EQ(PORTB, _BV(0));
+    CHECK_EQ(PORTC, 0);
+    CHECK_EQ(PORTD, 0);
+
+    // A new angle is used from the next frame
+    rfs_servo_bank_set_angle(&bank, 0, 0);
+    TCNT1 = 3999;
+    CHECK_EQ(rfs_servo_bank_poll(&bank), 1);
+    CHECK_EQ(PORTB, 0);
+    CHECK_EQ(bank.next, RFS_SERVO_NONE);
+
+    TCNT1 = 5000;
+    rfs_servo_bank_poll(&bank);
+    CHECK_EQ(bank.first, 0);
+    CHECK_EQ(servos[0].edge, 1999);
+}
+
+void test_close()
+{
+    init_bank();
+    PORTB = _BV(0) | _BV(4);
+    rfs_servo_bank_close(&bank);
+    CHECK_EQ(PORTB, 0);
+    CHECK_EQ(TCCR1A, 0);
+    CHECK_EQ(TCCR1B, 0);
+}
+
+int main()
+{
+    RUN(test_init);
+    RUN(test_set_angle);
+    RUN(test_sort);
+    RUN(test_late_frame);
+    RUN(test_pulses);
+    RUN(test_close);
+    return unit_result();
+}
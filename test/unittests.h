@@ -0,0 +1,88 @@
+/*
+unittests.h - Helpers for the unit tests of the native build
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+/*
+The unit tests are compiled for the build machine (configure --enable-native) and linked with librfsavr-native, where
+the I/O registers are plain memory (see src/native/avr/io.h). Each test program returns 0 if all the checks pass, or 1
+otherwise, as expected by the automake test driver.
+*/
+
+#ifndef RFS_UNITTESTS_H
+#define RFS_UNITTESTS_H
+
+#include <avr/io.h>
+#include <stdio.h>
+
+/**
+ * @brief Number of failed checks in the test program
+ */
+static int unit_failures = 0;
+
+/**
+ * @brief Check that a condition is true
+ */
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            unit_failures++; \
+        } \
+    } while (0)
+
+/**
+ * @brief Check that an integer value is the expected one
+ */
+#define CHECK_EQ(value, expected) \
+    do { \
+        const long long unit_value = (value); \
+        const long long unit_expected = (expected); \
+        if (unit_value != unit_expected) { \
+            fprintf(stderr, "%s:%d: check failed: %s == %s (0x%llx != 0x%llx)\n", __FILE__, __LINE__, #value, #expected, \
+                unit_value, unit_expected); \
+            unit_failures++; \
+        } \
+    } while (0)
+
+/**
+ * @brief Run a test function with all the registers at their reset value
+ */
+#define RUN(test) \
+    do { \
+        rfs_native_reset(); \
+        test(); \
+    } while (0)
+
+/**
+ * @brief The interrupt handlers of the library, called by the tests to simulate the interrupts
+ */
+void USART_RX_vect(void);
+void USART_UDRE_vect(void);
+
+/**
+ * @brief Return the exit status of the test program
+ */
+static inline int unit_result(void)
+{
+    return unit_failures ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,159 @@
+/*
+unittimers.c - Unit tests of the timers, for the native build
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+#include "rfsavr/timers.h"
+#include "unittests.h"
+
+void test_init()
+{
+    struct rfs_timer_t timer;
+
+    rfs_timer_init(&timer, RFS_TIMER0);
+    CHECK(timer.cra == &TCCR0A);
+    CHECK(rfs_timer_crb(&timer) == &TCCR0B);
+    CHECK(timer.ocra8 == &OCR0A);
+    CHECK(timer.ocrb8 == &OCR0B);
+    CHECK(rfs_timer_cnt_8(&timer) == &TCNT0);
+
+    rfs_timer_init(&timer, RFS_TIMER1);
+    CHECK(timer.cra == &TCCR1A);
+    CHECK(rfs_timer_crb(&timer) == &TCCR1B);
+    CHECK(rfs_timer_crc(&timer) == &TCCR1C);
+    CHECK(timer.ocra16 == &OCR1A);
+    CHECK(timer.ocrb16 == &OCR1B);
+    CHECK(rfs_timer_cnt_16(&timer) == &TCNT1);
+    CHECK(rfs_timer_icr(&timer) == &ICR1);
+
+    rfs_timer_init(&timer, RFS_TIMER2);
+    CHECK(timer.cra == &TCCR2A);
+    CHECK(rfs_timer_crb(&timer) == &TCCR2B);
+    CHECK(timer.ocra8 == &OCR2A);
+    CHECK(timer.ocrb8 == &OCR2B);
+    CHECK(rfs_timer_cnt_8(&timer) == &TCNT2);
+}
+
+void test_set_mode_8()
+{
+    struct rfs_timer_t timer;
+
+    rfs_timer_init(&timer, RFS_TIMER0);
+    TCCR0A = _BV(COM0A1);
+    TCCR0B = _BV(CS01);
+    rfs_timer_set_mode_8(&timer, RFS_TIMER8_MODE_FAST_PWM_OCRA);
+    CHECK_EQ(TCCR0A, _BV(COM0A1) | _BV(WGM01) | _BV(WGM00));
+    CHECK_EQ(TCCR0B, _BV(WGM02) | _BV(CS01));
+    CHECK_EQ(rfs_timer_get_mode(&timer), RFS_TIMER8_MODE_FAST_PWM_OCRA);
+
+    rfs_timer_set_mode_8(&timer, RFS_TIMER8_MODE_CTC);
+    CHECK_EQ(TCCR0A, _BV(COM0A1) | _BV(WGM01));
+    CHECK_EQ(TCCR0B, _BV(CS01));
+}
+
+void test_set_mode_16()
+{
+    struct rfs_timer_t timer;
+
+    rfs_timer_init(&timer, RFS_TIMER1);
+    rfs_timer_set_mode_16(&timer, RFS_TIMER16_MODE_FAST_PWM_ICR);
+    CHECK_EQ(TCCR1A, _BV(WGM11));
+    CHECK_EQ(TCCR1B, _BV(WGM13) | _BV(WGM12));
+    CHECK_EQ(rfs_timer_get_mode(&timer), RFS_TIMER16_MODE_FAST_PWM_ICR);
+}
+
+void test_set_clock()
+{
+    struct rfs_timer_t timer;
+
+    rfs_timer_init(&timer, RFS_TIMER2);
+    TCCR2B = _BV(WGM22) | _BV(CS22) | _BV(CS21) | _BV(CS20);
+    rfs_timer_set_clock(&timer, RFS_TIMER2_CLOCK_32);
+    CHECK_EQ(TCCR2B, _BV(WGM22) | _BV(CS21) | _BV(CS20));
+    rfs_timer_set_clock(&timer, RFS_TIMER_CLOCK_NONE);
+    CHECK_EQ(TCCR2B, _BV(WGM22));
+}
+
+void test_compare_match_output_mode()
+{
+    struct rfs_timer_t timer;
+
+    rfs_timer_init(&timer, RFS_TIMER0);
+    TCCR0A = _BV(WGM00);
+    rfs_timer_set_compare_match_output_mode_a(&timer, RFS_TIMER_COMA_INVERT);
+    rfs_timer_set_compare_match_output_mode_b(&timer, RFS_TIMER_COMB_TOGGLE);
+    CHECK_EQ(TCCR0A, _BV(COM0A1) | _BV(COM0A0) | _BV(COM0B0) | _BV(WGM00));
+    rfs_timer_set_compare_match_output_mode_a(&timer, RFS_TIMER_COMA_NORMAL);
+    CHECK_EQ(TCCR0A, _BV(COM0B0) | _BV(WGM00));
+}
+
+void test_registers_16()
+{
+    struct rfs_timer_t timer;
+
+    rfs_timer_init(&timer, RFS_TIMER1);
+    rfs_timer_set_16(&timer, 0x1234);
+    rfs_timer_set_icr(&timer, 0xbeef);
+    rfs_timer_set_ocra_16(&timer, 0x0102);
+    rfs_timer_set_ocrb_16(&timer, 0xa0b0);
+    CHECK_EQ(TCNT1H, 0x12);
+    CHECK_EQ(TCNT1L, 0x34);
+    CHECK_EQ(ICR1, 0xbeef);
+    CHECK_EQ(OCR1AH, 0x01);
+    CHECK_EQ(OCR1AL, 0x02);
+    CHECK_EQ(OCR1B, 0xa0b0);
+    CHECK_EQ(rfs_timer_get_16(&timer), 0x1234);
+}
+
+void test_width_16()
+{
+    struct rfs_timer_t timer;
+
+    // The counter and ICR are accessed as whole 16-bit registers, not only through their low byte
+    rfs_timer_init(&timer, RFS_TIMER1);
+    CHECK_EQ(sizeof(*rfs_timer_cnt_16(&timer)), 2);
+    CHECK_EQ(sizeof(*rfs_timer_icr(&timer)), 2);
+    TCNT1H = 0xab;
+    TCNT1L = 0xcd;
+    CHECK_EQ(rfs_timer_get_16(&timer), 0xabcd);
+    ICR1 = 0xffff;
+    OCR1A = 0x5555;
+    rfs_timer_set_icr(&timer, 0x0100);
+    CHECK_EQ(ICR1H, 0x01);
+    CHECK_EQ(ICR1L, 0x00);
+    // The registers that follow are left alone
+    CHECK_EQ(OCR1A, 0x5555);
+    rfs_timer_set_16(&timer, 0xff00);
+    CHECK_EQ(TCNT1H, 0xff);
+    CHECK_EQ(TCNT1L, 0x00);
+    CHECK_EQ(ICR1, 0x0100);
+}
+
+int main()
+{
+    RUN(test_init);
+    RUN(test_set_mode_8);
+    RUN(test_set_mode_16);
+    RUN(test_set_clock);
+    RUN(test_compare_match_output_mode);
+    RUN(test_registers_16);
+    RUN(test_width_16);
+    return unit_result();
+}
@@ -0,0 +1,378 @@
+/*
+unitusart.c - Unit tests of the USART, for the native build
+
+This file is part of RobotsFromScratch.
+
+Copyright 2023 Antonio Serrano Hernandez
+
+RobotsFromScratch is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RobotsFromScratch is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RobotsFromScratch; see the file COPYING.  If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+#include <avr/interrupt.h>
+
+#include "rfsavr/usart.h"
+#include "rfsavr/errno.h"
+#include "unittests.h"
+
+#define CPU_FREQUENCY 16000000UL
+
+void test_open()
+{
+    struct rfs_usart_t usart;
+
+    rfs_usart_open(&usart, RFS_USART_0, RFS_USART_ASYNC, RFS_USART_RXTX | RFS_USART_8BITS | RFS_USART_PARITYEVEN);
+    CHECK(usart.udr == &UDR0);
+    CHECK(usart.ubrr == &UBRR0);
+    CHECK_EQ(UCSR0B, _BV(RXEN0) | _BV(TXEN0));
+    CHECK_EQ(UCSR0C, _BV(UPM01) | _BV(UCSZ01) | _BV(UCSZ00));
+
+    rfs_native_reset();
+    rfs_usart_open(&usart, RFS_USART_0, RFS_USART_MASTERSPI, RFS_USART_TX | RFS_USART_SPI_LSBFIRST | RFS_USART_SPI_MODE3);
+    CHECK_EQ(UCSR0B, _BV(TXEN0));
+    CHECK_EQ(UCSR0C, _BV(UMSEL01) | _BV(UMSEL00) | _BV(UDORD0) | _BV(UCPHA0) | _BV(UCPOL0));
+    CHECK_EQ(UBRR0, 0);
+    CHECK_EQ(DDRD, _BV(DDD4));
+}
+
+void test_parity()
+{
+    struct rfs_usart_t usart;
+
+    // UPM0 = 00 is no parity, 10 is even parity and 11 is odd parity
+    rfs_usart_open(&usart, RFS_USART_0, RFS_USART_ASYNC, RFS_USART_RXTX | RFS_USART_8BITS);
+    CHECK_EQ(UCSR0C & (_BV(UPM01) | _BV(UPM00)), 0);
+    rfs_usart_open(&usart, RFS_USART_0, RFS_USART_ASYNC, RFS_USART_RXTX | RFS_USART_8BITS | RFS_USART_PARITYEVEN);
+    CHECK_EQ(UCSR0C & (_BV(UPM01) | _BV(UPM00)), _BV(UPM01));
+    rfs_usart_open(&usart, RFS_USART_0, RFS_USART_ASYNC, RFS_USART_RXTX | RFS_USART_7BITS | RFS_USART_PARITYODD
+        | RFS_USART_2STOPBITS);
+    CHECK_EQ(UCSR0C, _BV(UPM01) | _BV(UPM00) | _BV(USBS0) | _BV(UCSZ01));
+}
+
+void test_setspeed()
+{
+    struct rfs_usart_t usart;
+
+    rfs_usart_open(&usart, RFS_USART_0, RFS_USART_ASYNC, RFS_USART_RXTX | RFS_USART_8BITS);
+    rfs_usart_setspeed(&usart, RFS_USART_B19200, CPU_FREQUENCY);
+    CHECK_EQ(UBRR0, 51);
+    CHECK_EQ(UCSR0A & _BV(U2X0), 0);
+    rfs_usart_setspeed(&usart, RFS_USART_B115200, CPU_FREQUENCY);
+    CHECK_EQ(UBRR0, 16);
+    CHECK_EQ(UCSR0A & _BV(U2X0), _BV(U2X0));
+
+    // The flags are not written back, and the multi-processor mode is kept
+    UCSR0A = _BV(TXC0) | _BV(FE0) | _BV(MPCM0);
+    rfs_usart_setspeed(&usart, RFS_USART_B19200, CPU_FREQUENCY);
+    CHECK_EQ(UCSR0A, _BV(MPCM0));
+    rfs_usart_setspeed(&usart, RFS_USART_B115200, CPU_FREQUENCY);
+    CHECK_EQ(UCSR0A, _BV(MPCM0) | _BV(U2X0));
+}
+
+void test_getspeed()
+{
+    struct rfs_usart_speed_t speed;
+
+    rfs_usart_getspeed(&speed, RFS_USART_B9600, CPU_FREQUENCY);
+    CHECK_EQ(speed.ubrr, 103);
+    CHECK_EQ(speed.double_speed, 0);
+    CHECK_EQ(speed.baudrate, 9615);
+    CHECK_EQ(speed.error_ppm, 1602);
+
+    rfs_usart_getspeed(&speed, RFS_USART_B115200, CPU_FREQUENCY);
+    CHECK_EQ(speed.ubrr, 16);
+    CHECK_EQ(speed.double_speed, 1);
+    CHECK_EQ(speed.baudrate, 117647);
+    CHECK_EQ(speed.error_ppm, 21241);
+
+    rfs_usart_getspeed(&speed, 2000000, CPU_FREQUENCY);
+    CHECK_EQ(speed.ubrr, 0);
+    CHECK_EQ(speed.error_ppm, 0);
+
+    // Too slow: UBRR is clamped, and the error is too large for the product in 32 bits
+    rfs_usart_getspeed(&speed, RFS_USART_B50, 20000000);
+    CHECK_EQ(speed.ubrr, RFS_USART_UBRR_MAX);
+    CHECK_EQ(speed.double_speed, 0);
+    CHECK_EQ(speed.error_ppm, 5103515);
+
+    // Too fast: the closest UBRR is 0, and the obtained baudrate is slower
+    rfs_usart_getspeed(&speed, 4000000, CPU_FREQUENCY);
+    CHECK_EQ(speed.ubrr, 0);
+    CHECK_EQ(speed.double_speed, 1);
+    // -500000 ppm, with the precision lost when scaling such a large error
+    CHECK(speed.error_ppm > -500100 && speed.error_ppm < -499900);
+    CHECK_EQ(rfs_usart_getubrr(4000000, CPU_FREQUENCY, RFS_USART_NORMAL_SPEED), 0);
+}
+
+void test_read()
+{
+    struct rfs_usart_t usart;
+    char data = 0;
+
+    rfs_usart_open(&usart, RFS_USART_0, RFS_USART_ASYNC, RFS_USART_RXTX | RFS_USART_8BITS);
+    CHECK_EQ(rfs_usart_read(&usart, &data), 0);
+
+    UDR0 = 'a';
+    UCSR0A |= _BV(RXC0);
+    CHECK_EQ(rfs_usart_read(&usart, &data), 1);
+    CHECK_EQ(data, 'a');
+
+    UCSR0A |= _BV(FE0);
+    CHECK_EQ(rfs_usart_read(&usart, &data), -1);
+    CHECK_EQ(rfs_errno, RFS_EFRAME);
+    UCSR0A &= ~_BV(FE0);
+    UCSR0A |= _BV(DOR0);
+    CHECK_EQ(rfs_usart_read(&usart, &data), -1);
+    CHECK_EQ(rfs_errno, RFS_EOVERRUN);
+}
+
+void test_write()
+{
+    struct rfs_usart_t usart;
+
+    rfs_usart_open(&usart, RFS_USART_0, RFS_USART_ASYNC, RFS_USART_RXTX | RFS_USART_8BITS);
+    UCSR0A &= ~_BV(UDRE0);
+    CHECK_EQ(rfs_usart_write(&usart, 'x'), 0);
+    CHECK_EQ(UDR0, 0);
+    UCSR0A |= _BV(UDRE0);
+    CHECK_EQ(rfs_usart_write(&usart, 'x'), 1);
+    CHECK_EQ(UDR0, 'x');
+}
+
+void test_write9()
+{
+    struct rfs_usart_t usart;
+
+    rfs_usart_open(&usart, RFS_USART_0, RFS_USART_ASYNC, RFS_USART_RXTX | RFS_USART_9BITS);
+    CHECK_EQ(rfs_usart_write_address(&usart, 0x12), 1);
+    CHECK_EQ(UDR0, 0x12);
+    CHECK_EQ(UCSR0B & _BV(TXB80), _BV(TXB80));
+    CHECK_EQ(rfs_usart_write9(&usart, 0x34), 1);
+    CHECK_EQ(UDR0, 0x34);
+    CHECK_EQ(UCSR0B & _BV(TXB80), 0);
+
+    // The bytes written after an address are data frames
+    CHECK_EQ(rfs_usart_write_address(&usart, 0x12), 1);
+    CHECK_EQ(rfs_usart_write(&usart, 'a'), 1);
+    CHECK_EQ(UDR0, 'a');
+    CHECK_EQ(UCSR0B & _BV(TXB80), 0);
+    CHECK_EQ(rfs_usart_write_address(&usart, 0x12), 1);
+    CHECK_EQ(rfs_usart_write_buf(&usart, "bc", 2), 2);
+    CHECK_EQ(UDR0, 'c');
+    CHECK_EQ(UCSR0B & _BV(TXB80), 0);
+}
+
+void test_setmultiprocessor()
+{
+    struct rfs_usart_t usart;
+
+    rfs_usart_open(&usart, RFS_USART_0, RFS_USART_ASYNC, RFS_USART_RXTX | RFS_USART_9BITS);
+    // The flags are not written back: TXC0 would be cleared, and the error flags must be written as zero
+    UCSR0A = _BV(TXC0) | _BV(FE0) | _BV(DOR0) | _BV(UPE0) | _BV(U2X0);
+    rfs_usart_setmultiprocessor(&usart, 1);
+    CHECK_EQ(UCSR0A, _BV(U2X0) | _BV(MPCM0));
+    UCSR0A |= _BV(TXC0);
+    rfs_usart_setmultiprocessor(&usart, 0);
+    CHECK_EQ(UCSR0A, _BV(U2X0));
+}
+
+void test_spi_setspeed()
+{
+    struct rfs_usart_t usart;
+
+    rfs_usart_open(&usart, RFS_USART_0, RFS_USART_MASTERSPI, RFS_USART_RXTX);
+    // The clock is F_CPU / (2 * (UBRR + 1)), rounded down to the closest frequency that is not faster
+    CHECK_EQ(rfs_usart_spi_setspeed(&usart, 8000000, CPU_FREQUENCY), 8000000);
+    CHECK_EQ(UBRR0, 0);
+    CHECK_EQ(rfs_usart_spi_setspeed(&usart, 20000000, CPU_FREQUENCY), 8000000);
+    CHECK_EQ(UBRR0, 0);
+    CHECK_EQ(rfs_usart_spi_setspeed(&usart, 4000000, CPU_FREQUENCY), 4000000);
+    CHECK_EQ(UBRR0, 1);
+    CHECK_EQ(rfs_usart_spi_setspeed(&usart, 3000000, CPU_FREQUENCY), 2666666);
+    CHECK_EQ(UBRR0, 2);
+    CHECK_EQ(rfs_usart_spi_setspeed(&usart, 1000000, CPU_FREQUENCY), 1000000);
+    CHECK_EQ(UBRR0, 7);
+    CHECK_EQ(rfs_usart_spi_setspeed(&usart, 1953, CPU_FREQUENCY), 1953);
+    CHECK_EQ(UBRR0, 4095);
+    // Slower than the slowest clock
+    CHECK_EQ(rfs_usart_spi_setspeed(&usart, 100, CPU_FREQUENCY), 1953);
+    CHECK_EQ(UBRR0, RFS_USART_UBRR_MAX);
+    CHECK_EQ(rfs_usart_spi_setspeed(&usart, 0, CPU_FREQUENCY), 1953);
+    CHECK_EQ(UBRR0, RFS_USART_UBRR_MAX);
+    // 2 * frequency doesn't fit in 32 bits
+    CHECK_EQ(rfs_usart_spi_setspeed(&usart, 0x80000000, CPU_FREQUENCY), 8000000);
+    CHECK_EQ(UBRR0, 0);
+    CHECK_EQ(rfs_usart_spi_setspeed(&usart, 0xffffffff, CPU_FREQUENCY), 8000000);
+    CHECK_EQ(UBRR0, 0);
+    CHECK_EQ(rfs_usart_spi_setspeed(&usart, 0xffffffff, 0xffffffff), 0x7fffffff);
+    CHECK_EQ(UBRR0, 0);
+}
+
+void test_spi_transfer()
+{
+    const uint8_t tx_data[5] = {0x11, 0x22, 0x33, 0x44, 0x55};
+    uint8_t rx_data[5] = {0};
+    struct rfs_usart_t usart;
+    struct rfs_usart_spi_transfer_t transfer;
+
+    rfs_usart_open(&usart, RFS_USART_0, RFS_USART_MASTERSPI, RFS_USART_RXTX);
+    rfs_usart_spi_transfer_init(&transfer, &usart, tx_data, rx_data, sizeof(tx_data));
+
+    // Only two bytes are written before the first one is read
+    CHECK_EQ(rfs_usart_spi_transfer(&transfer), 1);
+    CHECK_EQ(transfer.written, 2);
+    CHECK_EQ(transfer.read, 0);
+    CHECK_EQ(UDR0, 0x22);
+
+    // Nothing to do while the USART is busy
+    UCSR0A = 0;
+    CHECK_EQ(rfs_usart_spi_transfer(&transfer), 1);
+    CHECK_EQ(transfer.written, 2);
+    CHECK_EQ(transfer.read, 0);
+
+    // With both flags set, every read takes the last written byte, as if the slave echoed it with a delay of one
+    // byte, so each byte is read before the next one is written, in order
+    UCSR0A = _BV(RXC0) | _BV(UDRE0);
+    CHECK_EQ(rfs_usart_spi_transfer(&transfer), 0);
+    CHECK_EQ(transfer.written, 5);
+    CHECK_EQ(transfer.read, 5);
+    CHECK_EQ(rx_data[0], 0x22);
+    CHECK_EQ(rx_data[1], 0x33);
+    CHECK_EQ(rx_data[2], 0x44);
+    CHECK_EQ(rx_data[3], 0x55);
+    CHECK_EQ(rx_data[4], 0x55);
+
+    // Without data to send, the filler byte is sent
+    UCSR0A = _BV(UDRE0);
+    rfs_usart_spi_transfer_init(&transfer, &usart, 0, 0, 1);
+    UDR0 = 0;
+    CHECK_EQ(rfs_usart_spi_transfer(&transfer), 1);
+    CHECK_EQ(UDR0, 0xff);
+    UCSR0A = _BV(RXC0);
+    CHECK_EQ(rfs_usart_spi_transfer(&transfer), 0);
+}
+
+void test_buffered()
+{
+    struct rfs_usart_t usart;
+    struct rfs_ringbuf_t rx_buffer;
+    struct rfs_ringbuf_t tx_buffer;
+    char rx_data[4];
+    char tx_data[4];
+    char data;
+
+    rfs_usart_open(&usart, RFS_USART_0, RFS_USART_ASYNC, RFS_USART_RXTX | RFS_USART_8BITS);
+    RFS_RINGBUF_INIT(&rx_buffer, rx_data);
+    RFS_RINGBUF_INIT(&tx_buffer, tx_data);
+    rfs_usart_setbuffers(&usart, &rx_buffer, &tx_buffer);
+    CHECK_EQ(UCSR0B & _BV(RXCIE0), _BV(RXCIE0));
+
+    // Three bytes fit in the reception buffer, the fourth one is lost
+    for (char c = '1'; c <= '4'; c++) {
+        UDR0 = c;
+        USART_RX_vect();
+    }
+    CHECK_EQ(rfs_usart_read(&usart, &data), -1);
+    CHECK_EQ(rfs_errno, RFS_EOVERRUN);
+    for (char c = '1'; c <= '3'; c++) {
+        CHECK_EQ(rfs_usart_read(&usart, &data), 1);
+        CHECK_EQ(data, c);
+    }
+    CHECK_EQ(rfs_usart_read(&usart, &data), 0);
+
+    // The transmission interrupt is enabled until the buffer is empty
+    CHECK_EQ(rfs_usart_write_buf(&usart, "abcd", 4), 3);
+    CHECK_EQ(UCSR0B & _BV(UDRIE0), _BV(UDRIE0));
+    for (char c = 'a'; c <= 'c'; c++) {
+        USART_UDRE_vect();
+        CHECK_EQ(UDR0, c);
+    }
+    USART_UDRE_vect();
+    CHECK_EQ(UCSR0B & _BV(UDRIE0), 0);
+
+    // Dropping the transmission buffer with bytes still queued disables its interrupt, and setting it again
+    // enables it
+    CHECK_EQ(rfs_usart_write_buf(&usart, "ef", 2), 2);
+    rfs_usart_setbuffers(&usart, &rx_buffer, 0);
+    CHECK_EQ(UCSR0B & _BV(UDRIE0), 0);
+    CHECK_EQ(UCSR0B & _BV(RXCIE0), _BV(RXCIE0));
+    rfs_usart_setbuffers(&usart, 0, &tx_buffer);
+    CHECK_EQ(UCSR0B & _BV(UDRIE0), _BV(UDRIE0));
+    CHECK_EQ(UCSR0B & _BV(RXCIE0), 0);
+    USART_UDRE_vect();
+    CHECK_EQ(UDR0, 'e');
+}
+
+void test_ringbuf()
+{
+    struct rfs_ringbuf_t buffer;
+    char data[6];
+    char c = 0;
+
+    // The indexes wrap around with a mask, so only the powers of two are valid sizes
+    CHECK_EQ(rfs_ringbuf_init(&buffer, data, 6), 0);
+    CHECK_EQ(rfs_ringbuf_put(&buffer, 'a'), 0);
+    CHECK_EQ(rfs_ringbuf_get(&buffer, &c), 0);
+    CHECK_EQ(rfs_ringbuf_init(&buffer, data, 512), 0);
+    CHECK_EQ(rfs_ringbuf_init(&buffer, data, 1), 0);
+    CHECK_EQ(rfs_ringbuf_init(&buffer, data, 4), 1);
+    CHECK_EQ(rfs_ringbuf_put(&buffer, 'a'), 1);
+    CHECK_EQ(rfs_ringbuf_get(&buffer, &c), 1);
+    CHECK_EQ(c, 'a');
+}
+
+void test_stats()
+{
+    struct rfs_usart_t usart;
+    struct rfs_usart_stats_t stats;
+    struct rfs_usart_counters_t counters;
+    volatile uint16_t clock = 100;
+    char data;
+
+    rfs_usart_open(&usart, RFS_USART_0, RFS_USART_ASYNC, RFS_USART_RXTX | RFS_USART_8BITS);
+    rfs_usart_setstats(&usart, &stats, &clock);
+    UCSR0A |= _BV(RXC0) | _BV(UPE0);
+    clock = 150;
+    rfs_usart_read(&usart, &data);
+    rfs_usart_write(&usart, 'x');
+
+    // The counters are read with the interrupts disabled, and the interrupts state is restored afterwards
+    sei();
+    rfs_usart_getstats(&usart, &counters, 1);
+    CHECK_EQ(SREG & _BV(SREG_I), _BV(SREG_I));
+    CHECK_EQ(counters.parity_errors, 1);
+    CHECK_EQ(counters.rx_bytes, 0);
+    CHECK_EQ(counters.tx_bytes, 1);
+    CHECK_EQ(counters.max_poll_gap, 50);
+    rfs_usart_getstats(&usart, &counters, 0);
+    CHECK_EQ(counters.tx_bytes, 0);
+}
+
+int main()
+{
+    RUN(test_open);
+    RUN(test_parity);
+    RUN(test_setspeed);
+    RUN(test_getspeed);
+    RUN(test_read);
+    RUN(test_write);
+    RUN(test_write9);
+    RUN(test_setmultiprocessor);
+    RUN(test_spi_setspeed);
+    RUN(test_spi_transfer);
+    RUN(test_buffered);
+    RUN(test_ringbuf);
+    RUN(test_stats);
+    return unit_result();
+}